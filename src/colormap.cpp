@@ -8,8 +8,13 @@
 
 #include "colormap.hpp"
 #include <algorithm>
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #if defined(UNITTEST)
 #include <doctest/doctest.h>
+#include <cmath>
 #endif
 
 
@@ -28,7 +33,8 @@ static void copy_color(std::vector<float>& Out, const std::vector<float>& Src) {
 }
 
 // Requires that value is strictly between end-points, no equality.
-static std::size_t binary_search(float V, const std::vector<std::vector<float>> Map)
+static std::size_t binary_search(
+    float V, const std::vector<std::vector<float>>& Map)
 {
     std::size_t low = 0;
     std::size_t high = Map.size() - 1;
@@ -76,6 +82,148 @@ std::vector<float> Interpolated(
     return out;
 }
 
+ColorMap::ColorMap(const std::vector<std::vector<float>>& Map)
+    : channels(0), table(TableSize, 0), scale(0.0f)
+{
+    if (Map.empty())
+        throw std::runtime_error("Color map is empty.");
+    std::vector<std::vector<float>> sorted(Map);
+    SortColorMap(sorted);
+    if (sorted.front().empty())
+        throw std::runtime_error("Color map entry is empty.");
+    channels = sorted.front().size() - 1;
+    thresholds.reserve(sorted.size());
+    colors.reserve(sorted.size() * channels);
+    for (auto& entry : sorted) {
+        if (entry.size() != channels + 1)
+            throw std::runtime_error("Color map entries differ in size.");
+        thresholds.push_back(entry.front());
+        colors.insert(colors.end(), entry.begin() + 1, entry.end());
+    }
+    if (thresholds.size() < 2 || !(thresholds.front() < thresholds.back()))
+        return;
+    const double low = thresholds.front();
+    const double span = double(thresholds.back()) - low;
+    scale = float(TableSize / span);
+    for (std::size_t b = 0; b < TableSize; ++b) {
+        const float start = float(low + span * b / TableSize);
+        std::size_t k = std::upper_bound(thresholds.begin(), thresholds.end(),
+            start) - thresholds.begin();
+        k = (k == 0) ? 0 : k - 1;
+        table[b] = std::uint32_t(std::min(k, thresholds.size() - 2));
+    }
+}
+
+// Table position clamped like in the SIMD code, where NaN also gives 0.
+static std::size_t table_position(float P) {
+    if (!(0.0f < P))
+        return 0;
+    return (P < float(ColorMap::TableSize)) ?
+        std::size_t(P) : ColorMap::TableSize - 1;
+}
+
+std::size_t ColorMap::bucket(float V) const {
+    return table_position((V - thresholds.front()) * scale);
+}
+
+// Requires that V is strictly between end-points. Table entry is at most a
+// rounding error off so the walk is short.
+std::size_t ColorMap::segment(float V, std::size_t Bucket) const {
+    std::size_t k = table[Bucket];
+    while (k > 0 && V < thresholds[k])
+        --k;
+    while (thresholds[k + 1] <= V)
+        ++k;
+    return k;
+}
+
+std::size_t ColorMap::index(float V, std::size_t Bucket) const {
+    if (V <= thresholds.front())
+        return 0;
+    if (thresholds.back() <= V)
+        return thresholds.size() - 1;
+    return segment(V, Bucket);
+}
+
+std::size_t ColorMap::Index(float V) const {
+    return index(V, bucket(V));
+}
+
+void ColorMap::color(float V, std::size_t Bucket, float* Out) const {
+    const float* src;
+    if (V <= thresholds.front())
+        src = colors.data();
+    else if (thresholds.back() <= V || thresholds.size() == 1)
+        src = colors.data() + (thresholds.size() - 1) * channels;
+    else {
+        const std::size_t k = segment(V, Bucket);
+        const float range = thresholds[k + 1] - thresholds[k];
+        const float low = (thresholds[k + 1] - V) / range;
+        const float high = (V - thresholds[k]) / range;
+        const float* a = colors.data() + k * channels;
+        const float* b = a + channels;
+        for (std::size_t c = 0; c < channels; ++c)
+            Out[c] = low * a[c] + high * b[c];
+        return;
+    }
+    std::copy(src, src + channels, Out);
+}
+
+void ColorMap::Interpolated(float V, float* Out) const {
+    color(V, bucket(V), Out);
+}
+
+// Calls Func(k, V, Bucket) for each normalized value of Row.
+template<typename Function>
+static void each_position(const float* Row, std::size_t Count, float Min,
+    float Range, float Front, float Scale, Function Func)
+{
+    std::size_t k = 0;
+#if defined(__SSE2__)
+    // Values and table positions 4 at a time, segments one by one.
+    const __m128 min = _mm_set1_ps(Min);
+    const __m128 range = _mm_set1_ps(Range);
+    const __m128 front = _mm_set1_ps(Front);
+    const __m128 sc = _mm_set1_ps(Scale);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 top = _mm_set1_ps(float(ColorMap::TableSize - 1));
+    alignas(16) float v[4];
+    alignas(16) std::int32_t b[4];
+    for (; k + 4 <= Count; k += 4) {
+        const __m128 x =
+            _mm_div_ps(_mm_sub_ps(_mm_loadu_ps(Row + k), min), range);
+        _mm_store_ps(v, x);
+        const __m128 p = _mm_min_ps(
+            _mm_max_ps(_mm_mul_ps(_mm_sub_ps(x, front), sc), zero), top);
+        _mm_store_si128(reinterpret_cast<__m128i*>(b), _mm_cvttps_epi32(p));
+        for (int j = 0; j < 4; ++j)
+            Func(k + j, v[j], std::size_t(b[j]));
+    }
+#endif
+    for (; k < Count; ++k) {
+        const float v = (Row[k] - Min) / Range;
+        Func(k, v, table_position((v - Front) * Scale));
+    }
+}
+
+void ColorMap::MapRow(const float* Row, std::size_t Count, float Min,
+    float Range, float* Out) const
+{
+    each_position(Row, Count, Min, Range, thresholds.front(), scale,
+        [this, Out](std::size_t K, float V, std::size_t Bucket) {
+            color(V, Bucket, Out + K * channels);
+        });
+}
+
+void ColorMap::IndexRow(const float* Row, std::size_t Count, float Min,
+    float Range, std::uint32_t* Out) const
+{
+    each_position(Row, Count, Min, Range, thresholds.front(), scale,
+        [this, Out](std::size_t K, float V, std::size_t Bucket) {
+            Out[K] = std::uint32_t(index(V, Bucket));
+        });
+}
+
 #if defined(UNITTEST)
 
 TEST_CASE("front_less") {
@@ -178,5 +326,80 @@ TEST_CASE("interpolate") {
     }
 }
 
-#endif
+TEST_CASE("ColorMap") {
+    std::vector<std::vector<float>> map;
+    map.push_back(std::vector<float> { 1.0f, 1.0f, 0.0f });
+    map.push_back(std::vector<float> { 0.0f, 0.0f, 0.5f });
+    map.push_back(std::vector<float> { 0.3f, 0.2f, 0.25f });
+    map.push_back(std::vector<float> { 0.3f, 0.9f, 0.75f });
+    map.push_back(std::vector<float> { 0.31f, 0.1f, 0.0f });
+    ColorMap compiled(map);
+    SortColorMap(map);
+    REQUIRE(compiled.Size() == 5);
+    REQUIRE(compiled.Channels() == 2);
+    REQUIRE(compiled.Threshold(4) == 1.0f);
+    SUBCASE("Same as Interpolated") {
+        std::vector<float> row;
+        for (int k = -10; k < 1010; ++k)
+            row.push_back(float(k) / 1000.0f);
+        row.push_back(0.3f);
+        row.push_back(std::nextafter(0.3f, 0.0f));
+        row.push_back(0.31f);
+        std::vector<float> out(row.size() * 2);
+        compiled.MapRow(row.data(), row.size(), 0.0f, 1.0f, out.data());
+        std::vector<std::uint32_t> idx(row.size());
+        compiled.IndexRow(row.data(), row.size(), 0.0f, 1.0f, idx.data());
+        for (std::size_t k = 0; k < row.size(); ++k) {
+            REQUIRE(compiled.Index(row[k]) == IndexInMap(row[k], map));
+            REQUIRE(idx[k] == compiled.Index(row[k]));
+            std::vector<float> expected = Interpolated(row[k], map);
+            REQUIRE(out[2 * k] == expected[0]);
+            REQUIRE(out[2 * k + 1] == expected[1]);
+            float one[2];
+            compiled.Interpolated(row[k], one);
+            REQUIRE(one[0] == expected[0]);
+        }
+    }
+    SUBCASE("Scaled row") {
+        const float row[5] = { 10.0f, 12.0f, 13.0f, 15.0f, 20.0f };
+        float out[10];
+        compiled.MapRow(row, 5, 10.0f, 10.0f, out);
+        REQUIRE(out[0] == 0.0f);
+        REQUIRE(out[1] == 0.5f);
+        REQUIRE(out[6] == Interpolated(0.5f, map)[0]);
+        REQUIRE(out[8] == 1.0f);
+    }
+    SUBCASE("Below first threshold") {
+        // Three values go through the scalar code even with SIMD.
+        const float row[3] = { -5.0f, -1e30f, -0.001f };
+        float out[6];
+        compiled.MapRow(row, 3, 0.0f, 1.0f, out);
+        std::uint32_t idx[3];
+        compiled.IndexRow(row, 3, 0.0f, 1.0f, idx);
+        for (int k = 0; k < 3; ++k) {
+            REQUIRE(out[2 * k] == 0.0f);
+            REQUIRE(out[2 * k + 1] == 0.5f);
+            REQUIRE(idx[k] == 0);
+            REQUIRE(compiled.Index(row[k]) == 0);
+            float one[2];
+            compiled.Interpolated(row[k], one);
+            REQUIRE(one[1] == 0.5f);
+        }
+    }
+    SUBCASE("Single entry") {
+        ColorMap single(std::vector<std::vector<float>> { { 0.5f, 2.0f } });
+        float out[1];
+        single.Interpolated(0.25f, out);
+        REQUIRE(out[0] == 2.0f);
+        single.Interpolated(0.75f, out);
+        REQUIRE(out[0] == 2.0f);
+        REQUIRE(single.Index(0.75f) == 0);
+    }
+    SUBCASE("Invalid") {
+        REQUIRE_THROWS(ColorMap(std::vector<std::vector<float>>()));
+        REQUIRE_THROWS(ColorMap(std::vector<std::vector<float>> {
+            { 0.0f, 1.0f }, { 1.0f } }));
+    }
+}
 
+#endif
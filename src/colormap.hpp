@@ -12,6 +12,8 @@
 // Helpers to deal with color map and gettting interpolated values.
 
 #include <vector>
+#include <cstdint>
+#include <cstddef>
 
 
 void SortColorMap(std::vector<std::vector<float>>& Map);
@@ -21,4 +23,44 @@ std::size_t IndexInMap(float V, const std::vector<std::vector<float>>& Map);
 std::vector<float> Interpolated(
     float V, const std::vector<std::vector<float>>& Map);
 
+// Sorted color map laid out for mapping many values. Thresholds and colors
+// are in flat arrays, and a table over the threshold range gives the segment
+// to start from, so that a lookup does not search the whole map. Results are
+// the same as from IndexInMap and Interpolated.
+class ColorMap {
+private:
+    std::vector<float> thresholds, colors;
+    std::size_t channels;
+    std::vector<std::uint32_t> table;
+    float scale;
+
+    std::size_t segment(float V, std::size_t Bucket) const;
+    std::size_t bucket(float V) const;
+    std::size_t index(float V, std::size_t Bucket) const;
+    void color(float V, std::size_t Bucket, float* Out) const;
+
+public:
+    static const std::size_t TableSize = 4096;
+
+    // Throws if Map is empty.
+    ColorMap(const std::vector<std::vector<float>>& Map);
+
+    std::size_t Size() const { return thresholds.size(); }
+    std::size_t Channels() const { return channels; }
+    float Threshold(std::size_t K) const { return thresholds[K]; }
+    const float* Color(std::size_t K) const {
+        return colors.data() + K * channels;
+    }
+
+    std::size_t Index(float V) const;
+    // Channels() values of color for V to Out.
+    void Interpolated(float V, float* Out) const;
+    // Colors for (Row[k] - Min) / Range to Out, Channels() values each.
+    void MapRow(const float* Row, std::size_t Count, float Min, float Range,
+        float* Out) const;
+    // Index for (Row[k] - Min) / Range to Out.
+    void IndexRow(const float* Row, std::size_t Count, float Min, float Range,
+        std::uint32_t* Out) const;
+};
+
 #endif
@@ -11,52 +11,266 @@
 #if !defined(CONVENIENCE_HPP)
 #define CONVENIENCE_HPP
 
+#include "numberparse.hpp"
+#include "inputsource.hpp"
 #include <vector>
+#include <string>
+#include <memory>
+#include <utility>
+#include <type_traits>
 #include <exception>
-#include <unistd.h>
-#include <cerrno>
+#include <stdexcept>
 #include <iostream>
 
 
+// Value of a top-level key that is parsed by NumberArrayParser instead of the
+// generated parser.
+template<typename Result>
+class NumberArrayKey {
+public:
+    virtual ~NumberArrayKey() { }
+    virtual const std::string& Key() const = 0;
+    virtual void Begin() = 0;
+    virtual const char* Parse(const char* Begin, const char* End) = 0;
+    virtual bool Finished() const = 0;
+    virtual void Move(Result& Val) = 0;
+};
+
+// Values up to threshold bytes are parsed as they arrive. After that the
+// rest of the text is kept and indexed for row starts, and once the closing
+// bracket is found the remaining rows are parsed in parallel.
+template<typename Result, typename Value, typename Accessor>
+class NumberArrayField : public NumberArrayKey<Result> {
+private:
+    typedef typename std::decay<
+        decltype(std::declval<Accessor>()(std::declval<Result&>()))>::type
+            Container;
+    std::string key;
+    Accessor accessor;
+    NumberArrayParser<Value> parser;
+    Container values;
+    bool used;
+    const std::size_t threshold;
+    std::size_t streamed;
+    bool buffering, finished;
+    int depth;
+    std::string text;
+    std::vector<std::size_t> starts;
+    std::unique_ptr<ThreadPool> pool;
+
+    void check_lead() const {
+        bool comma = false;
+        const std::size_t lead = starts.empty() ? text.size() : starts[0];
+        for (std::size_t k = 0; k < lead; ++k) {
+            const char c = text[k];
+            if (c == ',' && !comma && !starts.empty())
+                comma = true;
+            else if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+                throw std::runtime_error(
+                    "Unexpected character in number array.");
+        }
+        if (!starts.empty() && !comma)
+            throw std::runtime_error("Expected comma between arrays.");
+    }
+
+    void parse_buffered() {
+        check_lead();
+        if (starts.empty())
+            return;
+        const std::size_t first = values.size();
+        values.resize(first + starts.size());
+        if (!pool)
+            pool.reset(new ThreadPool());
+        ParseRows<Value>(text.data(), text.size(), starts, values, first,
+            *pool);
+    }
+
+public:
+    NumberArrayField(const std::string& Key, Accessor A,
+        std::size_t Threshold = 1 << 24)
+        : key(Key), accessor(A), used(false), threshold(Threshold),
+        streamed(0), buffering(false), finished(false), depth(0) { }
+    const std::string& Key() const { return key; }
+    void Begin() {
+        parser.Reset();
+        values = Container();
+        used = true;
+        streamed = 0;
+        buffering = finished = false;
+        text.resize(0);
+        starts.resize(0);
+    }
+    const char* Parse(const char* Begin, const char* End) {
+        if (!buffering) {
+            const char* pos = parser.Parse(Begin, End, values);
+            streamed += pos - Begin;
+            if (threshold <= streamed)
+                parser.PauseAfterRow();
+            if (!parser.Paused())
+                return pos;
+            buffering = true;
+            depth = 1;
+            Begin = pos;
+        }
+        const std::size_t count = starts.size();
+        const char* stop = IndexRows(Begin, Begin, End, depth, starts);
+        for (std::size_t k = count; k < starts.size(); ++k)
+            starts[k] += text.size();
+        text.append(Begin, stop);
+        if (stop == End)
+            return End;
+        parse_buffered();
+        text = std::string();
+        starts = std::vector<std::size_t>();
+        finished = true;
+        return stop + 1;
+    }
+    bool Finished() const { return finished || parser.Finished(); }
+    void Move(Result& Val) {
+        if (used)
+            std::swap(accessor(Val), values);
+        used = false;
+        values = Container();
+    }
+};
+
 template<typename Pool, typename Parser, typename Result>
 class InputParser {
 private:
-    bool eof;
-    int fd;
-    const std::size_t block_size = 65536;
-    std::vector<char> buffer;
+    std::unique_ptr<InputSource> input;
     Pool pp;
     Parser parser;
+    // Top-level keys with number array values and the scanning state that
+    // finds them in the input.
+    std::vector<std::unique_ptr<NumberArrayKey<Result>>> number_arrays;
+    NumberArrayKey<Result>* active;
+    NumberArrayKey<Result>* pending;
+    int depth;
+    bool in_string, escape, expect_key, in_key, key_done;
+    std::string key;
+    const std::string placeholder = "[[0]]";
 
-public:
-    typedef int (*Worker)(Result& Val);
+    void reset_scan() {
+        active = pending = nullptr;
+        depth = 0;
+        in_string = escape = expect_key = in_key = key_done = false;
+    }
 
-    InputParser(int FileDescriptor)
-        : eof(false), fd(FileDescriptor), buffer(block_size + 1, 0) { }
+    NumberArrayKey<Result>* find(const std::string& Key) {
+        for (auto& na : number_arrays)
+            if (na->Key() == Key)
+                return na.get();
+        return nullptr;
+    }
 
-    int ReadAndParse(Worker W) {
-        const char* end = nullptr;
-        while (!eof) {
-            if (end == nullptr) {
-                if (buffer.size() != block_size + 1)
-                    buffer.resize(block_size + 1);
-                errno = 0;
-                int count = read(fd, &buffer.front(), block_size);
-                eof = (count == 0) ||
-                    (count < 0 && !(errno == EAGAIN || errno == EINTR));
-                if (count <= 0)
+    // Returns the start of a number array value to parse or the position
+    // past the end of the object, End if neither is in range.
+    const char* scan(const char* Begin, const char* End) {
+        for (; Begin != End; ++Begin) {
+            const char c = *Begin;
+            if (in_string) {
+                if (escape)
+                    escape = false;
+                else if (c == '\\')
+                    escape = true;
+                else if (c == '"') {
+                    in_string = false;
+                    key_done = in_key;
+                    in_key = false;
+                    continue;
+                }
+                if (in_key)
+                    key.push_back(c);
+                continue;
+            }
+            if (pending != nullptr) {
+                if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
                     continue;
-                buffer.resize(count + 1);
-                buffer.back() = 0;
-                end = &buffer.front();
+                if (c == '[')
+                    return Begin;
+                pending = nullptr;
             }
+            switch (c) {
+            case '"':
+                in_string = true;
+                in_key = (depth == 1 && expect_key);
+                expect_key = false;
+                key.resize(0);
+                break;
+            case ':':
+                if (depth == 1 && key_done)
+                    pending = find(key);
+                key_done = false;
+                break;
+            case ',':
+                expect_key = (depth == 1);
+                break;
+            case '{':
+            case '[':
+                expect_key = (++depth == 1);
+                break;
+            case '}':
+            case ']':
+                if (--depth == 0)
+                    return Begin + 1;
+                break;
+            }
+        }
+        return End;
+    }
+
+    const char* parse(const char* Begin, const char* End) {
+        if (number_arrays.empty())
+            return parser.Parse(Begin, End, pp);
+        const char* from = Begin;
+        while (Begin != End) {
+            if (active != nullptr) {
+                Begin = active->Parse(Begin, End);
+                if (!active->Finished())
+                    return End;
+                active = nullptr;
+                from = Begin;
+                continue;
+            }
+            Begin = scan(Begin, End);
+            if (pending != nullptr && Begin != End) {
+                // Generated parser sees a minimal valid value instead.
+                if (from != Begin)
+                    parser.Parse(from, Begin, pp);
+                parser.Parse(placeholder.data(),
+                    placeholder.data() + placeholder.size(), pp);
+                active = pending;
+                pending = nullptr;
+                active->Begin();
+                continue;
+            }
+            if (depth == 0) {
+                reset_scan();
+                return parser.Parse(from, Begin, pp);
+            }
+        }
+        if (from != End)
+            parser.Parse(from, End, pp);
+        return End;
+    }
+
+public:
+    typedef int (*Worker)(Result& Val);
+
+private:
+    int read_and_parse(Worker W) {
+        const char* end = nullptr;
+        const char* last = nullptr;
+        while (true) {
+            if (end == nullptr && !input->Next(end, last))
+                break;
             if (parser.Finished()) {
-                end = pp.skipWhitespace(end, &buffer.back());
+                end = pp.skipWhitespace(end, last);
                 if (end == nullptr)
                     continue;
             }
             try {
-                end = parser.Parse(end, &buffer.back(), pp);
+                end = parse(end, last);
             }
             catch (const std::exception& e) {
                 std::cerr << e.what() << std::endl;
@@ -68,12 +282,42 @@ public:
             }
             Result val;
             parser.Swap(val.values);
+            for (auto& na : number_arrays)
+                na->Move(val);
             int rv = W(val);
             if (rv)
                 return rv;
         }
         return 0;
     }
+
+public:
+    // Input is handed to the parser in pieces of at most ChunkSize bytes.
+    // Buffers is the number of pieces read ahead when input is not a file.
+    InputParser(int FileDescriptor, std::size_t ChunkSize = 1 << 22,
+        std::size_t Buffers = 4)
+        : input(InputSource::Open(FileDescriptor, ChunkSize, Buffers))
+    {
+        reset_scan();
+    }
+
+    // Parse the array of arrays of numbers under Key using the fast path.
+    // Accessor(Result&) returns the container the generated parser would
+    // fill. Value is float or double. Values longer than Threshold bytes
+    // have the rest of their rows parsed in parallel.
+    template<typename Value, typename Accessor>
+    void AddNumberArray(const std::string& Key, Accessor A,
+        std::size_t Threshold = 1 << 24)
+    {
+        number_arrays.push_back(std::unique_ptr<NumberArrayKey<Result>>(
+            new NumberArrayField<Result, Value, Accessor>(Key, A, Threshold)));
+    }
+
+    int ReadAndParse(Worker W) {
+        int status = read_and_parse(W);
+        ReportStats(input->Statistics());
+        return status;
+    }
 };
 
 #endif
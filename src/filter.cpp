@@ -0,0 +1,450 @@
+//
+//  filter.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "filter.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+FilterKind FilterKindFromName(const std::string& Name) {
+    if (Name == "box")
+        return FilterBox;
+    if (Name == "gaussian")
+        return FilterGaussian;
+    if (Name == "min")
+        return FilterMin;
+    if (Name == "max")
+        return FilterMax;
+    throw std::runtime_error("Unknown filter: " + Name);
+}
+
+std::uint32_t FilterPasses(FilterKind Kind) {
+    return (Kind == FilterGaussian) ? 3 : 1;
+}
+
+// Same choices as _mm_min_ps and _mm_max_ps make.
+struct MinOp {
+    float operator()(float A, float B) const { return (A < B) ? A : B; }
+#if defined(__SSE2__)
+    __m128 operator()(__m128 A, __m128 B) const { return _mm_min_ps(A, B); }
+#endif
+};
+
+struct MaxOp {
+    float operator()(float A, float B) const { return (A > B) ? A : B; }
+#if defined(__SSE2__)
+    __m128 operator()(__m128 A, __m128 B) const { return _mm_max_ps(A, B); }
+#endif
+};
+
+// Mean of each 2 * Radius + 1 values of In to Count values of Out.
+static void box_line(
+    float* Out, const float* In, std::size_t Count, std::uint32_t Radius)
+{
+    const std::size_t span = 2 * std::size_t(Radius);
+    const double inv = 1.0 / (span + 1);
+    double sum = 0.0;
+    for (std::size_t i = 0; i < span; ++i)
+        sum += In[i];
+    for (std::size_t x = 0; x < Count; ++x) {
+        sum += In[x + span];
+        Out[x] = static_cast<float>(sum * inv);
+        sum -= In[x];
+    }
+}
+
+// Prefix is from the start of each block of 2 * Radius + 1 values and Suffix
+// to the end. A window covers a suffix and the following prefix.
+template<typename Op>
+static void extreme_line(float* Out, const float* In, std::size_t Count,
+    std::uint32_t Radius, float* Prefix, float* Suffix, Op Combine)
+{
+    const std::size_t k = 2 * std::size_t(Radius) + 1;
+    const std::size_t length = Count + k - 1;
+    for (std::size_t i = 0; i < length; ++i)
+        Prefix[i] = (i % k) ? Combine(Prefix[i - 1], In[i]) : In[i];
+    Suffix[length - 1] = In[length - 1];
+    for (std::size_t i = length - 1; i-- > 0;)
+        Suffix[i] = (i % k == k - 1) ? In[i] : Combine(In[i], Suffix[i + 1]);
+    for (std::size_t x = 0; x < Count; ++x)
+        Out[x] = Combine(Suffix[x], Prefix[x + k - 1]);
+}
+
+void FilterLine(float* Out, const float* In, std::size_t Count,
+    FilterKind Kind, std::uint32_t Radius, std::vector<float>& Work)
+{
+    if (!Count)
+        return;
+    const std::uint32_t passes = FilterPasses(Kind);
+    const std::size_t length = Count + 2 * std::size_t(passes) * Radius;
+    Work.resize(2 * length);
+    if (Kind == FilterMin || Kind == FilterMax) {
+        if (Kind == FilterMin)
+            extreme_line(Out, In, Count, Radius, Work.data(),
+                Work.data() + length, MinOp());
+        else
+            extreme_line(Out, In, Count, Radius, Work.data(),
+                Work.data() + length, MaxOp());
+        return;
+    }
+    // Each pass drops Radius values from both ends.
+    const float* src = In;
+    for (std::uint32_t p = 0; p < passes; ++p) {
+        float* dst = (p + 1 == passes) ? Out : Work.data() + (p % 2) * length;
+        box_line(dst, src,
+            Count + 2 * std::size_t(passes - 1 - p) * Radius, Radius);
+        src = dst;
+    }
+}
+
+// State of one pass along the columns. Row N of the input of the pass is
+// given to Step for a range of columns at a time, so that threads can share
+// the rows with a range of columns each.
+class ColumnPass {
+private:
+    FilterKind kind;
+    std::uint32_t radius;
+    std::size_t k;
+    // Ring of k rows for the mean. Rows of the current block and the suffix
+    // of the previous one for the minimum and maximum.
+    HeightField rows[2];
+    std::vector<double> sums;
+    std::vector<float> prefix;
+
+    void mean(std::uint64_t N, const float* In, float* Out,
+        std::size_t Begin, std::size_t End);
+    template<typename Op>
+    void extreme(std::uint64_t N, const float* In, float* Out,
+        std::size_t Begin, std::size_t End, Op Combine);
+
+public:
+    ColumnPass(FilterKind Kind, std::uint32_t Radius, std::uint32_t Width);
+
+    // True and writes the result for row N - 2 * radius when N is at least
+    // 2 * radius.
+    bool Step(std::uint64_t N, const float* In, float* Out,
+        std::size_t Begin, std::size_t End);
+};
+
+ColumnPass::ColumnPass(
+    FilterKind Kind, std::uint32_t Radius, std::uint32_t Width)
+    : kind(Kind), radius(Radius), k(2 * std::size_t(Radius) + 1)
+{
+    rows[0] = HeightField(Width, k);
+    if (kind == FilterMin || kind == FilterMax) {
+        rows[1] = HeightField(Width, k);
+        prefix.resize(Width);
+    } else
+        sums.resize(Width, 0.0);
+}
+
+void ColumnPass::mean(std::uint64_t N, const float* In, float* Out,
+    std::size_t Begin, std::size_t End)
+{
+    float* slot = rows[0].Row(N % k);
+    // Row N - 2 * radius leaves the window after this row.
+    const float* oldest = rows[0].Row((N + 1) % k);
+    const bool full = 2 * std::uint64_t(radius) <= N;
+    const double inv = 1.0 / k;
+    double* sum = sums.data();
+    std::size_t c = Begin;
+#if defined(__SSE2__)
+    if (full) {
+        const __m128d vinv = _mm_set1_pd(inv);
+        for (; c + 4 <= End; c += 4) {
+            const __m128 v = _mm_loadu_ps(In + c);
+            _mm_storeu_ps(slot + c, v);
+            const __m128 o = _mm_loadu_ps(oldest + c);
+            const __m128d lo =
+                _mm_add_pd(_mm_loadu_pd(sum + c), _mm_cvtps_pd(v));
+            const __m128d hi = _mm_add_pd(
+                _mm_loadu_pd(sum + c + 2), _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+            _mm_storeu_ps(Out + c, _mm_movelh_ps(
+                _mm_cvtpd_ps(_mm_mul_pd(lo, vinv)),
+                _mm_cvtpd_ps(_mm_mul_pd(hi, vinv))));
+            _mm_storeu_pd(sum + c, _mm_sub_pd(lo, _mm_cvtps_pd(o)));
+            _mm_storeu_pd(sum + c + 2,
+                _mm_sub_pd(hi, _mm_cvtps_pd(_mm_movehl_ps(o, o))));
+        }
+    }
+#endif
+    for (; c < End; ++c) {
+        slot[c] = In[c];
+        sum[c] += In[c];
+        if (full) {
+            Out[c] = static_cast<float>(sum[c] * inv);
+            sum[c] -= oldest[c];
+        }
+    }
+}
+
+template<typename Op>
+void ColumnPass::extreme(std::uint64_t N, const float* In, float* Out,
+    std::size_t Begin, std::size_t End, Op Combine)
+{
+    const std::size_t m = N % k;
+    HeightField& current = rows[(N / k) % 2];
+    float* row = current.Row(m);
+    float* pre = prefix.data();
+    const bool full = 2 * std::uint64_t(radius) <= N;
+    // Window that ends at the last row of a block is the block.
+    const float* suffix =
+        (full && m + 1 < k) ? rows[(N / k + 1) % 2].Row(m + 1) : nullptr;
+    std::size_t c = Begin;
+#if defined(__SSE2__)
+    for (; c + 4 <= End; c += 4) {
+        const __m128 v = _mm_loadu_ps(In + c);
+        _mm_storeu_ps(row + c, v);
+        const __m128 p = m ? Combine(_mm_loadu_ps(pre + c), v) : v;
+        _mm_storeu_ps(pre + c, p);
+        if (full)
+            _mm_storeu_ps(Out + c,
+                suffix ? Combine(_mm_loadu_ps(suffix + c), p) : p);
+    }
+#endif
+    for (; c < End; ++c) {
+        row[c] = In[c];
+        pre[c] = m ? Combine(pre[c], In[c]) : In[c];
+        if (full)
+            Out[c] = suffix ? Combine(suffix[c], pre[c]) : pre[c];
+    }
+    if (m + 1 < k)
+        return;
+    // Block is complete and becomes the suffix for the next block.
+    for (std::size_t i = k - 1; i-- > 0;) {
+        float* r = current.Row(i);
+        const float* below = current.Row(i + 1);
+        c = Begin;
+#if defined(__SSE2__)
+        for (; c + 4 <= End; c += 4)
+            _mm_storeu_ps(r + c,
+                Combine(_mm_loadu_ps(r + c), _mm_loadu_ps(below + c)));
+#endif
+        for (; c < End; ++c)
+            r[c] = Combine(r[c], below[c]);
+    }
+}
+
+bool ColumnPass::Step(std::uint64_t N, const float* In, float* Out,
+    std::size_t Begin, std::size_t End)
+{
+    if (kind == FilterMin)
+        extreme(N, In, Out, Begin, End, MinOp());
+    else if (kind == FilterMax)
+        extreme(N, In, Out, Begin, End, MaxOp());
+    else
+        mean(N, In, Out, Begin, End);
+    return 2 * std::uint64_t(radius) <= N;
+}
+
+// Index of value I of Count values, beyond the edges as Wrap says.
+static std::size_t source(std::int64_t I, std::size_t Count, bool Wrap) {
+    const std::int64_t count = static_cast<std::int64_t>(Count);
+    if (0 <= I && I < count)
+        return static_cast<std::size_t>(I);
+    if (!Wrap)
+        return (I < 0) ? 0 : Count - 1;
+    const std::int64_t m = I % count;
+    return static_cast<std::size_t>((m < 0) ? m + count : m);
+}
+
+void FilterRows(HeightFieldRowReader& Rows, const FilterSpec& Spec,
+    ThreadPool& Pool, const std::function<void(const float*)>& Out)
+{
+    const std::uint32_t width = Rows.Width(), height = Rows.Height();
+    if (!width || !height)
+        return;
+    const std::uint32_t passes = FilterPasses(Spec.kind);
+    const std::uint32_t r = Spec.radius;
+    const std::size_t pad = std::size_t(passes) * r;
+    const std::size_t row_size = sizeof(float) * width;
+    const std::uint32_t block = 64;
+    HeightField raw(width, block), across(width, block), results(width, block);
+    // Rows above the first and below the last, filtered along the rows.
+    HeightField before(width, Spec.wrap ? pad : 0);
+    HeightField after(width, Spec.wrap ? pad : 0);
+    std::vector<ColumnPass> columns;
+    std::vector<std::vector<float>> between(passes);
+    for (std::uint32_t p = 0; p < passes; ++p) {
+        columns.push_back(ColumnPass(Spec.kind, r, width));
+        between[p].resize(width);
+    }
+    auto along_rows = [&](const HeightField& Src, HeightField& Dst,
+        std::size_t Count)
+    {
+        Pool.ParallelFor(Count, [&](std::size_t Begin, std::size_t End) {
+            std::vector<float> line(width + 2 * pad), work;
+            for (std::size_t k = Begin; k < End; ++k) {
+                const float* row = Src.Row(k);
+                for (std::size_t i = 0; i < pad; ++i) {
+                    line[i] = row[source(std::int64_t(i) - std::int64_t(pad),
+                        width, Spec.wrap)];
+                    line[pad + width + i] =
+                        row[source(width + i, width, Spec.wrap)];
+                }
+                std::memcpy(line.data() + pad, row, row_size);
+                FilterLine(Dst.Row(k), line.data(), width, Spec.kind, r, work);
+            }
+        });
+    };
+    // Rows in order from the row pad above the first, each given once.
+    std::uint64_t pushed = 0;
+    auto along_columns = [&](const std::vector<const float*>& Sequence) {
+        for (std::size_t s0 = 0; s0 < Sequence.size(); s0 += block) {
+            const std::size_t n = std::min<std::size_t>(
+                block, Sequence.size() - s0);
+            Pool.ParallelFor(width, [&](std::size_t Begin, std::size_t End) {
+                std::size_t done = 0;
+                for (std::size_t k = 0; k < n; ++k) {
+                    const float* in = Sequence[s0 + k];
+                    std::uint64_t index = pushed + k;
+                    bool produced = true;
+                    for (std::uint32_t p = 0; produced && p < passes; ++p) {
+                        float* out = (p + 1 == passes) ?
+                            results.Row(done) : between[p].data();
+                        produced = columns[p].Step(index, in, out, Begin, End);
+                        in = out;
+                        index -= 2 * std::uint64_t(r);
+                    }
+                    if (produced)
+                        ++done;
+                }
+            });
+            std::size_t done = 0;
+            for (std::size_t k = 0; k < n; ++k)
+                if (2 * pad <= pushed + k)
+                    Out(results.Row(done++));
+            pushed += n;
+        }
+    };
+    if (Spec.wrap && pad) {
+        // Row y is above the first row at y - height + pad and further up by
+        // multiples of height.
+        Rows.Rewind();
+        for (std::uint32_t y = 0; const float* row = Rows.Next(); ++y)
+            for (std::size_t j = (y + pad) % height; j < pad; j += height)
+                std::memcpy(before.Row(j), row, row_size);
+        along_rows(before, before, pad);
+    }
+    Rows.Rewind();
+    std::vector<const float*> sequence;
+    for (std::uint32_t y0 = 0; y0 < height; y0 += block) {
+        const std::uint32_t n = std::min(block, height - y0);
+        for (std::uint32_t k = 0; k < n; ++k)
+            std::memcpy(raw.Row(k), Rows.Next(), row_size);
+        along_rows(raw, across, n);
+        sequence.resize(0);
+        for (std::size_t j = 0; y0 == 0 && j < pad; ++j)
+            sequence.push_back(Spec.wrap ? before.Row(j) : across.Row(0));
+        for (std::uint32_t k = 0; k < n; ++k) {
+            sequence.push_back(across.Row(k));
+            for (std::size_t j = y0 + k; Spec.wrap && j < pad; j += height)
+                std::memcpy(after.Row(j), across.Row(k), row_size);
+        }
+        for (std::size_t j = 0; y0 + n == height && j < pad; ++j)
+            sequence.push_back(Spec.wrap ? after.Row(j) : across.Row(n - 1));
+        along_columns(sequence);
+    }
+}
+
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <cmath>
+
+// Direct sums and comparisons over the window for the expected values. The
+// input is extended by the padding of all passes before the first pass.
+static HeightField reference(const HeightField& In, FilterKind Kind,
+    std::uint32_t Radius, bool Wrap)
+{
+    const std::int64_t r = Radius;
+    std::int64_t pad = FilterPasses(Kind) * r;
+    HeightField field(In.Width() + 2 * pad, In.Height() + 2 * pad);
+    for (std::int64_t y = 0; y < std::int64_t(field.Height()); ++y)
+        for (std::int64_t x = 0; x < std::int64_t(field.Width()); ++x)
+            field.Row(y)[x] = In.Row(source(y - pad, In.Height(), Wrap))[
+                source(x - pad, In.Width(), Wrap)];
+    for (; pad; pad -= r) {
+        HeightField next(field.Width() - 2 * r, field.Height() - 2 * r);
+        for (std::int64_t y = 0; y < std::int64_t(next.Height()); ++y)
+            for (std::int64_t x = 0; x < std::int64_t(next.Width()); ++x) {
+                double sum = 0.0;
+                float low = field.Row(y)[x], high = low;
+                for (std::int64_t dy = 0; dy <= 2 * r; ++dy)
+                    for (std::int64_t dx = 0; dx <= 2 * r; ++dx) {
+                        const float v = field.Row(y + dy)[x + dx];
+                        sum += v;
+                        low = std::min(low, v);
+                        high = std::max(high, v);
+                    }
+                next.Row(y)[x] = (Kind == FilterMin) ? low :
+                    (Kind == FilterMax) ? high :
+                    float(sum / ((2 * r + 1) * (2 * r + 1)));
+            }
+        field = next;
+    }
+    return field;
+}
+
+TEST_CASE("FilterLine") {
+    std::vector<float> work, out(3);
+    const float in[7] = { 1.0f, 5.0f, 2.0f, 0.0f, 4.0f, 3.0f, 6.0f };
+    FilterLine(out.data(), in, 3, FilterBox, 2, work);
+    REQUIRE(out[0] == doctest::Approx(12.0f / 5.0f));
+    REQUIRE(out[2] == doctest::Approx(15.0f / 5.0f));
+    FilterLine(out.data(), in, 3, FilterMin, 2, work);
+    REQUIRE(out == std::vector<float> { 0.0f, 0.0f, 0.0f });
+    FilterLine(out.data(), in, 3, FilterMax, 2, work);
+    REQUIRE(out == std::vector<float> { 5.0f, 5.0f, 6.0f });
+    FilterLine(out.data(), in + 1, 3, FilterMax, 0, work);
+    REQUIRE(out == std::vector<float> { 5.0f, 2.0f, 0.0f });
+    out.resize(1);
+    FilterLine(out.data(), in, 1, FilterGaussian, 1, work);
+    // Weights 1, 3, 6, 7, 6, 3, 1 of 27.
+    REQUIRE(out[0] == doctest::Approx(
+        (1 + 15 + 12 + 0 + 24 + 9 + 6) / 27.0f));
+    REQUIRE(FilterKindFromName("gaussian") == FilterGaussian);
+    REQUIRE_THROWS_AS(FilterKindFromName("median"), std::runtime_error);
+}
+
+static void check_rows(const HeightField& Field, ThreadPool& Pool) {
+    for (FilterKind kind : { FilterBox, FilterGaussian, FilterMin, FilterMax })
+        for (std::uint32_t radius : { 0, 2, 30 })
+            for (bool wrap : { false, true }) {
+                HeightFieldRowReader rows(Field, {});
+                const HeightField expected =
+                    reference(Field, kind, radius, wrap);
+                std::uint32_t y = 0;
+                FilterRows(rows, FilterSpec { kind, radius, wrap }, Pool,
+                    [&](const float* Row) {
+                        for (std::uint32_t x = 0; x < Field.Width(); ++x)
+                            REQUIRE(Row[x] == doctest::Approx(
+                                expected.Row(y)[x]).epsilon(1e-5));
+                        ++y;
+                    });
+                REQUIRE(y == Field.Height());
+            }
+}
+
+TEST_CASE("FilterRows") {
+    ThreadPool pool(3);
+    // Second field is smaller than the padding.
+    for (std::uint32_t size : { 150, 5 }) {
+        HeightField hf(size / 5 + 7, size);
+        for (std::uint32_t y = 0; y < hf.Height(); ++y)
+            for (std::uint32_t x = 0; x < hf.Width(); ++x)
+                hf.Row(y)[x] = float((x * 7 + y * 13) % 17) +
+                    std::sin(0.1f * float(x * y));
+        check_rows(hf, pool);
+    }
+}
+
+#endif
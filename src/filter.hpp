@@ -0,0 +1,62 @@
+//
+//  filter.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(FILTER_HPP)
+#define FILTER_HPP
+
+// Separable smoothing and morphological filters of height field rows. Each
+// pass takes the mean, minimum, or maximum of 2 * radius + 1 values, first
+// along the rows and then along the columns. Means use running sums and
+// minimum and maximum the van Herk and Gil-Werman method, so the cost per
+// value does not depend on the radius.
+
+#include "heightfieldfile.hpp"
+#include "threadpool.hpp"
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+
+enum FilterKind {
+    FilterBox,
+    FilterGaussian, // Three box passes.
+    FilterMin,
+    FilterMax
+};
+
+// Kind for box, gaussian, min, or max. Throws if unknown.
+FilterKind FilterKindFromName(const std::string& Name);
+// Number of passes of Kind.
+std::uint32_t FilterPasses(FilterKind Kind);
+
+struct FilterSpec {
+    FilterKind kind;
+    std::uint32_t radius;
+    // Values beyond an edge come from the other edge, as on the wrap-around
+    // maps of renderchanges that repeat with a period of their size.
+    // Otherwise the edge values repeat.
+    bool wrap;
+};
+
+// Filters Count values to Out. In starts with FilterPasses(Kind) * Radius
+// values before those and has as many after them. Work holds temporary
+// values.
+void FilterLine(float* Out, const float* In, std::size_t Count,
+    FilterKind Kind, std::uint32_t Radius, std::vector<float>& Work);
+
+// Filters the rows of Rows and gives each result row to Out in order. Rows
+// are read in blocks, and a block is filtered along the rows in parallel and
+// then along the columns with a range of columns per thread. Memory use
+// depends on the width and the radius, not on the height. With wrap, rows
+// are read once before the filtering for the rows above the first row.
+void FilterRows(HeightFieldRowReader& Rows, const FilterSpec& Spec,
+    ThreadPool& Pool, const std::function<void(const float*)>& Out);
+
+#endif
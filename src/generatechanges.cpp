@@ -13,6 +13,8 @@
 #include "convenience.hpp"
 #endif
 #include "generate_io.hpp"
+#include "output.hpp"
+#include "numberformat.hpp"
 #include <vector>
 #include <iostream>
 #include <cmath>
@@ -145,6 +147,8 @@ static double redistribute(double Value, const RangeMap Map) {
 #if !defined(UNITTEST)
 
 static int generate(io::GenerateIn& Val) {
+    const NumberFormat format(
+        Val.output_precisionGiven() ? Val.output_precision() : 0);
     std::vector<char> output_buffer;
     const double s = 1.0 / static_cast<double>(std::mt19937_64::max());
     std::vector<double> change(4, 0.0);
@@ -192,18 +196,18 @@ static int generate(io::GenerateIn& Val) {
     RangeMap offset_map = histogram2rangemap(Val.offset_histogram());
     normalize_histogram(Val.radius_histogram());
     RangeMap radius_map = histogram2rangemap(Val.radius_histogram());
-    std::cout << "{\"changes\":[";
+    Output() << "{\"changes\":[";
     for (std::uint32_t k = 0; k < Val.count(); ++k) {
         for (auto& v : change)
             v = s * static_cast<double>(rnd());
         change[2] = redistribute(change[2], radius_map);
         change[3] = redistribute(change[3], offset_map);
         generate_change(change, radius, offset);
-        io::Write(std::cout, change, output_buffer);
+        format.Write(Output(), change, output_buffer);
         if (k + 1 != Val.count())
-            std::cout << ',';
+            Output() << ',';
     }
-    std::cout << "]}" << std::endl;
+    Output() << "]}" << std::endl;
     return 0;
 }
 
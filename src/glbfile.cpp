@@ -0,0 +1,314 @@
+//
+//  glbfile.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "glbfile.hpp"
+#include "numberformat.hpp"
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <cstdio>
+#include <cstring>
+#endif
+
+
+static std::uint64_t round4(std::uint64_t Size) {
+    return (Size + 3) & ~std::uint64_t(3);
+}
+
+static int create(const std::string& Path) {
+    int fd = open(Path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        throw std::runtime_error("Failed to create " + Path);
+    return fd;
+}
+
+GLBWriter::GLBWriter(const std::string& Path, std::uint32_t Width,
+    std::uint32_t Height, std::size_t Channels)
+    : fd(-1), width(Width), height(Height), rows(0), channels(Channels),
+    color_size(0), index_size(4)
+{
+    if (width < 2 || height < 2)
+        throw std::runtime_error("Mesh needs at least 2 rows and 2 columns.");
+    if (channels > 4)
+        throw std::runtime_error("Mesh colors need 1 to 4 components.");
+    if (channels)
+        color_size = (channels == 1 || channels == 3) ? 3 : 4;
+    const std::uint64_t vertices = std::uint64_t(width) * height;
+    // Largest value of the type may not be used as an index.
+    if (vertices <= 65535)
+        index_size = 2;
+    for (int k = 0; k < 3; ++k)
+        low[k] = high[k] = 0.0f;
+    json_size = round4(json(false).size() + 6 * MaxNumberLength);
+    bin_start = 12 + 8 + json_size + 8;
+    colors_start = bin_start + vertices * 3 * sizeof(float);
+    indexes_start = colors_start + vertices * color_size * sizeof(float);
+    bin_size = round4(indexes_start + IndexCount() * index_size - bin_start);
+    // File and chunk lengths are uint32.
+    if (bin_start + bin_size > UINT32_MAX)
+        throw std::runtime_error("Mesh is too large for a binary glTF file.");
+    expanded.resize(std::size_t(width) * color_size);
+    fd = create(Path);
+}
+
+GLBWriter::~GLBWriter() {
+    if (fd != -1)
+        close(fd);
+}
+
+std::uint64_t GLBWriter::IndexCount() const {
+    // Strip for each pair of rows and 2 indexes between strips.
+    return std::uint64_t(height - 1) * 2 * width + 2 * (height - 2);
+}
+
+static void append_number(std::string& Out, std::uint64_t V) {
+    Out += std::to_string(V);
+}
+
+static void append_bounds(std::string& Out, const char* Name,
+    const float* V, bool Given)
+{
+    char text[MaxNumberLength];
+    Out += ",\"";
+    Out += Name;
+    Out += "\":[";
+    for (int k = 0; k < 3; ++k) {
+        if (k)
+            Out.push_back(',');
+        if (Given)
+            Out.append(text, FormatShortest(V[k], text));
+        else
+            Out.push_back('0');
+    }
+    Out.push_back(']');
+}
+
+std::string GLBWriter::json(bool Bounds) const {
+    const std::uint64_t vertices = std::uint64_t(width) * height;
+    const std::size_t indexes_view = color_size ? 2 : 1;
+    std::string s("{\"asset\":{\"version\":\"2.0\","
+        "\"generator\":\"heightfield2model\"},\"scene\":0,"
+        "\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+        "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0");
+    if (color_size)
+        s += ",\"COLOR_0\":1";
+    s += "},\"indices\":";
+    append_number(s, indexes_view);
+    // Mode 5 is triangle strip.
+    s += ",\"mode\":5}]}],\"buffers\":[{\"byteLength\":";
+    append_number(s, bin_size);
+    s += "}],\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":";
+    append_number(s, colors_start - bin_start);
+    s += ",\"target\":34962}";
+    if (color_size) {
+        s += ",{\"buffer\":0,\"byteOffset\":";
+        append_number(s, colors_start - bin_start);
+        s += ",\"byteLength\":";
+        append_number(s, indexes_start - colors_start);
+        s += ",\"target\":34962}";
+    }
+    s += ",{\"buffer\":0,\"byteOffset\":";
+    append_number(s, indexes_start - bin_start);
+    s += ",\"byteLength\":";
+    append_number(s, IndexCount() * index_size);
+    s += ",\"target\":34963}],\"accessors\":[{\"bufferView\":0,"
+        "\"componentType\":5126,\"count\":";
+    append_number(s, vertices);
+    s += ",\"type\":\"VEC3\"";
+    append_bounds(s, "min", low, Bounds);
+    append_bounds(s, "max", high, Bounds);
+    s += "}";
+    if (color_size) {
+        s += ",{\"bufferView\":1,\"componentType\":5126,\"count\":";
+        append_number(s, vertices);
+        s += (color_size == 3) ? ",\"type\":\"VEC3\"}" : ",\"type\":\"VEC4\"}";
+    }
+    s += ",{\"bufferView\":";
+    append_number(s, indexes_view);
+    s += (index_size == 2) ? ",\"componentType\":5123,\"count\":" :
+        ",\"componentType\":5125,\"count\":";
+    append_number(s, IndexCount());
+    s += ",\"type\":\"SCALAR\"}]}";
+    return s;
+}
+
+void GLBWriter::write(
+    const void* Data, std::size_t Length, std::uint64_t Offset)
+{
+    const char* src = static_cast<const char*>(Data);
+    while (Length) {
+        ssize_t n = pwrite(fd, src, Length, off_t(Offset));
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            throw std::runtime_error("Failed to write glb file.");
+        }
+        src += n;
+        Offset += n;
+        Length -= n;
+    }
+}
+
+void GLBWriter::WriteRow(const float* Positions, const float* Colors) {
+    if (rows == height)
+        throw std::runtime_error("Mesh has more rows than height.");
+    for (std::uint32_t x = 0; x < width; ++x)
+        for (int k = 0; k < 3; ++k) {
+            const float v = Positions[3 * x + k];
+            if (rows == 0 && x == 0)
+                low[k] = high[k] = v;
+            low[k] = (v < low[k]) ? v : low[k];
+            high[k] = (high[k] < v) ? v : high[k];
+        }
+    write(Positions, std::size_t(width) * 3 * sizeof(float),
+        bin_start + std::uint64_t(rows) * width * 3 * sizeof(float));
+    if (color_size) {
+        const float* src = Colors;
+        if (channels == 1 || channels == 2) {
+            for (std::uint32_t x = 0; x < width; ++x) {
+                float* dst = expanded.data() + x * color_size;
+                dst[0] = dst[1] = dst[2] = Colors[x * channels];
+                if (channels == 2)
+                    dst[3] = Colors[x * channels + 1];
+            }
+            src = expanded.data();
+        }
+        write(src, expanded.size() * sizeof(float), colors_start +
+            std::uint64_t(rows) * expanded.size() * sizeof(float));
+    }
+    ++rows;
+}
+
+template<typename Index>
+static void strip_indexes(std::vector<unsigned char>& Out,
+    std::uint32_t Y, std::uint32_t Width, std::uint32_t Height)
+{
+    Out.resize(0);
+    auto put = [&Out](std::uint32_t V) {
+        const Index i = static_cast<Index>(V);
+        const unsigned char* b = reinterpret_cast<const unsigned char*>(&i);
+        Out.insert(Out.end(), b, b + sizeof(Index));
+    };
+    // Repeating the last index of a strip and the first of the next gives
+    // degenerate triangles and keeps the winding of the next strip.
+    if (Y)
+        put(Y * Width);
+    for (std::uint32_t x = 0; x < Width; ++x) {
+        put(Y * Width + x);
+        put((Y + 1) * Width + x);
+    }
+    if (Y + 2 < Height)
+        put((Y + 1) * Width + Width - 1);
+}
+
+void GLBWriter::Finish() {
+    if (rows != height)
+        throw std::runtime_error("Mesh has fewer rows than height.");
+    std::uint64_t offset = indexes_start;
+    for (std::uint32_t y = 0; y + 1 < height; ++y) {
+        if (index_size == 2)
+            strip_indexes<std::uint16_t>(buffer, y, width, height);
+        else
+            strip_indexes<std::uint32_t>(buffer, y, width, height);
+        write(buffer.data(), buffer.size(), offset);
+        offset += buffer.size();
+    }
+    const unsigned char zeros[4] = { 0, 0, 0, 0 };
+    write(zeros, bin_start + bin_size - offset, offset);
+    std::string text = json(true);
+    text.resize(json_size, ' ');
+    buffer.resize(0);
+    auto put32 = [this](std::uint64_t V) {
+        for (int k = 0; k < 4; ++k)
+            buffer.push_back(static_cast<unsigned char>((V >> (8 * k)) & 0xff));
+    };
+    buffer.insert(buffer.end(), { 'g', 'l', 'T', 'F' });
+    put32(2);
+    put32(bin_start + bin_size);
+    put32(json_size);
+    buffer.insert(buffer.end(), { 'J', 'S', 'O', 'N' });
+    buffer.insert(buffer.end(), text.begin(), text.end());
+    put32(bin_size);
+    buffer.insert(buffer.end(), { 'B', 'I', 'N', 0 });
+    write(buffer.data(), buffer.size(), 0);
+}
+
+#if defined(UNITTEST)
+
+static std::uint32_t get32(const std::vector<unsigned char>& Data,
+    std::size_t Offset)
+{
+    std::uint32_t v;
+    std::memcpy(&v, Data.data() + Offset, sizeof(v));
+    return v;
+}
+
+TEST_CASE("GLBWriter") {
+    char name[] = "/tmp/glbfileXXXXXX";
+    int fd = mkstemp(name);
+    REQUIRE(fd != -1);
+    close(fd);
+    const float positions[9] = { 0, 0, 1, 1, 0, -2, 2, 0, 3 };
+    const float colors[6] = { 0.5f, 1, 0.25f, 1, 0, 0 };
+    {
+        GLBWriter writer(name, 3, 3, 2);
+        REQUIRE(writer.IndexCount() == 14);
+        for (int y = 0; y < 3; ++y)
+            writer.WriteRow(positions, colors);
+        REQUIRE_THROWS(writer.WriteRow(positions, colors));
+        writer.Finish();
+    }
+    std::vector<unsigned char> data;
+    FILE* f = fopen(name, "rb");
+    int c;
+    while ((c = fgetc(f)) != EOF)
+        data.push_back(static_cast<unsigned char>(c));
+    fclose(f);
+    unlink(name);
+    REQUIRE(std::memcmp(data.data(), "glTF", 4) == 0);
+    REQUIRE(get32(data, 4) == 2);
+    REQUIRE(get32(data, 8) == data.size());
+    const std::uint32_t json_size = get32(data, 12);
+    REQUIRE(json_size % 4 == 0);
+    REQUIRE(std::memcmp(data.data() + 16, "JSON", 4) == 0);
+    const std::string json(data.begin() + 20, data.begin() + 20 + json_size);
+    REQUIRE(json.find("\"min\":[0,0,-2],\"max\":[2,0,3]") !=
+        std::string::npos);
+    REQUIRE(json.find("\"type\":\"VEC4\"") != std::string::npos);
+    REQUIRE(json.find("\"componentType\":5123") != std::string::npos);
+    const std::size_t bin = 20 + json_size;
+    const std::uint32_t bin_size = get32(data, bin);
+    REQUIRE(bin_size == 9 * 12 + 9 * 16 + 28);
+    REQUIRE(bin + 8 + bin_size == data.size());
+    float v;
+    std::memcpy(&v, data.data() + bin + 8 + 12 * 4 + 8, sizeof(v));
+    REQUIRE(v == -2.0f);
+    std::memcpy(&v, data.data() + bin + 8 + 9 * 12 + 16 + 8, sizeof(v));
+    REQUIRE(v == 0.25f);
+    std::memcpy(&v, data.data() + bin + 8 + 9 * 12 + 16 + 12, sizeof(v));
+    REQUIRE(v == 1.0f);
+    std::memcpy(&v, data.data() + bin + 8 + 9 * 12 + 32 + 12, sizeof(v));
+    REQUIRE(v == 0.0f);
+    const std::uint16_t expected[14] = {
+        0, 3, 1, 4, 2, 5, 5, 3, 3, 6, 4, 7, 5, 8 };
+    std::uint16_t indexes[14];
+    std::memcpy(indexes, data.data() + bin + 8 + 9 * 12 + 9 * 16,
+        sizeof(indexes));
+    for (int k = 0; k < 14; ++k)
+        REQUIRE(indexes[k] == expected[k]);
+    REQUIRE_THROWS(GLBWriter(name, 1, 3, 0));
+    // Lengths are uint32, and 2^30 vertices need more than 4 GiB.
+    REQUIRE_THROWS(GLBWriter(name, 32768, 32768, 0));
+    REQUIRE_NOTHROW(GLBWriter(name, 8192, 8192, 4));
+    unlink(name);
+}
+
+#endif
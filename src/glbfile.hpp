@@ -0,0 +1,53 @@
+//
+//  glbfile.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(GLBFILE_HPP)
+#define GLBFILE_HPP
+
+// Binary glTF file of a height field mesh, written a row of vertices at a
+// time. Sizes of all parts follow from the mesh size, so each row goes to its
+// place in the binary chunk right away and the JSON chunk is written last to
+// space reserved for it.
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+class GLBWriter {
+private:
+    int fd;
+    std::uint32_t width, height, rows;
+    std::size_t channels, color_size, index_size;
+    std::uint64_t json_size, bin_start, colors_start, indexes_start, bin_size;
+    float low[3], high[3];
+    std::vector<float> expanded;
+    std::vector<unsigned char> buffer;
+
+    std::string json(bool Bounds) const;
+    void write(const void* Data, std::size_t Length, std::uint64_t Offset);
+
+public:
+    // Channels is 0 for no colors, 1 for grey, 2 for grey and alpha, 3 for
+    // RGB, 4 for RGBA. Throws if the file can not be created.
+    GLBWriter(const std::string& Path, std::uint32_t Width,
+        std::uint32_t Height, std::size_t Channels);
+    ~GLBWriter();
+    GLBWriter(const GLBWriter&) = delete;
+    GLBWriter& operator=(const GLBWriter&) = delete;
+
+    // Number of indexes in the triangle strip that joins the rows.
+    std::uint64_t IndexCount() const;
+    // Width times x, y, and z, and Width times Channels color values.
+    void WriteRow(const float* Positions, const float* Colors);
+    // Writes the indexes, JSON chunk, and header. Throws if rows are missing.
+    void Finish();
+};
+
+#endif
@@ -0,0 +1,373 @@
+//
+//  heightfield.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "heightfield.hpp"
+#include <new>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <cmath>
+#endif
+
+
+static float* allocate(std::size_t Count) {
+    if (Count == 0)
+        return nullptr;
+    return static_cast<float*>(::operator new(Count * sizeof(float),
+        std::align_val_t(HeightField::Alignment)));
+}
+
+static void release(float* Data) {
+    if (Data != nullptr)
+        ::operator delete(Data, std::align_val_t(HeightField::Alignment));
+}
+
+static std::size_t padded(std::size_t Width) {
+    const std::size_t per_line = HeightField::Alignment / sizeof(float);
+    return ((Width + per_line - 1) / per_line) * per_line;
+}
+
+HeightField::HeightField()
+    : data(nullptr), width(0), height(0), stride(0), capacity(0)
+{ }
+
+HeightField::HeightField(std::size_t Width, std::size_t Height)
+    : data(allocate(padded(Width) * Height)), width(Width), height(Height),
+    stride(padded(Width)), capacity(Height)
+{
+    if (data != nullptr)
+        std::memset(data, 0, stride * height * sizeof(float));
+}
+
+HeightField::HeightField(float* Data, std::size_t Width, std::size_t Height,
+    std::size_t Stride, std::shared_ptr<void> Owner)
+    : data(Data), width(Width), height(Height), stride(Stride),
+    capacity(Height), owner(Owner)
+{
+    if (reinterpret_cast<std::uintptr_t>(Data) % Alignment == 0 &&
+        Stride % (Alignment / sizeof(float)) == 0)
+        return;
+    // Loops over rows expect them aligned.
+    stride = padded(Width);
+    data = allocate(stride * Height);
+    owner.reset();
+    for (std::size_t y = 0; y < Height; ++y) {
+        std::memcpy(Row(y), Data + y * Stride, Width * sizeof(float));
+        std::memset(Row(y) + Width, 0, (stride - Width) * sizeof(float));
+    }
+}
+
+HeightField::HeightField(const HeightField& Other)
+    : data(allocate(Other.stride * Other.height)), width(Other.width),
+    height(Other.height), stride(Other.stride), capacity(Other.height)
+{
+    if (data != nullptr)
+        std::memcpy(data, Other.data, stride * height * sizeof(float));
+}
+
+HeightField::HeightField(HeightField&& Other) noexcept
+    : data(Other.data), width(Other.width), height(Other.height),
+    stride(Other.stride), capacity(Other.capacity),
+    owner(std::move(Other.owner))
+{
+    Other.data = nullptr;
+    Other.width = Other.height = Other.stride = Other.capacity = 0;
+}
+
+HeightField::~HeightField() {
+    drop();
+}
+
+HeightField& HeightField::operator=(const HeightField& Other) {
+    if (this != &Other) {
+        HeightField copy(Other);
+        swap(copy);
+    }
+    return *this;
+}
+
+HeightField& HeightField::operator=(HeightField&& Other) noexcept {
+    HeightField moved(std::move(Other));
+    swap(moved);
+    return *this;
+}
+
+void HeightField::swap(HeightField& Other) noexcept {
+    std::swap(data, Other.data);
+    std::swap(width, Other.width);
+    std::swap(height, Other.height);
+    std::swap(stride, Other.stride);
+    std::swap(capacity, Other.capacity);
+    std::swap(owner, Other.owner);
+}
+
+void HeightField::drop() {
+    if (owner)
+        owner.reset();
+    else
+        release(data);
+}
+
+void HeightField::reallocate(std::size_t Rows) {
+    float* fresh = allocate(stride * Rows);
+    if (data != nullptr) {
+        std::memcpy(fresh, data, stride * height * sizeof(float));
+        drop();
+    }
+    data = fresh;
+    capacity = Rows;
+}
+
+void HeightField::clear() {
+    height = 0;
+    if (owner) {
+        drop();
+        data = nullptr;
+        capacity = 0;
+    }
+}
+
+void HeightField::reserve(std::size_t Rows) {
+    if (capacity < Rows && stride != 0)
+        reallocate(Rows);
+}
+
+void HeightField::resize(std::size_t Rows) {
+    if (Rows <= height || stride == 0) {
+        height = Rows;
+        return;
+    }
+    reserve(Rows);
+    if (height < Rows)
+        std::memset(Row(height), 0, (Rows - height) * stride * sizeof(float));
+    height = Rows;
+}
+
+void HeightField::push_back(const std::vector<float>& Values) {
+    if (height == 0) {
+        if (Values.empty())
+            throw std::runtime_error("Height field row is empty.");
+        if (width != Values.size()) {
+            drop();
+            data = nullptr;
+            capacity = 0;
+            width = Values.size();
+            stride = padded(width);
+        }
+    } else if (Values.size() != width)
+        throw std::runtime_error("Height field rows differ in length.");
+    if (height == capacity)
+        reallocate((capacity < 16) ? 16 : 2 * capacity);
+    float* dest = Row(height);
+    std::memcpy(dest, Values.data(), width * sizeof(float));
+    std::memset(dest + width, 0, (stride - width) * sizeof(float));
+    ++height;
+}
+
+void StoreRow(HeightField& Out, std::size_t Y, std::vector<float>& Row) {
+    if (Row.size() != Out.Width())
+        throw std::runtime_error("Height field rows differ in length.");
+    std::memcpy(Out.Row(Y), Row.data(), Row.size() * sizeof(float));
+}
+
+void MinMax(const float* Row, std::size_t Count, float& Min, float& Max) {
+    float low = Min;
+    float high = Max;
+    std::size_t x = 0;
+#if defined(__SSE2__)
+    // Lane-wise like the scalar loop below, so NaN values are skipped.
+    if (Count >= 8) {
+        __m128 lo = _mm_set1_ps(low);
+        __m128 hi = _mm_set1_ps(high);
+        for (; x + 4 <= Count; x += 4) {
+            const __m128 v = _mm_loadu_ps(Row + x);
+            lo = _mm_min_ps(v, lo);
+            hi = _mm_max_ps(v, hi);
+        }
+        alignas(16) float l[4], h[4];
+        _mm_store_ps(l, lo);
+        _mm_store_ps(h, hi);
+        for (int k = 0; k < 4; ++k) {
+            low = (l[k] < low) ? l[k] : low;
+            high = (high < h[k]) ? h[k] : high;
+        }
+    }
+#endif
+    for (; x < Count; ++x) {
+        low = (Row[x] < low) ? Row[x] : low;
+        high = (high < Row[x]) ? Row[x] : high;
+    }
+    Min = low;
+    Max = high;
+}
+
+#if defined(UNITTEST)
+
+TEST_CASE("HeightField") {
+    SUBCASE("Empty") {
+        HeightField hf;
+        REQUIRE(hf.empty());
+        REQUIRE(hf.size() == 0);
+        REQUIRE(hf.Width() == 0);
+    }
+    SUBCASE("Sized") {
+        HeightField hf(3, 2);
+        REQUIRE(hf.Width() == 3);
+        REQUIRE(hf.Height() == 2);
+        REQUIRE(hf.Stride() >= hf.Width());
+        REQUIRE(hf[1][2] == 0.0f);
+    }
+    SUBCASE("Aligned rows") {
+        HeightField hf;
+        for (int k = 0; k < 40; ++k)
+            hf.push_back(std::vector<float>(17, float(k)));
+        REQUIRE(hf.Height() == 40);
+        REQUIRE(hf.Width() == 17);
+        for (std::size_t y = 0; y < hf.Height(); ++y) {
+            REQUIRE(reinterpret_cast<std::uintptr_t>(hf.Row(y))
+                % HeightField::Alignment == 0);
+            REQUIRE(hf[y][16] == float(y));
+        }
+    }
+    SUBCASE("Row length mismatch") {
+        HeightField hf;
+        hf.push_back(std::vector<float> { 1.0f, 2.0f });
+        REQUIRE_THROWS(hf.push_back(std::vector<float> { 1.0f }));
+    }
+    SUBCASE("Clear and refill") {
+        HeightField hf;
+        hf.push_back(std::vector<float> { 1.0f, 2.0f });
+        hf.clear();
+        hf.push_back(std::vector<float> { 3.0f, 4.0f, 5.0f });
+        REQUIRE(hf.Width() == 3);
+        REQUIRE(hf[0][2] == 5.0f);
+    }
+    SUBCASE("Resize and store") {
+        HeightField hf;
+        hf.push_back(std::vector<float> { 1.0f, 2.0f });
+        hf.resize(30);
+        REQUIRE(hf.Height() == 30);
+        REQUIRE(hf[29][1] == 0.0f);
+        std::vector<float> row { 3.0f, 4.0f };
+        StoreRow(hf, 29, row);
+        REQUIRE(hf[29][1] == 4.0f);
+        REQUIRE(hf[0][1] == 2.0f);
+        row.push_back(5.0f);
+        REQUIRE_THROWS(StoreRow(hf, 28, row));
+    }
+    SUBCASE("View") {
+        std::shared_ptr<HeightField> mem(new HeightField(16, 2));
+        mem->Row(1)[0] = 4.0f;
+        mem->Row(1)[2] = 6.0f;
+        HeightField hf(mem->Data(), 3, 2, mem->Stride(), mem);
+        REQUIRE(hf.Row(1) == mem->Row(1));
+        HeightField copy(hf);
+        REQUIRE(copy.Row(1)[0] == 4.0f);
+        REQUIRE(copy.Data() != mem->Data());
+        hf.push_back(std::vector<float> { 7.0f, 8.0f, 9.0f });
+        REQUIRE(hf.Data() != mem->Data());
+        REQUIRE(hf.Row(2)[2] == 9.0f);
+        REQUIRE(hf.Row(1)[2] == 6.0f);
+        REQUIRE(mem.use_count() == 1);
+        HeightField view(mem->Data(), 3, 2, mem->Stride(), mem);
+        view.clear();
+        REQUIRE(mem.use_count() == 1);
+        view.push_back(std::vector<float> { 1.0f, 0.0f, 0.0f });
+        REQUIRE(mem->Row(0)[0] == 0.0f);
+    }
+    SUBCASE("Unaligned view") {
+        std::shared_ptr<std::vector<float>> mem(new std::vector<float> {
+            0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f });
+        HeightField hf(mem->data() + 1, 3, 2, 3, mem);
+        REQUIRE(mem.use_count() == 1);
+        REQUIRE(hf.Stride() % (HeightField::Alignment / sizeof(float)) == 0);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(hf.Row(1))
+            % HeightField::Alignment == 0);
+        REQUIRE(hf.Row(0)[0] == 1.0f);
+        REQUIRE(hf.Row(1)[2] == 6.0f);
+        hf.push_back(std::vector<float> { 7.0f, 8.0f, 9.0f });
+        REQUIRE(hf.Row(2)[0] == 7.0f);
+    }
+    SUBCASE("Resize without width") {
+        HeightField hf;
+        hf.resize(0);
+        REQUIRE(hf.empty());
+        hf.push_back(std::vector<float> { 1.0f });
+        hf.resize(0);
+        REQUIRE(hf.empty());
+    }
+    SUBCASE("Copy and move") {
+        HeightField hf;
+        hf.push_back(std::vector<float> { 1.0f, 2.0f });
+        HeightField copy(hf);
+        REQUIRE(copy[0][1] == 2.0f);
+        HeightField moved(std::move(copy));
+        REQUIRE(moved[0][0] == 1.0f);
+        REQUIRE(copy.empty());
+    }
+}
+
+// Range of all values of Field with the row function.
+static void field_min_max(const HeightField& Field, float& Min, float& Max) {
+    Min = Max = Field.Row(0)[0];
+    for (std::size_t y = 0; y < Field.Height(); ++y)
+        MinMax(Field.Row(y), Field.Width(), Min, Max);
+}
+
+TEST_CASE("MinMax") {
+    HeightField map;
+    SUBCASE("min first") {
+        map.clear();
+        map.push_back(std::vector<float> { -1.0f, 0.0f });
+        map.push_back(std::vector<float> { 1.0f, 0.5f });
+        float min, max;
+        field_min_max(map, min, max);
+        REQUIRE(min == -1.0f);
+        REQUIRE(max == 1.0f);
+    }
+    SUBCASE("max first") {
+        map.clear();
+        map.push_back(std::vector<float> { 2.0f, 0.0f });
+        map.push_back(std::vector<float> { 1.0f, 0.5f });
+        float min, max;
+        field_min_max(map, min, max);
+        REQUIRE(min == 0.0f);
+        REQUIRE(max == 2.0f);
+    }
+    SUBCASE("min and max later") {
+        map.clear();
+        map.push_back(std::vector<float> { 2.0f, 3.0f });
+        map.push_back(std::vector<float> { 1.0f, 0.5f });
+        float min, max;
+        field_min_max(map, min, max);
+        REQUIRE(min == 0.5f);
+        REQUIRE(max == 3.0f);
+    }
+    SUBCASE("Long rows") {
+        map.clear();
+        std::vector<float> row;
+        for (int k = 0; k < 37; ++k)
+            row.push_back(float((k * 7) % 37) - 3.0f);
+        row[21] = NAN;
+        map.push_back(row);
+        row[30] = 40.0f;
+        map.push_back(row);
+        float min, max;
+        field_min_max(map, min, max);
+        REQUIRE(min == -3.0f);
+        REQUIRE(max == 40.0f);
+    }
+}
+
+#endif
@@ -0,0 +1,82 @@
+//
+//  heightfield.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(HEIGHTFIELD_HPP)
+#define HEIGHTFIELD_HPP
+
+// Height field stored as one row-major buffer. Each row starts at a 64-byte
+// boundary so that inner loops over a row can use aligned vector loads.
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+
+class HeightField {
+private:
+    float* data;
+    std::size_t width;
+    std::size_t height;
+    std::size_t stride;
+    std::size_t capacity; // In rows.
+    // Set when data is memory that is not ours, such as a mapped file.
+    std::shared_ptr<void> owner;
+
+    void drop();
+    void reallocate(std::size_t Rows);
+
+public:
+    // Alignment of the buffer and of each row, in bytes.
+    static const std::size_t Alignment = 64;
+    // The generated container parsers fill the field one row at a time.
+    typedef std::vector<float> value_type;
+
+    HeightField();
+    HeightField(std::size_t Width, std::size_t Height);
+    // Uses Data as is when the rows are aligned, and Owner keeps it valid.
+    // Otherwise copies the rows to a buffer of our own. Any change in size
+    // copies the data to a buffer of our own.
+    HeightField(float* Data, std::size_t Width, std::size_t Height,
+        std::size_t Stride, std::shared_ptr<void> Owner);
+    HeightField(const HeightField& Other);
+    HeightField(HeightField&& Other) noexcept;
+    ~HeightField();
+    HeightField& operator=(const HeightField& Other);
+    HeightField& operator=(HeightField&& Other) noexcept;
+    void swap(HeightField& Other) noexcept;
+
+    std::size_t Width() const { return width; }
+    std::size_t Height() const { return height; }
+    // Distance between row starts in floats, at least Width.
+    std::size_t Stride() const { return stride; }
+    float* Data() { return data; }
+    const float* Data() const { return data; }
+    float* Row(std::size_t Y) { return data + Y * stride; }
+    const float* Row(std::size_t Y) const { return data + Y * stride; }
+
+    // Subset of std::vector interface where an element is a row.
+    std::size_t size() const { return height; }
+    bool empty() const { return height == 0; }
+    // Releases the data of a view, as it may be read-only.
+    void clear();
+    void reserve(std::size_t Rows);
+    // Added rows are zero. Width must be known.
+    void resize(std::size_t Rows);
+    float* operator[](std::size_t Y) { return Row(Y); }
+    const float* operator[](std::size_t Y) const { return Row(Y); }
+    // First row sets the width, the rest must match it.
+    void push_back(const std::vector<float>& Values);
+};
+
+// Copies Row to row Y. Throws if the length is not the width.
+void StoreRow(HeightField& Out, std::size_t Y, std::vector<float>& Row);
+
+// Lowers Min and raises Max to cover Count values from Row.
+void MinMax(const float* Row, std::size_t Count, float& Min, float& Max);
+
+#endif
@@ -0,0 +1,200 @@
+//
+//  heightfield2all.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if defined(UNITTEST)
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#include <sstream>
+#else
+#include "convenience.hpp"
+#endif
+#include "heightfieldfile.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+typedef std::vector<std::vector<std::vector<float>>> Image;
+typedef std::vector<std::vector<float>> V3;
+typedef std::vector<std::vector<std::uint32_t>> TriStrips;
+#define IO_HEIGHTFIELD2ALLIN_TYPE HeightField2AllIn_Template<HeightField,std::string,std::string,std::vector<std::uint32_t>,float,float,std::vector<std::vector<float>>,float,float,std::vector<std::string>,std::uint32_t>
+#define IO_HEIGHTFIELD2ALLOUT_TYPE HeightField2AllOut_Template<Image,Image,V3,V3,V3,TriStrips>
+#include "heightfield2all_io.hpp"
+#include "colormap.hpp"
+#include "heightfieldjson.hpp"
+#include "output.hpp"
+#include "numberformat.hpp"
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+enum OutputBits {
+    OutputImage = 1,
+    OutputTexture = 2,
+    OutputCoordinates = 4,
+    OutputVertices = 8,
+    OutputColors = 16,
+    OutputTriStrips = 32
+};
+
+static const char* output_names[] = {
+    "image", "texture", "coordinates", "vertices", "colors", "tristrips" };
+static const int output_count = 6;
+static const int colormap_outputs =
+    OutputImage | OutputTexture | OutputCoordinates | OutputColors;
+static const int mesh_outputs = OutputVertices | OutputColors | OutputTriStrips;
+
+static int requested_outputs(const io::HeightField2AllIn& Val) {
+    if (!Val.outputsGiven())
+        return Val.colormapGiven() ? (1 << output_count) - 1 :
+            OutputVertices | OutputTriStrips;
+    int bits = 0;
+    for (auto& name : Val.outputs()) {
+        int k = 0;
+        while (k < output_count && name != output_names[k])
+            ++k;
+        if (k == output_count)
+            throw std::runtime_error("Unknown output: " + name);
+        bits |= 1 << k;
+    }
+    if ((bits & colormap_outputs) && !Val.colormapGiven())
+        throw std::runtime_error(
+            "image, texture, coordinates, and colors need colormap.");
+    return bits;
+}
+
+// Writes the requested outputs in the order of output_names. Each of them is
+// made from the rows from the start, the same way the separate programs do.
+static void write_all(std::ostream& Out, HeightFieldRowReader& Rows,
+    io::HeightField2AllIn& Val, int Outputs, float Min, float Max,
+    const NumberFormat& Format)
+{
+    std::unique_ptr<ColorMap> map;
+    if (Outputs & colormap_outputs)
+        map.reset(new ColorMap(Val.colormap()));
+    char separator = '{';
+    for (int k = 0; k < output_count; ++k) {
+        const int bit = 1 << k;
+        if (!(Outputs & bit))
+            continue;
+        Out << separator << '"' << output_names[k] << "\":";
+        separator = ',';
+        switch (bit) {
+        case OutputImage:
+            WriteImage(Out, Rows, *map, Min, Max, Format);
+            break;
+        case OutputTexture:
+            WriteTexture(Out, *map, Format);
+            break;
+        case OutputCoordinates:
+            WriteCoordinates(Out, Rows, *map, Min, Max, Format);
+            break;
+        case OutputVertices:
+            WriteVertices(
+                Out, Rows, Val.width(), Val.range() / (Max - Min), Format);
+            break;
+        case OutputColors:
+            WriteColors(Out, Rows, *map, Min, Max, Format);
+            break;
+        case OutputTriStrips:
+            WriteTriStrips(Out, Rows.Width(), Rows.Height(), Format);
+            break;
+        }
+    }
+    if (separator == '{')
+        Out << separator;
+    Out << '}' << std::endl;
+}
+
+#if !defined(UNITTEST)
+
+static int all(io::HeightField2AllIn& Val) {
+    try {
+        const int outputs = requested_outputs(Val);
+        std::unique_ptr<HeightFieldRowReader> rows = HeightFieldRows(Val);
+        if (outputs & mesh_outputs) {
+            if (rows->Height() < 2)
+                throw std::runtime_error("Height field has less than 2 rows.");
+            if (rows->Width() < 2)
+                throw std::runtime_error(
+                    "Height field has less than 2 columns.");
+        }
+        if (!Val.widthGiven())
+            Val.width() = rows->Width() - 1;
+        float min, max;
+        HeightFieldRange(Val, *rows, min, max);
+        if (!Val.rangeGiven())
+            Val.range() = max - min;
+        write_all(Output(), *rows, Val, outputs, min, max, NumberFormat(
+            Val.output_precisionGiven() ? Val.output_precision() : 0));
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int f = 0;
+    if (argc > 1)
+        f = open(argv[1], O_RDONLY);
+    InputParser<io::ParserPool, io::HeightField2AllIn_Parser,
+        io::HeightField2AllIn> ip(f);
+    ip.AddNumberArray<float>("heightfield", [](io::HeightField2AllIn& Val)
+        -> HeightField& { return Val.heightfield(); });
+    int status = ip.ReadAndParse(all);
+    if (f)
+        close(f);
+    return status;
+}
+
+#else
+
+TEST_CASE("write_all") {
+    io::HeightField2AllIn val;
+    val.heightfield().push_back(std::vector<float> { -1.0f, 0.0f });
+    val.heightfield().push_back(std::vector<float> { 1.0f, 0.5f });
+    val.colormap().push_back(std::vector<float> { 0.0f, 0.0f, 0.0f, 0.0f });
+    val.colormap().push_back(std::vector<float> { 1.0f, 1.0f, 0.5f, 0.0f });
+    val.width() = 8.0f;
+    val.range() = 4.0f;
+    HeightFieldRowReader rows(val.heightfield(), {});
+    float min, max;
+    MinMax(rows, min, max);
+    std::ostringstream out;
+    SUBCASE("All") {
+        write_all(out, rows, val, (1 << output_count) - 1, min, max,
+            NumberFormat());
+        REQUIRE(out.str() == "{\"image\":[[[0,0,0],[0.5,0.25,0]],"
+            "[[1,0.5,0],[0.75,0.375,0]]],"
+            "\"texture\":[[[0,0,0],[1,0.5,0]]],"
+            "\"coordinates\":[[0,0.5],[0.5,0.5],[1,0.5],[0.75,0.5]],"
+            "\"vertices\":[[0,0,-2],[8,0,0],[0,8,2],[8,8,1]],"
+            "\"colors\":[[0,0,0],[0.5,0.25,0],[1,0.5,0],[0.75,0.375,0]],"
+            "\"tristrips\":[[0,2,1,3]]}\n");
+    }
+    SUBCASE("Some") {
+        write_all(out, rows, val, OutputTriStrips | OutputTexture, min, max,
+            NumberFormat());
+        REQUIRE(out.str() == "{\"texture\":[[[0,0,0],[1,0.5,0]]],"
+            "\"tristrips\":[[0,2,1,3]]}\n");
+    }
+    SUBCASE("None") {
+        write_all(out, rows, val, 0, min, max, NumberFormat());
+        REQUIRE(out.str() == "{}\n");
+    }
+}
+
+TEST_CASE("requested_outputs") {
+    io::HeightField2AllIn val;
+    REQUIRE(requested_outputs(val) == (OutputVertices | OutputTriStrips));
+}
+
+#endif
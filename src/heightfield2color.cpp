@@ -9,51 +9,207 @@
 #if defined(UNITTEST)
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
+#include <sstream>
+#include <cstdio>
 #else
 #include "convenience.hpp"
 #endif
+#include "heightfieldfile.hpp"
 #include <vector>
+#include <string>
+#include <cstdint>
+#include <memory>
 typedef std::vector<std::vector<std::vector<float>>> Image;
+#define IO_HEIGHTFIELD2COLORIN_TYPE HeightField2ColorIn_Template<HeightField,std::string,std::string,std::vector<std::uint32_t>,float,float,std::vector<std::vector<float>>,std::vector<std::vector<std::vector<float>>>,std::uint32_t,std::string,std::vector<std::string>,std::string,std::uint32_t,std::string,std::vector<float>,float>
 #define IO_HEIGHTFIELD2COLOROUT_TYPE HeightField2ColorOut_Template<Image>
 #include "heightfield2color_io.hpp"
 #include "colormap.hpp"
+#include "heightfieldjson.hpp"
+#include "imagefile.hpp"
+#include "hillshade.hpp"
+#include "output.hpp"
+#include "numberformat.hpp"
+#include "rowwriter.hpp"
 #include <iostream>
 #include <cmath>
 #include <fcntl.h>
 #include <unistd.h>
 
 
-static void color_map(
-    io::HeightField2ColorOut& Out, io::HeightField2ColorIn& Val)
+// Array of rows of colors like WriteImage, multiplied by the shades if
+// Shading is given.
+static void write_image(std::ostream& Out, HeightFieldRowReader& Rows,
+    const ColorMap& Map, float Min, float Max, const NumberFormat& Format,
+    const HillShade* Shading)
 {
-    float min, max;
-    min = max = Val.heightfield()[0][0];
-    for (auto& line : Val.heightfield())
-        for (auto& value : line)
-            if (value < min)
-                min = value;
-            else if (max < value)
-                max = value;
-    const float range = (min < max) ? max - min : 1.0f;
-    std::vector<std::vector<float>> map = Val.colormap();
-    SortColorMap(map);
-    Out.image.reserve(Val.heightfield().size());
-    for (auto& line : Val.heightfield()) {
-        Out.image.push_back(std::vector<std::vector<float>>());
-        Out.image.back().reserve(line.size());
-        for (auto& v : line)
-            Out.image.back().push_back(Interpolated((v - min) / range, map));
+    if (!Shading) {
+        WriteImage(Out, Rows, Map, Min, Max, Format);
+        return;
     }
+    const float range = (Min < Max) ? Max - Min : 1.0f;
+    std::vector<float> line(std::size_t(Rows.Width()) * Map.Channels());
+    std::vector<char> buffer;
+    ShadedRows shaded(Rows, *Shading);
+    Out << '[';
+    for (std::uint32_t y = 0; const float* row = shaded.Next(); ++y) {
+        Map.MapRow(row, Rows.Width(), Min, range, line.data());
+        ApplyShade(line.data(), shaded.Shades(), Rows.Width(), Map.Channels());
+        Out << (y ? ",[" : "[");
+        Format.WriteGroups(
+            Out, line.data(), Rows.Width(), Map.Channels(), false, buffer);
+        Out << ']';
+    }
+    Out << ']';
+}
+
+static void color_map(std::ostream& Out, HeightFieldRowReader& Rows,
+    const ColorMap& Map, float Min, float Max, const NumberFormat& Format,
+    const HillShade* Shading = nullptr)
+{
+    Out << "{\"image\":";
+    write_image(Out, Rows, Map, Min, Max, Format, Shading);
+    Out << '}' << std::endl;
+}
+
+// Writes {"images":[...]} with one image per map. Rows are read again for
+// each map as the images follow each other in the output.
+static void color_maps(std::ostream& Out, HeightFieldRowReader& Rows,
+    const std::vector<ColorMap>& Maps, float Min, float Max,
+    const NumberFormat& Format, const HillShade* Shading = nullptr)
+{
+    Out << "{\"images\":[";
+    for (std::size_t k = 0; k < Maps.size(); ++k) {
+        if (k)
+            Out << ',';
+        write_image(Out, Rows, Maps[k], Min, Max, Format, Shading);
+    }
+    Out << "]}" << std::endl;
+}
+
+// Writes each image row to its writer. Every map colors the height field row
+// while it is at hand, so the rows are read once. The shade of a row is found
+// once for all maps.
+static void color_files(
+    std::vector<std::unique_ptr<ImageFileWriter>>& Writers,
+    const std::vector<ImageFileFormat>& Formats, HeightFieldRowReader& Rows,
+    const std::vector<ColorMap>& Maps, float Min, float Max,
+    const HillShade* Shading = nullptr)
+{
+    const float range = (Min < Max) ? Max - Min : 1.0f;
+    std::vector<std::vector<float>> lines(Maps.size());
+    std::vector<std::uint32_t> indexes(Rows.Width());
+    for (std::size_t k = 0; k < Maps.size(); ++k) {
+        if (Formats[k] != ImagePNGPalette) {
+            lines[k].resize(std::size_t(Rows.Width()) * Maps[k].Channels());
+            continue;
+        }
+        if (ImageFileWriter::MaxPalette < Maps[k].Size())
+            throw std::runtime_error("Palette needs at most 256 colors.");
+        if (Shading)
+            throw std::runtime_error("png_palette can not be shaded.");
+        Writers[k]->SetPalette(Maps[k].Color(0), Maps[k].Size());
+    }
+    std::unique_ptr<ShadedRows> shaded;
+    if (Shading)
+        shaded.reset(new ShadedRows(Rows, *Shading));
+    while (const float* row = shaded ? shaded->Next() : Rows.Next()) {
+        for (std::size_t k = 0; k < Maps.size(); ++k) {
+            if (Formats[k] == ImagePNGPalette) {
+                Maps[k].IndexRow(
+                    row, Rows.Width(), Min, range, indexes.data());
+                Writers[k]->WriteRow(indexes.data());
+            } else {
+                Maps[k].MapRow(row, Rows.Width(), Min, range, lines[k].data());
+                if (shaded)
+                    ApplyShade(lines[k].data(), shaded->Shades(),
+                        Rows.Width(), Maps[k].Channels());
+                Writers[k]->WriteRow(lines[k].data());
+            }
+        }
+    }
+    for (auto& writer : Writers)
+        writer->Finish();
 }
 
 #if !defined(UNITTEST)
 
 static int color(io::HeightField2ColorIn& Val) {
-    std::vector<char> output_buffer;
-    io::HeightField2ColorOut out;
-    color_map(out, Val);
-    Write(std::cout, out, output_buffer);
-    std::cout << std::endl;
+    try {
+        if (Val.colormapGiven() == Val.colormapsGiven())
+            throw std::runtime_error("Give either colormap or colormaps.");
+        if (Val.image_fileGiven() && !Val.colormapGiven())
+            throw std::runtime_error("image_file needs colormap.");
+        if (Val.image_filesGiven() && !Val.colormapsGiven())
+            throw std::runtime_error("image_files needs colormaps.");
+        std::vector<ColorMap> maps;
+        if (Val.colormapGiven())
+            maps.push_back(ColorMap(Val.colormap()));
+        for (auto& map : Val.colormaps())
+            maps.push_back(ColorMap(map));
+        std::unique_ptr<HillShade> shading;
+        if (Val.shadingGiven()) {
+            if (Val.lightGiven() && Val.light().size() != 2)
+                throw std::runtime_error("light needs azimuth and altitude.");
+            shading.reset(new HillShade(ShadingModeFromName(Val.shading()),
+                Val.lightGiven() ? Val.light()[0] : 315.0f,
+                Val.lightGiven() ? Val.light()[1] : 45.0f,
+                Val.z_factorGiven() ? Val.z_factor() : 1.0f));
+        } else if (Val.lightGiven() || Val.z_factorGiven())
+            throw std::runtime_error("light and z_factor need shading.");
+        std::unique_ptr<HeightFieldRowReader> rows = HeightFieldRows(Val);
+        float min, max;
+        HeightFieldRange(Val, *rows, min, max);
+        if (!Val.image_fileGiven() && !Val.image_filesGiven()) {
+            if (Val.image_formatGiven() || Val.image_depthGiven())
+                throw std::runtime_error(
+                    "image_format and image_depth need image_file.");
+            const NumberFormat format(
+                Val.output_precisionGiven() ? Val.output_precision() : 0);
+            if (Val.colormapGiven())
+                color_map(Output(), *rows, maps.front(), min, max, format,
+                    shading.get());
+            else
+                color_maps(Output(), *rows, maps, min, max, format,
+                    shading.get());
+            return 0;
+        }
+        std::vector<std::string> names;
+        if (Val.image_fileGiven())
+            names.push_back(Val.image_file());
+        else if (Val.image_files().size() == maps.size())
+            names = Val.image_files();
+        else
+            throw std::runtime_error("image_files and colormaps sizes differ.");
+        std::vector<ImageFileFormat> formats;
+        std::vector<std::unique_ptr<ImageFileWriter>> writers;
+        for (std::size_t k = 0; k < names.size(); ++k) {
+            formats.push_back(Val.image_formatGiven() ?
+                ImageFileFormatFromName(Val.image_format()) :
+                ImageFileFormatFromPath(names[k]));
+            writers.push_back(std::unique_ptr<ImageFileWriter>(
+                new ImageFileWriter(names[k], formats.back(), rows->Width(),
+                    rows->Height(), maps[k].Channels(),
+                    Val.image_depthGiven() ? Val.image_depth() : 8)));
+        }
+        color_files(writers, formats, *rows, maps, min, max, shading.get());
+        if (Val.image_fileGiven()) {
+            Output() << "{\"image_file\":";
+            WriteJSONString(Output(), names.front());
+        } else {
+            Output() << "{\"image_files\":[";
+            for (std::size_t k = 0; k < names.size(); ++k) {
+                if (k)
+                    Output() << ',';
+                WriteJSONString(Output(), names[k]);
+            }
+            Output() << ']';
+        }
+        Output() << "}" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
     return 0;
 }
 
@@ -63,6 +219,8 @@ int main(int argc, char** argv) {
         f = open(argv[1], O_RDONLY);
     InputParser<io::ParserPool, io::HeightField2ColorIn_Parser,
         io::HeightField2ColorIn> ip(f);
+    ip.AddNumberArray<float>("heightfield", [](io::HeightField2ColorIn& Val)
+        -> HeightField& { return Val.heightfield(); });
     int status = ip.ReadAndParse(color);
     if (f)
         close(f);
@@ -72,33 +230,123 @@ int main(int argc, char** argv) {
 #else
 
 TEST_CASE("color_map") {
-    io::HeightField2ColorOut out;
     io::HeightField2ColorIn val;
+    val.colormap().push_back(std::vector<float> { 0.0f, 0.0f, 0.0f, 0.0f });
+    val.colormap().push_back(std::vector<float> { 1.0f, 1.0f, 0.5f, 0.0f });
+    const ColorMap map(val.colormap());
     SUBCASE("min < max") {
-        val.heightfield().resize(0);
-        out.image.resize(0);
+        val.heightfield().clear();
         val.heightfield().push_back(std::vector<float> { -1.0f, 0.0f });
         val.heightfield().push_back(std::vector<float> { 1.0f, 0.5f });
-        val.colormap().push_back(std::vector<float> { 0.0f, 0.0f, 0.0f, 0.0f });
-        val.colormap().push_back(std::vector<float> { 1.0f, 1.0f, 0.5f, 0.0f });
-        color_map(out, val);
-        REQUIRE(out.image.size() == val.heightfield().size());
-        for (std::size_t k = 0; k < out.image.size(); ++k)
-            REQUIRE(out.image[k].size() == val.heightfield()[k].size());
-        REQUIRE(out.image[0][0].size() == 3);
-        REQUIRE(out.image[0][0] == std::vector<float> { 0.0f, 0.0f, 0.0f });
-        REQUIRE(out.image[1][0] == std::vector<float> { 1.0f, 0.5f, 0.0f });
+        HeightFieldRowReader rows(val.heightfield(), {});
+        float min, max;
+        MinMax(rows, min, max);
+        std::vector<float> image(3 * 2 * 2);
+        for (std::size_t y = 0; y < val.heightfield().Height(); ++y)
+            map.MapRow(val.heightfield().Row(y), val.heightfield().Width(),
+                min, max - min, image.data() + 3 * y * 2);
+        REQUIRE(image[0] == 0.0f);
+        REQUIRE(image[1] == 0.0f);
+        REQUIRE(image[6] == 1.0f);
+        REQUIRE(image[7] == 0.5f);
+        REQUIRE(image[8] == 0.0f);
+        std::ostringstream out;
+        color_map(out, rows, map, min, max, NumberFormat());
+        REQUIRE(out.str() == "{\"image\":[[[0,0,0],[0.5,0.25,0]],"
+            "[[1,0.5,0],[0.75,0.375,0]]]}\n");
     }
     SUBCASE("min == max") {
-        val.heightfield().resize(0);
-        out.image.resize(0);
+        val.heightfield().clear();
         val.heightfield().push_back(std::vector<float> { 1.0f, 1.0f });
         val.heightfield().push_back(std::vector<float> { 1.0f, 1.0f });
-        val.colormap().push_back(std::vector<float> { 0.0f, 0.0f, 0.0f, 0.0f });
-        val.colormap().push_back(std::vector<float> { 1.0f, 1.0f, 0.5f, 0.0f });
-        color_map(out, val);
-        REQUIRE(out.image[0][0] == std::vector<float> { 0.0f, 0.0f, 0.0f });
+        HeightFieldRowReader rows(val.heightfield(), {});
+        float min, max;
+        MinMax(rows, min, max);
+        std::ostringstream out;
+        color_map(out, rows, map, min, max, NumberFormat());
+        REQUIRE(out.str() == "{\"image\":[[[0,0,0],[0,0,0]],"
+            "[[0,0,0],[0,0,0]]]}\n");
+    }
+    SUBCASE("Empty") {
+        val.heightfield().clear();
+        HeightFieldRowReader rows(val.heightfield(), {});
+        std::ostringstream out;
+        color_map(out, rows, map, 0.0f, 0.0f, NumberFormat());
+        REQUIRE(out.str() == "{\"image\":[]}\n");
+    }
+}
+
+TEST_CASE("color_maps") {
+    HeightField hf;
+    hf.push_back(std::vector<float> { -1.0f, 0.0f });
+    hf.push_back(std::vector<float> { 1.0f, 0.5f });
+    std::vector<ColorMap> maps;
+    maps.push_back(ColorMap(std::vector<std::vector<float>> {
+        { 0.0f, 0.0f }, { 1.0f, 1.0f } }));
+    maps.push_back(ColorMap(std::vector<std::vector<float>> {
+        { 0.0f, 2.0f }, { 0.5f, 1.0f } }));
+    HeightFieldRowReader rows(hf, {});
+    std::ostringstream out;
+    color_maps(out, rows, maps, -1.0f, 1.0f, NumberFormat());
+    REQUIRE(out.str() == "{\"images\":[[[[0],[0.5]],[[1],[0.75]]],"
+        "[[[2],[1]],[[1],[1]]]]}\n");
+}
+
+TEST_CASE("shading") {
+    HeightField hf;
+    hf.push_back(std::vector<float> { 0.0f, 8.0f });
+    hf.push_back(std::vector<float> { 0.0f, 8.0f });
+    const ColorMap map(std::vector<std::vector<float>> {
+        { 0.0f, 0.0f }, { 1.0f, 1.0f } });
+    HeightFieldRowReader rows(hf, {});
+    const HillShade slope(ShadingSlope);
+    std::ostringstream out;
+    // Slope of 4 everywhere.
+    color_map(out, rows, map, 0.0f, 8.0f, NumberFormat(3), &slope);
+    REQUIRE(out.str() == "{\"image\":[[[0],[0.243]],[[0],[0.243]]]}\n");
+}
+
+static std::string read_file(const char* Name) {
+    std::string data;
+    FILE* f = fopen(Name, "rb");
+    int c;
+    while ((c = fgetc(f)) != EOF)
+        data.push_back(char(c));
+    fclose(f);
+    return data;
+}
+
+TEST_CASE("color_files") {
+    HeightField hf;
+    hf.push_back(std::vector<float> { -1.0f, 0.0f });
+    hf.push_back(std::vector<float> { 1.0f, 0.5f });
+    std::vector<ColorMap> maps;
+    maps.push_back(ColorMap(std::vector<std::vector<float>> {
+        { 0.0f, 0.0f }, { 1.0f, 1.0f } }));
+    maps.push_back(ColorMap(std::vector<std::vector<float>> {
+        { 0.0f, 1.0f }, { 1.0f, 0.0f } }));
+    char first[] = "/tmp/heightfield2colorXXXXXX";
+    char second[] = "/tmp/heightfield2colorXXXXXX";
+    for (char* name : { first, second }) {
+        int fd = mkstemp(name);
+        REQUIRE(fd != -1);
+        close(fd);
+    }
+    {
+        HeightFieldRowReader rows(hf, {});
+        std::vector<std::unique_ptr<ImageFileWriter>> writers;
+        writers.push_back(std::unique_ptr<ImageFileWriter>(
+            new ImageFileWriter(first, ImagePNM, 2, 2, 1)));
+        writers.push_back(std::unique_ptr<ImageFileWriter>(
+            new ImageFileWriter(second, ImagePNM, 2, 2, 1)));
+        color_files(writers, std::vector<ImageFileFormat>(2, ImagePNM), rows,
+            maps, -1.0f, 1.0f);
     }
+    const std::string a = read_file(first), b = read_file(second);
+    unlink(first);
+    unlink(second);
+    REQUIRE(a == std::string("P5\n2 2\n255\n\x00\x80\xff\xbf", 15));
+    REQUIRE(b == std::string("P5\n2 2\n255\n\xff\x80\x00\x40", 15));
 }
 
 #endif
@@ -9,115 +9,484 @@
 #if defined(UNITTEST)
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
-#include <algorithm>
+#include <cstdio>
 #else
 #include "convenience.hpp"
 #endif
+#include "heightfieldfile.hpp"
 #include <cinttypes>
 #include <vector>
+#include <string>
 typedef std::vector<std::vector<float>> V3;
 typedef std::vector<std::vector<std::uint32_t>> TriStrips;
-#define IO_HEIGHTFIELD2MODELOUT_TYPE HeightField2ModelOut_Template<V3,V3,TriStrips>
+#define IO_HEIGHTFIELD2MODELIN_TYPE HeightField2ModelIn_Template<HeightField,std::string,std::string,std::vector<std::uint32_t>,float,float,float,float,std::vector<std::vector<float>>,std::uint32_t,std::string,float,std::uint32_t,std::uint32_t,float,std::string,std::uint32_t,std::string,std::string,bool,std::uint32_t>
+#define IO_HEIGHTFIELD2MODELOUT_TYPE HeightField2ModelOut_Template<V3,V3,V3,TriStrips>
 #include "heightfield2model_io.hpp"
 #include "colormap.hpp"
+#include "heightfieldjson.hpp"
+#include "glbfile.hpp"
+#include "rtin.hpp"
+#include "meshchunk.hpp"
+#include "meshindex.hpp"
+#include "normals.hpp"
+#include "spill.hpp"
+#include "threadpool.hpp"
+#include "output.hpp"
+#include "rowwriter.hpp"
+#include "numberformat.hpp"
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <fcntl.h>
 #include <unistd.h>
 
 
-static void minmax(
-    io::HeightField2ModelIn::heightfieldType& Map, float& Min, float& Max)
+enum VertexEncoding {
+    EncodingXYZ,
+    EncodingGrid,
+    EncodingQuantized
+};
+
+struct ModelOptions {
+    VertexEncoding encoding = EncodingXYZ;
+    bool normals = false;
+    NormalEncoding normal_encoding = NormalXYZ;
+    bool wrap = false;
+};
+
+// Writes vertices and colors a row at a time, reading the rows again for the
+// colors and normals. Last row has no triangle strip.
+static void write_model(std::ostream& Out, HeightFieldRowReader& Rows,
+    io::HeightField2ModelIn& Val, float Min, float Max,
+    const NumberFormat& Format, const ModelOptions& Options = ModelOptions())
 {
-    Min = Max = Map.front().front();
-    for (auto& line : Map)
-        for (auto& value : line)
-            if (value < Min)
-                Min = value;
-            else if (Max < value)
-                Max = value;
+    const float zscale = Val.range() / (Max - Min);
+    const float spacing = Val.width() / (Rows.Width() - 1);
+    std::vector<char> buffer;
+    switch (Options.encoding) {
+    case EncodingXYZ:
+        Out << "{\"vertices\":";
+        WriteVertices(Out, Rows, Val.width(), zscale, Format);
+        break;
+    case EncodingGrid:
+        Out << "{\"grid\":{\"columns\":" << Rows.Width()
+            << ",\"rows\":" << Rows.Height() << ",\"spacing\":";
+        Format.WriteItems(Out, std::vector<float> { spacing }, false, buffer);
+        Out << "},\"heights\":";
+        WriteHeights(Out, Rows, zscale, Format);
+        break;
+    case EncodingQuantized:
+        if (65536 < Rows.Width() || 65536 < Rows.Height())
+            throw std::runtime_error(
+                "Quantized height field has over 65536 rows or columns.");
+        Out << "{\"positions\":";
+        WriteQuantizedVertices(Out, Rows, Min, Max, Format);
+        Out << ",\"offset\":";
+        Format.Write(Out, std::vector<float> { 0.0f, 0.0f, zscale * Min },
+            buffer);
+        Out << ",\"scale\":";
+        Format.Write(Out, std::vector<float> { spacing, spacing,
+            (Min < Max) ? Val.range() / 65535.0f : 0.0f }, buffer);
+        break;
+    }
+    if (Val.colormapGiven()) {
+        Out << ",\"colors\":";
+        WriteColors(Out, Rows, ColorMap(Val.colormap()), Min, Max, Format);
+    }
+    if (Options.normals) {
+        ThreadPool pool;
+        Out << ",\"normals\":";
+        WriteNormals(Out, Rows, spacing, zscale, Options.wrap,
+            Options.normal_encoding, Format, pool);
+    }
+    Out << ",\"tristrips\":";
+    WriteTriStrips(Out, Rows.Width(), Rows.Height(), Format);
+    Out << '}' << std::endl;
 }
 
-static void create_vertices(V3& Vertices,
-    const io::HeightField2ModelIn::heightfieldType& Heightfield,
-    const float Width, const float Range, const float Min, const float Max)
+// Writes vertices and colors of each row to Writer as the row is read.
+static void write_glb(GLBWriter& Writer, HeightFieldRowReader& Rows,
+    io::HeightField2ModelIn& Val, float Min, float Max)
 {
-    Vertices.reserve(Heightfield.size() * Heightfield.front().size());
-    const float zscale = Range / (Max - Min);
-    for (std::size_t y = 0; y < Heightfield.size(); ++y) {
-        const float yc = (y * Width) / (Heightfield.front().size() - 1);
-        const std::vector<float>& row = Heightfield[y];
-        for (std::size_t x = 0; x < row.size(); ++x) {
-            float xc = (x * Width) / (row.size() - 1);
-            float zc = zscale * row[x];
-            Vertices.push_back(std::vector<float> { xc, yc, zc });
-        }
+    const float zscale = Val.range() / (Max - Min);
+    std::unique_ptr<ColorMap> map;
+    if (Val.colormapGiven())
+        map.reset(new ColorMap(Val.colormap()));
+    const float range = (Min < Max) ? Max - Min : 1.0f;
+    std::vector<float> line, colors;
+    if (map)
+        colors.resize(std::size_t(Rows.Width()) * map->Channels());
+    Rows.Rewind();
+    for (std::uint32_t y = 0; const float* row = Rows.Next(); ++y) {
+        line.resize(0);
+        VertexRow(line, row, Rows.Width(), y, Val.width(), zscale);
+        if (map)
+            map->MapRow(row, Rows.Width(), Min, range, colors.data());
+        Writer.WriteRow(line.data(), colors.data());
     }
+    Writer.Finish();
 }
 
-static void create_tristrips(
-    TriStrips& TS, std::size_t Rows, std::size_t Columns)
+static void read_field(HeightField& Field, HeightFieldRowReader& Rows) {
+    Field = HeightField(Rows.Width(), Rows.Height());
+    Rows.Rewind();
+    for (std::uint32_t y = 0; const float* row = Rows.Next(); ++y)
+        std::memcpy(Field.Row(y), row, sizeof(float) * Rows.Width());
+}
+
+// Writes the vertices and colors at grid indexes Vertices of Field.
+static void write_grid_vertices(std::ostream& Out, const HeightField& Field,
+    const std::vector<std::uint32_t>& Vertices, io::HeightField2ModelIn& Val,
+    float Min, float Max, const NumberFormat& Format)
 {
-    // Each row into triangle strip using the indexes of the next row, too.
-    // Last row is skipped.
-    TS.reserve(Rows - 1);
-    for (std::uint32_t y = 0; y < Rows - 1; ++y) {
-        TS.push_back(std::vector<std::uint32_t>());
-        TS.back().reserve(2 * Columns);
-        for (std::uint32_t x = 0; x < Columns; ++x) {
-            TS.back().push_back(y * Columns + x);
-            TS.back().push_back((y + 1) * Columns + x);
+    const float zscale = Val.range() / (Max - Min);
+    const std::size_t chunk = 4096;
+    const std::size_t columns = Field.Width();
+    std::vector<float> line, heights;
+    std::vector<char> buffer;
+    Out << "\"vertices\":[";
+    for (std::size_t k = 0; k < Vertices.size(); k += chunk) {
+        const std::size_t n = std::min(chunk, Vertices.size() - k);
+        line.resize(0);
+        for (std::size_t v = k; v < k + n; ++v) {
+            const std::size_t x = Vertices[v] % columns;
+            const std::size_t y = Vertices[v] / columns;
+            line.push_back((x * Val.width()) / (columns - 1));
+            line.push_back((y * Val.width()) / (columns - 1));
+            line.push_back(zscale * Field.Row(y)[x]);
         }
+        Format.WriteGroups(Out, line.data(), n, 3, k != 0, buffer);
+    }
+    Out << ']';
+    if (!Val.colormapGiven())
+        return;
+    const ColorMap map(Val.colormap());
+    const float range = (Min < Max) ? Max - Min : 1.0f;
+    line.resize(chunk * map.Channels());
+    Out << ",\"colors\":[";
+    for (std::size_t k = 0; k < Vertices.size(); k += chunk) {
+        const std::size_t n = std::min(chunk, Vertices.size() - k);
+        heights.resize(0);
+        for (std::size_t v = k; v < k + n; ++v)
+            heights.push_back(
+                Field.Row(Vertices[v] / columns)[Vertices[v] % columns]);
+        map.MapRow(heights.data(), n, Min, range, line.data());
+        Format.WriteGroups(
+            Out, line.data(), n, map.Channels(), k != 0, buffer);
     }
+    Out << ']';
 }
 
-static void create_colors(V3& Colors,
-    const io::HeightField2ModelIn::heightfieldType& Heightfield,
-    const io::HeightField2ModelIn::colormapType& Colormap,
-    const float Min, const float Max)
+// Writes Count indexes as arrays of 3 like WriteItems.
+static void write_triangles(std::ostream& Out, const std::uint32_t* Indexes,
+    std::size_t Count, bool Comma, const NumberFormat& Format,
+    std::vector<char>& Buffer)
+{
+    std::vector<std::vector<std::uint32_t>> triangles;
+    for (std::size_t k = 0; k + 2 < Count; k += 3)
+        triangles.push_back(std::vector<std::uint32_t>(
+            Indexes + k, Indexes + k + 3));
+    Format.WriteItems(Out, triangles, Comma, Buffer);
+}
+
+// Writes the adaptive mesh within max_error of the height field. Each
+// triangle is a strip of 3 indexes so the output has the same form as the
+// full mesh. The rows are gathered to one height field first.
+static void write_rtin(std::ostream& Out, HeightFieldRowReader& Rows,
+    io::HeightField2ModelIn& Val, float Min, float Max,
+    const NumberFormat& Format)
 {
+    HeightField field;
+    read_field(field, Rows);
+    const RTIN rtin(field);
+    const float zscale = Val.range() / (Max - Min);
+    std::vector<std::uint32_t> vertices, triangles;
+    rtin.Mesh(Val.max_error() / std::fabs(zscale), vertices, triangles);
+    Out << '{';
+    write_grid_vertices(Out, field, vertices, Val, Min, Max, Format);
+    Out << ",\"tristrips\":[";
+    std::vector<char> buffer;
+    const std::size_t chunk = 3 * 4096;
+    for (std::size_t k = 0; k < triangles.size(); k += chunk)
+        write_triangles(Out, triangles.data() + k,
+            std::min(chunk, triangles.size() - k), k != 0, Format, buffer);
+    Out << "]}" << std::endl;
+}
+
+// Writes the vertices and colors in the order of first use by the blocks
+// layout. Rows are read once, keeping the previous row for the first two
+// rows that each block uses in turn. The part of each row that goes to a
+// block is appended to the section of the block, and sections beyond
+// memory_budget go to a temporary file until the last row.
+static void write_blocks(std::ostream& Out, HeightFieldRowReader& Rows,
+    io::HeightField2ModelIn& Val, float Min, float Max,
+    const NumberFormat& Format, std::uint32_t Cache)
+{
+    const std::uint32_t width = Rows.Width();
+    const std::uint32_t block = IndexBlockWidth(Cache);
+    const std::uint32_t count = (width - 2) / block + 1;
+    std::unique_ptr<ColorMap> map;
+    if (Val.colormapGiven())
+        map.reset(new ColorMap(Val.colormap()));
+    const std::size_t budget = std::size_t(
+        Val.memory_budgetGiven() ? Val.memory_budget() : 256) << 20;
+    SpilledSections vertices(count, map ? budget / 2 : budget);
+    SpilledSections colors(map ? count : 0, budget / 2);
+    const float zscale = Val.range() / (Max - Min);
     const float range = (Min < Max) ? Max - Min : 1.0f;
-    Colors.reserve(Heightfield.size() * Heightfield.front().size());
-    for (auto& line : Heightfield)
-        for (auto& v : line)
-            Colors.push_back(Interpolated((v - Min) / range, Colormap));
+    std::vector<float> previous(width), line, heights, mapped;
+    std::vector<char> buffer;
+    std::ostringstream text;
+    Rows.Rewind();
+    for (std::uint32_t y = 0; const float* row = Rows.Next(); ++y) {
+        if (y == 0) {
+            std::memcpy(previous.data(), row, sizeof(float) * width);
+            continue;
+        }
+        for (std::uint32_t b = 0; b < count; ++b) {
+            const std::uint32_t first = b ? b * block + 1 : 0;
+            const std::uint32_t last = std::min((b + 1) * block, width - 1);
+            line.resize(0);
+            heights.resize(0);
+            for (std::uint32_t x = first; x <= last; ++x)
+                for (std::uint32_t r = (y == 1) ? 0 : y; r <= y; ++r) {
+                    const float h = r ? row[x] : previous[x];
+                    line.push_back((x * Val.width()) / (width - 1));
+                    line.push_back((r * Val.width()) / (width - 1));
+                    line.push_back(zscale * h);
+                    heights.push_back(h);
+                }
+            // Sections are joined, so only the very first vertex has no comma.
+            const bool comma = b || y != 1;
+            text.str("");
+            Format.WriteGroups(
+                text, line.data(), heights.size(), 3, comma, buffer);
+            vertices.Append(b, text.str());
+            if (!map)
+                continue;
+            mapped.resize(heights.size() * map->Channels());
+            map->MapRow(heights.data(), heights.size(), Min, range,
+                mapped.data());
+            text.str("");
+            Format.WriteGroups(text, mapped.data(), heights.size(),
+                map->Channels(), comma, buffer);
+            colors.Append(b, text.str());
+        }
+    }
+    Out << "\"vertices\":[";
+    vertices.Write(Out);
+    Out << ']';
+    if (!map)
+        return;
+    Out << ",\"colors\":[";
+    colors.Write(Out);
+    Out << ']';
 }
 
-static void create_output(io::HeightField2ModelOut& Out,
-    io::HeightField2ModelIn& Val, float Min, float Max)
+// Writes the mesh with indexes in index_layout, and the ACMR of each layout
+// for a FIFO cache of vertex_cache vertices. The blocks layout is a list of
+// triangles with the vertices in the order of first use.
+static void write_layout(std::ostream& Out, HeightFieldRowReader& Rows,
+    io::HeightField2ModelIn& Val, float Min, float Max,
+    const NumberFormat& Format)
 {
-    create_vertices(Out.vertices, Val.heightfield(), Val.width(), Val.range(),
-        Min, Max);
-    create_tristrips(Out.tristrips,
-        Val.heightfield().size(), Val.heightfield().front().size());
-    if (Val.colormapGiven()) {
-        SortColorMap(Val.colormap());
-        create_colors(Out.colors, Val.heightfield(), Val.colormap(), Min, Max);
+    const IndexLayout layout = IndexLayoutFromName(Val.index_layout());
+    const std::uint32_t cache =
+        Val.vertex_cacheGiven() ? Val.vertex_cache() : 32;
+    if (cache < 1)
+        throw std::runtime_error("vertex_cache must be positive.");
+    const std::uint32_t width = Rows.Width(), height = Rows.Height();
+    std::vector<char> buffer;
+    bool comma = false;
+    if (layout != LayoutBlocks) {
+        Out << "{\"vertices\":";
+        WriteVertices(
+            Out, Rows, Val.width(), Val.range() / (Max - Min), Format);
+        if (Val.colormapGiven()) {
+            Out << ",\"colors\":";
+            WriteColors(Out, Rows, ColorMap(Val.colormap()), Min, Max, Format);
+        }
+        Out << ",\"tristrips\":[";
+        if (layout != LayoutRows)
+            Out << '[';
+        std::vector<std::vector<std::uint32_t>> strip(1);
+        LayoutIndexes(layout, width, height, cache,
+            [&](const std::vector<std::uint32_t>& Part) {
+                if (layout == LayoutRows) {
+                    strip[0] = Part;
+                    Format.WriteItems(Out, strip, comma, buffer);
+                } else
+                    Format.WriteItems(Out, Part, comma, buffer);
+                comma = true;
+            });
+        if (layout != LayoutRows)
+            Out << ']';
+    } else {
+        Out << '{';
+        write_blocks(Out, Rows, Val, Min, Max, Format, cache);
+        Out << ",\"triangles\":[";
+        std::vector<std::uint32_t> mapped;
+        LayoutIndexes(layout, width, height, cache,
+            [&](const std::vector<std::uint32_t>& Part) {
+                mapped.resize(0);
+                for (std::uint32_t idx : Part)
+                    mapped.push_back(BlockVertexIndex(
+                        idx % width, idx / width, width, height, cache));
+                write_triangles(
+                    Out, mapped.data(), mapped.size(), comma, Format, buffer);
+                comma = true;
+            });
+    }
+    Out << "],\"acmr\":{";
+    for (int k = 0; k < IndexLayoutCount; ++k) {
+        const IndexLayout l = static_cast<IndexLayout>(k);
+        char number[MaxNumberLength];
+        char* end = FormatShortest(
+            static_cast<float>(ACMR(l, width, height, cache)), number);
+        Out << (k ? ",\"" : "\"") << IndexLayoutName(l) << "\":";
+        Out.write(number, end - number);
+    }
+    Out << "}}" << std::endl;
+}
+
+// Writes the mesh as chunks of chunk_size quads. Rows are read a band of
+// chunks at a time. Chunks of a band are built and formatted in parallel and
+// written in order.
+static void write_chunks(std::ostream& Out, HeightFieldRowReader& Rows,
+    io::HeightField2ModelIn& Val, float Min, float Max,
+    const NumberFormat& Format, ThreadPool& Pool)
+{
+    const std::uint32_t size = Val.chunk_size();
+    const std::uint32_t levels =
+        Val.chunk_levelsGiven() ? Val.chunk_levels() : 1;
+    if (size < 1 || MaxMeshChunkSize < size)
+        throw std::runtime_error("chunk_size must be in [1, " +
+            std::to_string(MaxMeshChunkSize) + "].");
+    if (levels < 1 || 8 < levels || size % (1u << (levels - 1)))
+        throw std::runtime_error(
+            "chunk_size must be divisible by 2^(chunk_levels - 1).");
+    std::unique_ptr<ColorMap> map;
+    if (Val.colormapGiven())
+        map.reset(new ColorMap(Val.colormap()));
+    const MeshScale scale {
+        Val.width(), Rows.Width(), Val.range() / (Max - Min) };
+    const float skirt = Val.skirt_depthGiven() ? Val.skirt_depth() : -1.0f;
+    const std::size_t row_size = sizeof(float) * Rows.Width();
+    const std::uint32_t count = (Rows.Width() - 2) / size + 1;
+    std::vector<MeshChunk> chunks(count);
+    std::vector<std::string> texts(count);
+    HeightField band(Rows.Width(), size + 1);
+    Rows.Rewind();
+    std::memcpy(band.Row(0), Rows.Next(), row_size);
+    Out << "{\"chunks\":[";
+    for (std::uint32_t y = 0; y + 1 < Rows.Height(); y += size) {
+        const std::uint32_t height =
+            std::min(size, Rows.Height() - 1 - y) + 1;
+        if (y)
+            std::memcpy(band.Row(0), band.Row(size), row_size);
+        for (std::uint32_t k = 1; k < height; ++k)
+            std::memcpy(band.Row(k), Rows.Next(), row_size);
+        Pool.ParallelFor(count, [&](std::size_t Begin, std::size_t End) {
+            for (std::size_t c = Begin; c < End; ++c) {
+                const std::uint32_t x = static_cast<std::uint32_t>(c) * size;
+                BuildMeshChunk(chunks[c], band, x, y,
+                    std::min(size, Rows.Width() - 1 - x) + 1, height,
+                    levels, skirt, scale);
+                std::ostringstream text;
+                WriteMeshChunk(text, chunks[c], map.get(), Min, Max, Format);
+                texts[c] = text.str();
+            }
+        });
+        for (std::uint32_t c = 0; c < count; ++c)
+            Out << ((y || c) ? "," : "") << texts[c];
     }
+    Out << "]}" << std::endl;
 }
 
 #if !defined(UNITTEST)
 
+static const char* encoding_names[] = { "xyz", "grid", "quantized" };
+static const int encoding_count = 3;
+
+static ModelOptions model_options(const io::HeightField2ModelIn& Val) {
+    ModelOptions options;
+    if (Val.vertex_encodingGiven()) {
+        int k = 0;
+        while (k < encoding_count &&
+            Val.vertex_encoding() != encoding_names[k])
+            ++k;
+        if (k == encoding_count)
+            throw std::runtime_error(
+                "Unknown vertex encoding: " + Val.vertex_encoding());
+        options.encoding = static_cast<VertexEncoding>(k);
+    }
+    options.normals = Val.normalsGiven();
+    if (options.normals)
+        options.normal_encoding = NormalEncodingFromName(Val.normals());
+    options.wrap = Val.normals_wrapGiven() && Val.normals_wrap();
+    return options;
+}
+
 static int model(io::HeightField2ModelIn& Val) {
-    std::vector<char> output_buffer;
-    if (Val.heightfield().size() < 2) {
-        std::cerr << "Height field has less than 2 rows." << std::endl;
-        return 1;
+    try {
+        std::unique_ptr<HeightFieldRowReader> rows = HeightFieldRows(Val);
+        if (rows->Height() < 2)
+            throw std::runtime_error("Height field has less than 2 rows.");
+        if (rows->Width() < 2)
+            throw std::runtime_error("Height field has less than 2 columns.");
+        if (!Val.widthGiven())
+            Val.width() = rows->Width() - 1;
+        float min, max;
+        HeightFieldRange(Val, *rows, min, max);
+        if (!Val.rangeGiven())
+            Val.range() = max - min;
+        if (1 < int(Val.glb_fileGiven()) + int(Val.max_errorGiven())
+            + int(Val.chunk_sizeGiven()) + int(Val.index_layoutGiven())
+            + int(Val.vertex_encodingGiven()))
+            throw std::runtime_error("Only one of glb_file, max_error, "
+                "chunk_size, index_layout, and vertex_encoding can be given.");
+        if (Val.normalsGiven() && (Val.glb_fileGiven() ||
+            Val.max_errorGiven() || Val.chunk_sizeGiven() ||
+            Val.index_layoutGiven()))
+            throw std::runtime_error("normals can be used only with the "
+                "vertices of the full mesh.");
+        if (Val.chunk_sizeGiven()) {
+            ThreadPool pool;
+            write_chunks(Output(), *rows, Val, min, max, NumberFormat(
+                Val.output_precisionGiven() ? Val.output_precision() : 0),
+                pool);
+            return 0;
+        }
+        if (Val.max_errorGiven()) {
+            write_rtin(Output(), *rows, Val, min, max, NumberFormat(
+                Val.output_precisionGiven() ? Val.output_precision() : 0));
+            return 0;
+        }
+        if (Val.index_layoutGiven()) {
+            write_layout(Output(), *rows, Val, min, max, NumberFormat(
+                Val.output_precisionGiven() ? Val.output_precision() : 0));
+            return 0;
+        }
+        if (!Val.glb_fileGiven()) {
+            write_model(Output(), *rows, Val, min, max, NumberFormat(
+                Val.output_precisionGiven() ? Val.output_precision() : 0),
+                model_options(Val));
+            return 0;
+        }
+        GLBWriter writer(Val.glb_file(), rows->Width(), rows->Height(),
+            Val.colormapGiven() ? ColorMap(Val.colormap()).Channels() : 0);
+        write_glb(writer, *rows, Val, min, max);
+        Output() << "{\"glb_file\":";
+        WriteJSONString(Output(), Val.glb_file());
+        Output() << '}' << std::endl;
     }
-    if (Val.heightfield().front().size() < 2) {
-        std::cerr << "Height field has less than 2 columns." << std::endl;
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
         return 1;
     }
-    if (!Val.widthGiven())
-        Val.width() = Val.heightfield().front().size() - 1;
-    float min, max;
-    minmax(Val.heightfield(), min, max);
-    if (!Val.rangeGiven())
-        Val.range() = max - min;
-    io::HeightField2ModelOut out;
-    create_output(out, Val, min, max);
-    Write(std::cout, out, output_buffer);
-    std::cout << std::endl;
     return 0;
 }
 
@@ -127,6 +496,8 @@ int main(int argc, char** argv) {
         f = open(argv[1], O_RDONLY);
     InputParser<io::ParserPool, io::HeightField2ModelIn_Parser,
         io::HeightField2ModelIn> ip(f);
+    ip.AddNumberArray<float>("heightfield", [](io::HeightField2ModelIn& Val)
+        -> HeightField& { return Val.heightfield(); });
     int status = ip.ReadAndParse(model);
     if (f)
         close(f);
@@ -135,146 +506,244 @@ int main(int argc, char** argv) {
 
 #else
 
-TEST_CASE("minmax") {
-    io::HeightField2ModelIn::heightfieldType map;
-    SUBCASE("min first") {
-        map.resize(0);
-        map.push_back(std::vector<float> { -1.0f, 0.0f });
-        map.push_back(std::vector<float> { 1.0f, 0.5f });
-        float min, max;
-        minmax(map, min, max);
-        REQUIRE(min == -1.0f);
-        REQUIRE(max == 1.0f);
-    }
-    SUBCASE("max first") {
-        map.resize(0);
-        map.push_back(std::vector<float> { 2.0f, 0.0f });
-        map.push_back(std::vector<float> { 1.0f, 0.5f });
-        float min, max;
-        minmax(map, min, max);
-        REQUIRE(min == 0.0f);
-        REQUIRE(max == 2.0f);
-    }
-    SUBCASE("min and max later") {
-        map.resize(0);
-        map.push_back(std::vector<float> { 2.0f, 3.0f });
-        map.push_back(std::vector<float> { 1.0f, 0.5f });
-        float min, max;
-        minmax(map, min, max);
-        REQUIRE(min == 0.5f);
-        REQUIRE(max == 3.0f);
+static void create_vertices(V3& Vertices, const HeightField& Heightfield,
+    const float Width, const float Range, const float Min, const float Max)
+{
+    std::vector<float> flat;
+    for (std::size_t y = 0; y < Heightfield.Height(); ++y)
+        VertexRow(flat, Heightfield.Row(y), Heightfield.Width(), y,
+            Width, Range / (Max - Min));
+    for (std::size_t k = 0; k < flat.size(); k += 3)
+        Vertices.push_back(std::vector<float>(
+            flat.begin() + k, flat.begin() + k + 3));
+}
+
+static void create_tristrips(
+    TriStrips& TS, std::size_t Rows, std::size_t Columns)
+{
+    for (std::uint32_t y = 0; y < Rows - 1; ++y) {
+        TS.push_back(std::vector<std::uint32_t>());
+        StripRow(TS.back(), y, Columns);
+    }
+}
+
+static void create_colors(V3& Colors, const HeightField& Heightfield,
+    const io::HeightField2ModelIn::colormapType& Colormap,
+    const float Min, const float Max)
+{
+    const ColorMap map(Colormap);
+    std::vector<float> flat(Heightfield.Width() * map.Channels());
+    for (std::size_t y = 0; y < Heightfield.Height(); ++y) {
+        map.MapRow(Heightfield.Row(y), Heightfield.Width(), Min,
+            (Min < Max) ? Max - Min : 1.0f, flat.data());
+        for (std::size_t x = 0; x < Heightfield.Width(); ++x)
+            Colors.push_back(std::vector<float>(
+                flat.begin() + x * map.Channels(),
+                flat.begin() + (x + 1) * map.Channels()));
     }
 }
 
-TEST_CASE("create_output") {
-    io::HeightField2ModelOut out;
+TEST_CASE("write_model") {
     io::HeightField2ModelIn val;
     val.range() = 4.0f;
     val.width() = 8.0f;
     float min, max;
+    std::ostringstream out;
     SUBCASE("1 strip") {
-        val.heightfield().resize(0);
+        val.heightfield().clear();
         val.heightfield().push_back(std::vector<float> { -1.0f, 0.0f });
         val.heightfield().push_back(std::vector<float> { 1.0f, 0.5f });
-        minmax(val.heightfield(), min, max);
-        create_output(out, val, min, max);
-        REQUIRE(out.vertices.size() == 4);
-        REQUIRE(out.vertices[0].size() == 3);
-        REQUIRE(out.vertices[0][0] == 0.0f);
-        REQUIRE(out.vertices[0][1] == 0.0f);
-        REQUIRE(out.vertices[0][2] == -2.0f);
-        REQUIRE(out.vertices[1][0] == 8.0f);
-        REQUIRE(out.vertices[1][1] == 0.0f);
-        REQUIRE(out.vertices[1][2] == 0.0f);
-        REQUIRE(out.vertices[2][0] == 0.0f);
-        REQUIRE(out.vertices[2][1] == 8.0f);
-        REQUIRE(out.vertices[2][2] == 2.0f);
-        REQUIRE(out.tristrips.size() == 1);
-        REQUIRE(out.tristrips[0].size() == 4);
-        std::sort(out.tristrips[0].begin(), out.tristrips[0].end());
-        for (std::uint32_t k = 0; k < out.tristrips[0].size(); ++k)
-            REQUIRE(out.tristrips[0][k] == k);
+        HeightFieldRowReader rows(val.heightfield(), {});
+        MinMax(rows, min, max);
+        write_model(out, rows, val, min, max, NumberFormat());
+        REQUIRE(out.str() == "{\"vertices\":[[0,0,-2],[8,0,0],[0,8,2],"
+            "[8,8,1]],\"tristrips\":[[0,2,1,3]]}\n");
     }
     SUBCASE("2 strips") {
-        val.heightfield().resize(0);
+        val.heightfield().clear();
         val.heightfield().push_back(std::vector<float> { -1.0f, 0.0f });
         val.heightfield().push_back(std::vector<float> { 3.0f, 2.0f });
         val.heightfield().push_back(std::vector<float> { 1.0f, 0.5f });
-        minmax(val.heightfield(), min, max);
-        create_output(out, val, min, max);
-        REQUIRE(out.vertices.size() == 6);
-        REQUIRE(out.tristrips.size() == 2);
-        REQUIRE(out.tristrips[0].size() == 4);
-        REQUIRE(out.tristrips[1].size() == 4);
-        std::sort(out.tristrips[1].begin(), out.tristrips[1].end());
-        for (std::uint32_t k = 0; k < out.tristrips[1].size(); ++k)
-            REQUIRE(out.tristrips[1][k] == k + 2);
+        HeightFieldRowReader rows(val.heightfield(), {});
+        MinMax(rows, min, max);
+        write_model(out, rows, val, min, max, NumberFormat());
+        REQUIRE(out.str() == "{\"vertices\":[[0,0,-1],[8,0,0],[0,8,3],"
+            "[8,8,2],[0,16,1],[8,16,0.5]],"
+            "\"tristrips\":[[0,2,1,3],[2,4,3,5]]}\n");
+    }
+}
+
+TEST_CASE("write_rtin") {
+    io::HeightField2ModelIn val;
+    val.range() = 4.0f;
+    val.width() = 4.0f;
+    for (int y = 0; y < 3; ++y)
+        val.heightfield().push_back(std::vector<float> { 0.0f, 0.0f, 0.0f });
+    val.heightfield()[1][1] = 1.0f;
+    HeightFieldRowReader rows(val.heightfield(), {});
+    std::ostringstream out;
+    SUBCASE("Coarse") {
+        val.max_error() = 4.0f;
+        write_rtin(out, rows, val, 0.0f, 1.0f, NumberFormat());
+        REQUIRE(out.str() == "{\"vertices\":[[0,0,0],[4,4,0],[4,0,0],"
+            "[0,4,0]],\"tristrips\":[[0,1,2],[1,0,3]]}\n");
+    }
+    SUBCASE("Fine") {
+        val.max_error() = 1.0f;
+        write_rtin(out, rows, val, 0.0f, 1.0f, NumberFormat());
+        REQUIRE(out.str().find("[2,2,4]") != std::string::npos);
+    }
+}
+
+TEST_CASE("write_model encodings") {
+    io::HeightField2ModelIn val;
+    val.range() = 4.0f;
+    val.width() = 8.0f;
+    val.heightfield().push_back(std::vector<float> { -1.0f, 0.0f });
+    val.heightfield().push_back(std::vector<float> { 1.0f, 0.5f });
+    HeightFieldRowReader rows(val.heightfield(), {});
+    std::ostringstream out;
+    SUBCASE("grid") {
+        ModelOptions options;
+        options.encoding = EncodingGrid;
+        write_model(out, rows, val, -1.0f, 1.0f, NumberFormat(), options);
+        REQUIRE(out.str() == "{\"grid\":{\"columns\":2,\"rows\":2,"
+            "\"spacing\":8},\"heights\":[-2,0,2,1],"
+            "\"tristrips\":[[0,2,1,3]]}\n");
+    }
+    SUBCASE("quantized") {
+        ModelOptions options;
+        options.encoding = EncodingQuantized;
+        write_model(out, rows, val, -1.0f, 1.0f, NumberFormat(), options);
+        REQUIRE(out.str() == "{\"positions\":[[0,0,0],[1,0,32768],"
+            "[0,1,65535],[1,1,49151]],\"offset\":[0,0,-2],"
+            "\"scale\":[8,8,6.103609e-05],"
+            "\"tristrips\":[[0,2,1,3]]}\n");
+    }
+    SUBCASE("normals") {
+        ModelOptions options;
+        options.normals = true;
+        options.normal_encoding = NormalOctahedral;
+        write_model(out, rows, val, -1.0f, 1.0f, NumberFormat(), options);
+        REQUIRE(out.str().find("],\"normals\":[[") != std::string::npos);
+        REQUIRE(out.str().find("]],\"tristrips\":") != std::string::npos);
+    }
+}
+
+TEST_CASE("write_chunks") {
+    io::HeightField2ModelIn val;
+    val.range() = 3.0f;
+    val.width() = 3.0f;
+    for (int y = 0; y < 3; ++y)
+        val.heightfield().push_back(
+            std::vector<float> { 0.0f, 1.0f, 2.0f, 3.0f });
+    HeightFieldRowReader rows(val.heightfield(), {});
+    ThreadPool pool(2);
+    std::ostringstream out;
+    val.chunk_size() = 2;
+    write_chunks(out, rows, val, 0.0f, 3.0f, NumberFormat(), pool);
+    REQUIRE(out.str() == "{\"chunks\":["
+        "{\"window\":[0,0,3,3],\"min\":[0,0,0],\"max\":[2,2,2],"
+        "\"levels\":[{\"vertices\":[[0,0,0],[1,0,1],[2,0,2],"
+        "[0,1,0],[1,1,1],[2,1,2],[0,2,0],[1,2,1],[2,2,2]],"
+        "\"tristrips\":[[0,3,1,4,2,5],[3,6,4,7,5,8]]}]},"
+        "{\"window\":[2,0,2,3],\"min\":[2,0,2],\"max\":[3,2,3],"
+        "\"levels\":[{\"vertices\":[[2,0,2],[3,0,3],[2,1,2],[3,1,3],"
+        "[2,2,2],[3,2,3]],\"tristrips\":[[0,2,1,3],[2,4,3,5]]}]}]}\n");
+}
+
+TEST_CASE("write_layout") {
+    io::HeightField2ModelIn val;
+    val.range() = 2.0f;
+    val.width() = 2.0f;
+    for (int y = 0; y < 3; ++y)
+        val.heightfield().push_back(std::vector<float> {
+            float(y), float(y), float(y) });
+    HeightFieldRowReader rows(val.heightfield(), {});
+    std::ostringstream out;
+    // All 9 vertices fit in the cache.
+    const std::string acmr(",\"acmr\":{\"rows\":1.125,\"strip\":1.125,"
+        "\"restart\":1.125,\"blocks\":1.125}}\n");
+    SUBCASE("strip") {
+        val.index_layout() = "strip";
+        write_layout(out, rows, val, 0.0f, 2.0f, NumberFormat());
+        REQUIRE(out.str() == "{\"vertices\":[[0,0,0],[1,0,0],[2,0,0],"
+            "[0,1,1],[1,1,1],[2,1,1],[0,2,2],[1,2,2],[2,2,2]],"
+            "\"tristrips\":[[0,3,1,4,2,5,5,3,3,6,4,7,5,8]]" + acmr);
+    }
+    SUBCASE("blocks") {
+        val.index_layout() = "blocks";
+        write_layout(out, rows, val, 0.0f, 2.0f, NumberFormat());
+        REQUIRE(out.str() == "{\"vertices\":[[0,0,0],[0,1,1],[1,0,0],"
+            "[1,1,1],[2,0,0],[2,1,1],[0,2,2],[1,2,2],[2,2,2]],"
+            "\"triangles\":[[0,1,2],[1,3,2],[2,3,4],[3,5,4],"
+            "[1,6,3],[6,7,3],[3,7,5],[7,8,5]]" + acmr);
     }
 }
 
 TEST_CASE("create_vertices") {
-    io::HeightField2ModelIn::heightfieldType hf;
+    HeightField hf;
     V3 vertices;
     SUBCASE("Index coordinates, original height.") {
-        hf.resize(0);
+        hf.clear();
         vertices.resize(0);
         hf.push_back(std::vector<float> { -1.0f, 0.0f });
         hf.push_back(std::vector<float> { 3.0f, 2.0f });
         create_vertices(vertices, hf, 1.0f, 4.0f, -1.0f, 3.0f);
-        REQUIRE(vertices.size() == hf.size() * hf.front().size());
+        REQUIRE(vertices.size() == hf.Height() * hf.Width());
         REQUIRE(vertices[0].size() == 3);
-        for (std::size_t y = 0; y < hf.size(); ++y)
-            for (std::size_t x = 0; x < hf.front().size(); ++x) {
-                const std::size_t idx = y * hf.front().size() + x;
+        for (std::size_t y = 0; y < hf.Height(); ++y)
+            for (std::size_t x = 0; x < hf.Width(); ++x) {
+                const std::size_t idx = y * hf.Width() + x;
                 REQUIRE(vertices[idx][0] == x);
                 REQUIRE(vertices[idx][1] == y);
                 REQUIRE(vertices[idx][2] == hf[y][x]);
             }
     }
     SUBCASE("Double coordinates, halve height.") {
-        hf.resize(0);
+        hf.clear();
         vertices.resize(0);
         hf.push_back(std::vector<float> { -1.0f, 0.0f });
         hf.push_back(std::vector<float> { 3.0f, 2.0f });
         create_vertices(vertices, hf, 2.0f, 2.0f, -1.0f, 3.0f);
-        REQUIRE(vertices.size() == hf.size() * hf.front().size());
+        REQUIRE(vertices.size() == hf.Height() * hf.Width());
         REQUIRE(vertices[0].size() == 3);
-        for (std::size_t y = 0; y < hf.size(); ++y)
-            for (std::size_t x = 0; x < hf.front().size(); ++x) {
-                const std::size_t idx = y * hf.front().size() + x;
+        for (std::size_t y = 0; y < hf.Height(); ++y)
+            for (std::size_t x = 0; x < hf.Width(); ++x) {
+                const std::size_t idx = y * hf.Width() + x;
                 REQUIRE(vertices[idx][0] == 2.0f * x);
                 REQUIRE(vertices[idx][1] == 2.0f * y);
                 REQUIRE(vertices[idx][2] == 0.5f * hf[y][x]);
             }
     }
     SUBCASE("Fewer rows than columns.") {
-        hf.resize(0);
+        hf.clear();
         vertices.resize(0);
         hf.push_back(std::vector<float> { -1.0f, 0.0f, 1.0f });
         hf.push_back(std::vector<float> { 3.0f, 2.0f, 0.0f });
         create_vertices(vertices, hf, 6.0f, 2.0f, -1.0f, 3.0f);
-        REQUIRE(vertices.size() == hf.size() * hf.front().size());
+        REQUIRE(vertices.size() == hf.Height() * hf.Width());
         REQUIRE(vertices[0].size() == 3);
-        for (std::size_t y = 0; y < hf.size(); ++y)
-            for (std::size_t x = 0; x < hf.front().size(); ++x) {
-                const std::size_t idx = y * hf.front().size() + x;
+        for (std::size_t y = 0; y < hf.Height(); ++y)
+            for (std::size_t x = 0; x < hf.Width(); ++x) {
+                const std::size_t idx = y * hf.Width() + x;
                 REQUIRE(vertices[idx][0] == 3.0f * x);
                 REQUIRE(vertices[idx][1] == 3.0f * y);
                 REQUIRE(vertices[idx][2] == 0.5f * hf[y][x]);
             }
     }
     SUBCASE("Fewer columns than rows.") {
-        hf.resize(0);
+        hf.clear();
         vertices.resize(0);
         hf.push_back(std::vector<float> { -1.0f, 1.0f });
         hf.push_back(std::vector<float> { 3.0f, 0.0f });
         hf.push_back(std::vector<float> { 2.0f, 0.0f });
         create_vertices(vertices, hf, 6.0f, 2.0f, -1.0f, 3.0f);
-        REQUIRE(vertices.size() == hf.size() * hf.front().size());
+        REQUIRE(vertices.size() == hf.Height() * hf.Width());
         REQUIRE(vertices[0].size() == 3);
-        for (std::size_t y = 0; y < hf.size(); ++y)
-            for (std::size_t x = 0; x < hf.front().size(); ++x) {
-                const std::size_t idx = y * hf.front().size() + x;
+        for (std::size_t y = 0; y < hf.Height(); ++y)
+            for (std::size_t x = 0; x < hf.Width(); ++x) {
+                const std::size_t idx = y * hf.Width() + x;
                 REQUIRE(vertices[idx][0] == 6.0f * x);
                 REQUIRE(vertices[idx][1] == 6.0f * y);
                 REQUIRE(vertices[idx][2] == 0.5f * hf[y][x]);
@@ -318,22 +787,52 @@ TEST_CASE("create_tristrips") {
 }
 
 TEST_CASE("create_colors") {
-    io::HeightField2ModelIn::heightfieldType hf;
+    HeightField hf;
     io::HeightField2ModelIn::colormapType colormap;
     colormap.push_back(std::vector<float> { 0.0f, 0.0f });
     colormap.push_back(std::vector<float> { 1.0f, 1.0f });
     V3 colors;
     SUBCASE("Size matches") {
-        hf.resize(0);
+        hf.clear();
         colors.resize(0);
         hf.push_back(std::vector<float> { -1.0f, 1.0f });
         hf.push_back(std::vector<float> { 3.0f, 0.0f });
         hf.push_back(std::vector<float> { 2.0f, 0.0f });
         create_colors(colors, hf, colormap, -1.0f, 3.0f);
-        REQUIRE(colors.size() == hf.size() * hf.front().size());
+        REQUIRE(colors.size() == hf.Height() * hf.Width());
         for (auto& color : colors)
             REQUIRE(color.size() == colormap.front().size() - 1);
     }
 }
 
+TEST_CASE("write_glb") {
+    io::HeightField2ModelIn val;
+    val.range() = 4.0f;
+    val.width() = 8.0f;
+    val.heightfield().push_back(std::vector<float> { -1.0f, 0.0f });
+    val.heightfield().push_back(std::vector<float> { 1.0f, 0.5f });
+    char name[] = "/tmp/heightfield2modelXXXXXX";
+    int fd = mkstemp(name);
+    REQUIRE(fd != -1);
+    close(fd);
+    {
+        HeightFieldRowReader rows(val.heightfield(), {});
+        GLBWriter writer(name, 2, 2, 0);
+        write_glb(writer, rows, val, -1.0f, 1.0f);
+    }
+    std::string data;
+    FILE* f = fopen(name, "rb");
+    int c;
+    while ((c = fgetc(f)) != EOF)
+        data.push_back(char(c));
+    fclose(f);
+    unlink(name);
+    REQUIRE(data.substr(0, 4) == "glTF");
+    REQUIRE(data.find("\"min\":[0,0,-2],\"max\":[8,8,2]") !=
+        std::string::npos);
+    REQUIRE(data.find("COLOR_0") == std::string::npos);
+    const std::string indexes("\0\0\2\0\1\0\3\0", 8);
+    REQUIRE(data.substr(data.size() - 8) == indexes);
+}
+
 #endif
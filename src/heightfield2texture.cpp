@@ -9,78 +9,55 @@
 #if defined(UNITTEST)
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
+#include <sstream>
 #else
 #include "convenience.hpp"
 #endif
+#include "heightfieldfile.hpp"
 #include <vector>
+#include <string>
 typedef std::vector<std::vector<std::vector<float>>> Texture;
 typedef std::vector<std::vector<float>> Coords;
+#define IO_HEIGHTFIELD2TEXTUREIN_TYPE HeightField2TextureIn_Template<HeightField,std::string,std::string,std::vector<std::uint32_t>,float,float,std::vector<std::vector<float>>>
 #define IO_HEIGHTFIELD2TEXTUREOUT_TYPE HeightField2TextureOut_Template<Texture,Coords>
 #include "heightfield2texture_io.hpp"
 #include "colormap.hpp"
+#include "heightfieldjson.hpp"
+#include "output.hpp"
+#include "numberformat.hpp"
 #include <iostream>
+#include <memory>
 #include <cmath>
 #include <fcntl.h>
 #include <unistd.h>
 
 
-static void texture(
-    io::HeightField2TextureOut& Out, io::HeightField2TextureIn& Val)
+// Writes the texture and then the coordinates a row at a time.
+static void write_texture(std::ostream& Out, HeightFieldRowReader& Rows,
+    io::HeightField2TextureIn& Val, float Min, float Max)
 {
-    std::vector<std::vector<float>> map = Val.colormap();
-    SortColorMap(map);
-    // Texture is a color map with each discontinuity mapped to a texel.
-    Out.texture.push_back(std::vector<std::vector<float>>());
-    Out.texture.back().reserve(map.size());
-    for (auto& limit : map) {
-        Out.texture.back().push_back(std::vector<float>(limit.size() - 1, 0.0f));
-        for (std::size_t k = 1; k < limit.size(); ++k)
-            Out.texture.back().back()[k - 1] = limit[k];
-    }
-}
-
-static void coordinates(
-    io::HeightField2TextureOut& Out, io::HeightField2TextureIn& Val)
-{
-    float min, max;
-    min = max = Val.heightfield()[0][0];
-    for (auto& line : Val.heightfield())
-        for (auto& value : line)
-            if (value < min)
-                min = value;
-            else if (max < value)
-                max = value;
-    const float range = (min < max) ? max - min : 1.0f;
-    std::vector<std::vector<float>> map = Val.colormap();
-    Out.coordinates.reserve(
-        Val.heightfield().size() * Val.heightfield().front().size());
-    for (auto& line : Val.heightfield())
-        for (auto& value : line) {
-            float v = (value - min) / range;
-            std::size_t idx = IndexInMap(v, map);
-            float s;
-            if (idx == 0 && v <= map.front().front())
-                s = 0.0f;
-            else if (idx == map.size() - 1)
-                s = 1.0f;
-            else // idx + relative location of v in range, mapped to [0, 1].
-                s = (idx
-                    + (v - map[idx].front())
-                        / (map[idx + 1].front() - map[idx].front()))
-                    / (map.size() - 1);
-            Out.coordinates.push_back(std::vector<float> { s, 0.5f });
-        }
+    const NumberFormat format;
+    const ColorMap map(Val.colormap());
+    Out << "{\"texture\":";
+    WriteTexture(Out, map, format);
+    Out << ",\"coordinates\":";
+    WriteCoordinates(Out, Rows, map, Min, Max, format);
+    Out << '}' << std::endl;
 }
 
 #if !defined(UNITTEST)
 
 static int texcoord(io::HeightField2TextureIn& Val) {
-    std::vector<char> output_buffer;
-    io::HeightField2TextureOut out;
-    texture(out, Val);
-    coordinates(out, Val);
-    Write(std::cout, out, output_buffer);
-    std::cout << std::endl;
+    try {
+        std::unique_ptr<HeightFieldRowReader> rows = HeightFieldRows(Val);
+        float min, max;
+        HeightFieldRange(Val, *rows, min, max);
+        write_texture(Output(), *rows, Val, min, max);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
     return 0;
 }
 
@@ -90,6 +67,8 @@ int main(int argc, char** argv) {
         f = open(argv[1], O_RDONLY);
     InputParser<io::ParserPool, io::HeightField2TextureIn_Parser,
         io::HeightField2TextureIn> ip(f);
+    ip.AddNumberArray<float>("heightfield", [](io::HeightField2TextureIn& Val)
+        -> HeightField& { return Val.heightfield(); });
     int status = ip.ReadAndParse(texcoord);
     if (f)
         close(f);
@@ -99,65 +78,82 @@ int main(int argc, char** argv) {
 #else
 
 TEST_CASE("texture") {
-    io::HeightField2TextureOut out;
     io::HeightField2TextureIn val;
-    SUBCASE("min < max") {
-        val.heightfield().resize(0);
-        val.colormap().resize(0);
-        out.texture.resize(0);
-        val.heightfield().push_back(std::vector<float> { -1.0f, 0.0f });
-        val.heightfield().push_back(std::vector<float> { 1.0f, 0.5f });
-        val.colormap().push_back(std::vector<float> { 0.0f, 0.0f, 0.0f, 0.0f });
+    std::ostringstream out;
+    SUBCASE("Sorted") {
         val.colormap().push_back(std::vector<float> { 1.0f, 1.0f, 0.5f, 0.0f });
-        texture(out, val);
-        REQUIRE(out.texture.size() == 1);
-        REQUIRE(out.texture.front().size() == val.colormap().size());
-        REQUIRE(out.texture[0][0].size() == val.colormap().front().size() - 1);
-        REQUIRE(out.texture[0][0] == std::vector<float> { 0.0f, 0.0f, 0.0f });
-        REQUIRE(out.texture[0][1] == std::vector<float> { 1.0f, 0.5f, 0.0f });
-    }
-    SUBCASE("min == max") {
-        val.heightfield().resize(0);
-        val.colormap().resize(0);
-        out.texture.resize(0);
-        val.heightfield().push_back(std::vector<float> { 1.0f, 1.0f });
-        val.heightfield().push_back(std::vector<float> { 1.0f, 1.0f });
         val.colormap().push_back(std::vector<float> { 0.0f, 0.0f, 0.0f, 0.0f });
-        val.colormap().push_back(std::vector<float> { 1.0f, 1.0f, 0.5f, 0.0f });
-        texture(out, val);
-        REQUIRE(out.texture[0][0] == std::vector<float> { 0.0f, 0.0f, 0.0f });
+        WriteTexture(out, ColorMap(val.colormap()), NumberFormat());
+        REQUIRE(out.str() == "[[[0,0,0],[1,0.5,0]]]");
+    }
+    SUBCASE("Single") {
+        val.colormap().push_back(std::vector<float> { 0.5f, 0.25f });
+        WriteTexture(out, ColorMap(val.colormap()), NumberFormat());
+        REQUIRE(out.str() == "[[[0.25]]]");
     }
 }
 
+static void coordinates(io::HeightField2TextureOut& Out,
+    io::HeightField2TextureIn& Val, float Min, float Max)
+{
+    const HeightField& hf(Val.heightfield());
+    const ColorMap map(Val.colormap());
+    std::vector<float> flat;
+    for (std::size_t y = 0; y < hf.Height(); ++y)
+        CoordinateRow(flat, hf.Row(y), hf.Width(), map,
+            Min, (Min < Max) ? Max - Min : 1.0f);
+    for (std::size_t k = 0; k < flat.size(); k += 2)
+        Out.coordinates.push_back(std::vector<float> { flat[k], flat[k + 1] });
+}
+
 TEST_CASE("coordinates") {
     io::HeightField2TextureOut out;
     io::HeightField2TextureIn val;
     SUBCASE("min < max") {
-        val.heightfield().resize(0);
+        val.heightfield().clear();
         val.colormap().resize(0);
         out.coordinates.resize(0);
         val.heightfield().push_back(std::vector<float> { -1.0f, 0.0f });
         val.heightfield().push_back(std::vector<float> { 1.0f, 0.5f });
         val.colormap().push_back(std::vector<float> { 0.0f, 0.0f, 0.0f, 0.0f });
         val.colormap().push_back(std::vector<float> { 1.0f, 1.0f, 0.5f, 0.0f });
-        coordinates(out, val);
-        REQUIRE(out.coordinates.size() == val.heightfield().size() * val.heightfield().front().size());
+        HeightFieldRowReader rows(val.heightfield(), {});
+        float min, max;
+        MinMax(rows, min, max);
+        coordinates(out, val, min, max);
+        REQUIRE(out.coordinates.size() == val.heightfield().Height() * val.heightfield().Width());
         for (std::size_t k = 0; k < out.coordinates.size(); ++k)
             REQUIRE(out.coordinates[k].size() == 2);
         REQUIRE(out.coordinates[0] == std::vector<float> { 0.0f, 0.5f });
         REQUIRE(out.coordinates[2] == std::vector<float> { 1.0f, 0.5f });
     }
     SUBCASE("min == max") {
-        val.heightfield().resize(0);
+        val.heightfield().clear();
         val.colormap().resize(0);
         out.coordinates.resize(0);
         val.heightfield().push_back(std::vector<float> { 1.0f, 1.0f });
         val.heightfield().push_back(std::vector<float> { 1.0f, 1.0f });
         val.colormap().push_back(std::vector<float> { 0.0f, 0.0f, 0.0f, 0.0f });
         val.colormap().push_back(std::vector<float> { 1.0f, 1.0f, 0.5f, 0.0f });
-        coordinates(out, val);
+        HeightFieldRowReader rows(val.heightfield(), {});
+        float min, max;
+        MinMax(rows, min, max);
+        coordinates(out, val, min, max);
         REQUIRE(out.coordinates[0] == std::vector<float> { 0.0f, 0.5f });
     }
 }
 
+TEST_CASE("write_texture") {
+    io::HeightField2TextureIn val;
+    val.heightfield().push_back(std::vector<float> { -1.0f, 0.0f });
+    val.heightfield().push_back(std::vector<float> { 1.0f, 0.5f });
+    val.colormap().push_back(std::vector<float> { 0.0f, 0.0f, 0.0f, 0.0f });
+    val.colormap().push_back(std::vector<float> { 1.0f, 1.0f, 0.5f, 0.0f });
+    HeightFieldRowReader rows(val.heightfield(), {});
+    std::ostringstream out;
+    write_texture(out, rows, val, -1.0f, 1.0f);
+    REQUIRE(out.str() == "{\"texture\":[[[0,0,0],[1,0.5,0]]],"
+        "\"coordinates\":[[0,0.5],[0.5,0.5],[1,0.5],[0.75,0.5]]}\n");
+}
+
 #endif
@@ -0,0 +1,337 @@
+//
+//  heightfieldcodec.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "heightfieldcodec.hpp"
+#include <cstring>
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <cmath>
+#endif
+
+
+Quantizer::Quantizer(std::int64_t Min, std::int64_t Max)
+    : low(Min)
+{
+    const std::uint64_t span = std::uint64_t(Max) - std::uint64_t(Min);
+    factor = (span != 0) ? 65535.0 / double(span) : 0.0;
+    step = double(span) / 65535.0;
+}
+
+static std::uint16_t quantize(float V, float Offset, float Inverse) {
+    float q = (V - Offset) * Inverse + 0.5f;
+    if (!(0.0f < q))
+        return 0;
+    return (q < 65535.0f) ? std::uint16_t(q) : std::uint16_t(65535);
+}
+
+void QuantizeRow(const float* In, std::size_t Count, double Offset,
+    double Scale, std::uint16_t* Out)
+{
+    const float offset = float(Offset);
+    const float inverse = (Scale > 0.0) ? float(1.0 / Scale) : 0.0f;
+    std::size_t k = 0;
+#if defined(__SSE2__)
+    // No unsigned saturating 32 to 16 bit pack in SSE2, so shift the range
+    // to signed, pack, and shift back.
+    const __m128 off = _mm_set1_ps(offset);
+    const __m128 inv = _mm_set1_ps(inverse);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 top = _mm_set1_ps(65535.0f);
+    const __m128i bias = _mm_set1_epi32(32768);
+    const __m128i flip = _mm_set1_epi16(-32768);
+    for (; k + 8 <= Count; k += 8) {
+        __m128 a = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(In + k), off),
+            inv), half);
+        __m128 b = _mm_add_ps(_mm_mul_ps(
+            _mm_sub_ps(_mm_loadu_ps(In + k + 4), off), inv), half);
+        a = _mm_min_ps(_mm_max_ps(a, zero), top);
+        b = _mm_min_ps(_mm_max_ps(b, zero), top);
+        __m128i qa = _mm_sub_epi32(_mm_cvttps_epi32(a), bias);
+        __m128i qb = _mm_sub_epi32(_mm_cvttps_epi32(b), bias);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(Out + k),
+            _mm_xor_si128(_mm_packs_epi32(qa, qb), flip));
+    }
+#endif
+    for (; k < Count; ++k)
+        Out[k] = quantize(In[k], offset, inverse);
+}
+
+void DequantizeRow(const std::uint16_t* In, std::size_t Count, double Offset,
+    double Scale, float* Out)
+{
+    std::size_t k = 0;
+#if defined(__SSE2__)
+    // Double precision so that the result equals Dequantize.
+    const __m128d off = _mm_set1_pd(Offset);
+    const __m128d scale = _mm_set1_pd(Scale);
+    const __m128i zero = _mm_setzero_si128();
+    for (; k + 8 <= Count; k += 8) {
+        __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(In + k));
+        __m128i lo = _mm_unpacklo_epi16(q, zero);
+        __m128i hi = _mm_unpackhi_epi16(q, zero);
+        __m128 a = _mm_movelh_ps(
+            _mm_cvtpd_ps(_mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(lo), scale), off)),
+            _mm_cvtpd_ps(_mm_add_pd(_mm_mul_pd(
+                _mm_cvtepi32_pd(_mm_srli_si128(lo, 8)), scale), off)));
+        __m128 b = _mm_movelh_ps(
+            _mm_cvtpd_ps(_mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(hi), scale), off)),
+            _mm_cvtpd_ps(_mm_add_pd(_mm_mul_pd(
+                _mm_cvtepi32_pd(_mm_srli_si128(hi, 8)), scale), off)));
+        _mm_storeu_ps(Out + k, a);
+        _mm_storeu_ps(Out + k + 4, b);
+    }
+#endif
+    for (; k < Count; ++k)
+        Out[k] = Dequantize(In[k], Offset, Scale);
+}
+
+// A block of coded differences is a byte that is 0 if all are zero. Otherwise
+// it is 1 and followed by a bitmap of non-zero values, 2-bit byte counts for
+// the non-zero values, and the values in as many little-endian bytes.
+
+static const std::size_t BitmapBytes = DeltaCoder::Block / 8;
+
+static int popcount(const unsigned char* Bitmap) {
+    int n = 0;
+    for (std::size_t k = 0; k < BitmapBytes; ++k)
+        for (unsigned char b = Bitmap[k]; b; b &= b - 1)
+            ++n;
+    return n;
+}
+
+static int byte_count(std::uint32_t V) {
+    return (V < 0x100u) ? 1 : (V < 0x10000u) ? 2 : (V < 0x1000000u) ? 3 : 4;
+}
+
+static void encode_block(const std::uint32_t* In, std::vector<char>& Out) {
+    unsigned char bitmap[BitmapBytes];
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (std::size_t k = 0; k < BitmapBytes; ++k) {
+        const __m128i* in = reinterpret_cast<const __m128i*>(In + 8 * k);
+        int zeros = _mm_movemask_ps(_mm_castsi128_ps(
+            _mm_cmpeq_epi32(_mm_loadu_si128(in), zero)));
+        zeros |= _mm_movemask_ps(_mm_castsi128_ps(
+            _mm_cmpeq_epi32(_mm_loadu_si128(in + 1), zero))) << 4;
+        bitmap[k] = static_cast<unsigned char>(~zeros);
+    }
+#else
+    for (std::size_t k = 0; k < BitmapBytes; ++k) {
+        bitmap[k] = 0;
+        for (int j = 0; j < 8; ++j)
+            if (In[8 * k + j])
+                bitmap[k] |= 1 << j;
+    }
+#endif
+    const int n = popcount(bitmap);
+    if (n == 0) {
+        Out.push_back(0);
+        return;
+    }
+    Out.push_back(1);
+    Out.insert(Out.end(), bitmap, bitmap + BitmapBytes);
+    std::size_t code = Out.size();
+    Out.resize(code + (n + 3) / 4, 0);
+    int index = 0;
+    for (std::size_t k = 0; k < BitmapBytes; ++k)
+        for (unsigned b = bitmap[k]; b; b &= b - 1, ++index) {
+            int j = 0;
+            while (!(b & (1u << j)))
+                ++j;
+            std::uint32_t v = In[8 * k + j];
+            const int bytes = byte_count(v);
+            Out[code + index / 4] |= char((bytes - 1) << (2 * (index % 4)));
+            for (int m = 0; m < bytes; ++m, v >>= 8)
+                Out.push_back(static_cast<char>(v & 0xff));
+        }
+}
+
+static const char* decode_block(
+    const char* In, const char* End, std::uint32_t* Out)
+{
+    std::memset(Out, 0, DeltaCoder::Block * sizeof(std::uint32_t));
+    if (End <= In)
+        throw std::runtime_error("Encoded height field row is truncated.");
+    if (*In++ == 0)
+        return In;
+    if (End - In < std::ptrdiff_t(BitmapBytes))
+        throw std::runtime_error("Encoded height field row is truncated.");
+    const unsigned char* bitmap = reinterpret_cast<const unsigned char*>(In);
+    const int n = popcount(bitmap);
+    const unsigned char* code = bitmap + BitmapBytes;
+    In = reinterpret_cast<const char*>(code) + (n + 3) / 4;
+    if (End < In)
+        throw std::runtime_error("Encoded height field row is truncated.");
+    int index = 0;
+    for (std::size_t k = 0; k < BitmapBytes; ++k)
+        for (unsigned b = bitmap[k]; b; b &= b - 1, ++index) {
+            int j = 0;
+            while (!(b & (1u << j)))
+                ++j;
+            const int bytes = 1 + ((code[index / 4] >> (2 * (index % 4))) & 3);
+            if (End - In < bytes)
+                throw std::runtime_error(
+                    "Encoded height field row is truncated.");
+            std::uint32_t v = 0;
+            for (int m = bytes - 1; 0 <= m; --m)
+                v = (v << 8) | static_cast<unsigned char>(In[m]);
+            In += bytes;
+            Out[8 * k + j] = v;
+        }
+    return In;
+}
+
+DeltaCoder::DeltaCoder(std::size_t Count)
+    : count(Count),
+    previous(((Count + Block - 1) / Block) * Block, 0x80000000u),
+    work(previous.size(), 0)
+{ }
+
+// Float bits are mapped so that integer order matches value order, then
+// differences to the row above are zigzag coded so that small negative and
+// positive differences both become small. Height changes come from circles
+// so most differences are zero.
+
+void DeltaCoder::Encode(const float* Row, std::vector<char>& Out) {
+    // Zero padding maps to the same value as in previous, so it codes as 0.
+    std::memcpy(work.data(), Row, count * sizeof(float));
+    std::memset(work.data() + count, 0,
+        (work.size() - count) * sizeof(std::uint32_t));
+    std::size_t k = 0;
+#if defined(__SSE2__)
+    const __m128i top = _mm_set1_epi32(int(0x80000000u));
+    for (; k < work.size(); k += 4) {
+        __m128i* w = reinterpret_cast<__m128i*>(work.data() + k);
+        __m128i* p = reinterpret_cast<__m128i*>(previous.data() + k);
+        __m128i bits = _mm_loadu_si128(w);
+        __m128i ordered = _mm_xor_si128(bits,
+            _mm_or_si128(_mm_srai_epi32(bits, 31), top));
+        __m128i d = _mm_sub_epi32(ordered, _mm_loadu_si128(p));
+        _mm_storeu_si128(p, ordered);
+        _mm_storeu_si128(w, _mm_xor_si128(_mm_slli_epi32(d, 1),
+            _mm_srai_epi32(d, 31)));
+    }
+#else
+    for (; k < work.size(); ++k) {
+        const std::uint32_t bits = work[k];
+        const std::uint32_t ordered =
+            (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+        const std::uint32_t d = ordered - previous[k];
+        previous[k] = ordered;
+        work[k] = (d << 1) ^ ((d & 0x80000000u) ? ~0u : 0u);
+    }
+#endif
+    for (std::size_t b = 0; b < work.size(); b += Block)
+        encode_block(work.data() + b, Out);
+}
+
+const char* DeltaCoder::Decode(const char* In, const char* End, float* Row) {
+    for (std::size_t b = 0; b < work.size(); b += Block)
+        In = decode_block(In, End, work.data() + b);
+    std::size_t k = 0;
+#if defined(__SSE2__)
+    const __m128i top = _mm_set1_epi32(int(0x80000000u));
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i ones = _mm_set1_epi32(-1);
+    for (; k < work.size(); k += 4) {
+        __m128i* w = reinterpret_cast<__m128i*>(work.data() + k);
+        __m128i* p = reinterpret_cast<__m128i*>(previous.data() + k);
+        __m128i z = _mm_loadu_si128(w);
+        __m128i d = _mm_xor_si128(_mm_srli_epi32(z, 1),
+            _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(z, one)));
+        __m128i ordered = _mm_add_epi32(_mm_loadu_si128(p), d);
+        _mm_storeu_si128(p, ordered);
+        _mm_storeu_si128(w, _mm_xor_si128(ordered, _mm_or_si128(
+            _mm_xor_si128(_mm_srai_epi32(ordered, 31), ones), top)));
+    }
+#else
+    for (; k < work.size(); ++k) {
+        const std::uint32_t z = work[k];
+        const std::uint32_t ordered = previous[k] + ((z >> 1) ^ (0u - (z & 1)));
+        previous[k] = ordered;
+        work[k] = (ordered & 0x80000000u) ? (ordered & 0x7fffffffu) : ~ordered;
+    }
+#endif
+    std::memcpy(Row, work.data(), count * sizeof(float));
+    return In;
+}
+
+#if defined(UNITTEST)
+
+TEST_CASE("Quantizer") {
+    Quantizer q(-1000, 64535);
+    REQUIRE(q(-1000) == 0);
+    REQUIRE(q(64535) == 65535);
+    REQUIRE(q(0) == 1000);
+    REQUIRE(q.Step() == 1.0);
+    Quantizer flat(5, 5);
+    REQUIRE(flat(5) == 0);
+    REQUIRE(flat.Step() == 0.0);
+}
+
+TEST_CASE("QuantizeRow") {
+    std::vector<float> in;
+    for (int k = 0; k < 21; ++k)
+        in.push_back(-1.0f + 0.1f * float(k));
+    const double scale = 2.0 / 65535.0;
+    std::vector<std::uint16_t> q(in.size());
+    QuantizeRow(in.data(), in.size(), -1.0, scale, q.data());
+    REQUIRE(q.front() == 0);
+    REQUIRE(q.back() == 65535);
+    for (std::size_t k = 1; k < q.size(); ++k)
+        REQUIRE(q[k - 1] < q[k]);
+    std::vector<float> out(in.size());
+    DequantizeRow(q.data(), q.size(), -1.0, scale, out.data());
+    for (std::size_t k = 0; k < out.size(); ++k) {
+        REQUIRE(std::fabs(out[k] - in[k]) <= scale);
+        REQUIRE(out[k] == Dequantize(q[k], -1.0, scale));
+    }
+}
+
+TEST_CASE("DeltaCoder") {
+    const std::size_t width = 300;
+    std::vector<std::vector<float>> rows(3, std::vector<float>(width));
+    for (std::size_t k = 0; k < width; ++k) {
+        rows[0][k] = 0.001f * float(k);
+        rows[1][k] = -0.001f * float(k);
+        rows[2][k] = (k % 7) ? 1e30f : -0.0f;
+    }
+    std::vector<char> encoded;
+    DeltaCoder enc(width);
+    for (auto& row : rows)
+        enc.Encode(row.data(), encoded);
+    SUBCASE("Round trip") {
+        DeltaCoder dec(width);
+        const char* in = encoded.data();
+        const char* end = in + encoded.size();
+        std::vector<float> out(width);
+        for (auto& row : rows) {
+            in = dec.Decode(in, end, out.data());
+            REQUIRE(std::memcmp(out.data(), row.data(), width * 4) == 0);
+        }
+        REQUIRE(in == end);
+    }
+    SUBCASE("Same rows are small") {
+        std::vector<char> again;
+        enc.Encode(rows[2].data(), again);
+        REQUIRE(again.size() == 3);
+    }
+    SUBCASE("Truncated") {
+        DeltaCoder dec(width);
+        std::vector<float> out(width);
+        REQUIRE_THROWS(dec.Decode(encoded.data(), encoded.data() + 10,
+            out.data()));
+    }
+}
+
+#endif
@@ -0,0 +1,72 @@
+//
+//  heightfieldcodec.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(HEIGHTFIELDCODEC_HPP)
+#define HEIGHTFIELDCODEC_HPP
+
+// Row encodings for the binary height field file. Quantization to 16 bits
+// loses precision, delta coding does not.
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+// Maps fixed-point values in [Min, Max] to 16-bit codes without converting
+// them to float first.
+class Quantizer {
+private:
+    std::int64_t low;
+    double factor, step;
+
+public:
+    Quantizer(std::int64_t Min, std::int64_t Max);
+    // Fixed-point value of one code step.
+    double Step() const { return step; }
+
+    std::uint16_t operator()(std::int64_t V) const {
+        const double q =
+            double(std::uint64_t(V) - std::uint64_t(low)) * factor + 0.5;
+        return (q < 65535.0) ? std::uint16_t(q) : std::uint16_t(65535);
+    }
+};
+
+// Value of code Q is Offset + Q * Scale.
+inline float Dequantize(std::uint16_t Q, double Offset, double Scale) {
+    return float(Offset + double(Q) * Scale);
+}
+
+void QuantizeRow(const float* In, std::size_t Count, double Offset,
+    double Scale, std::uint16_t* Out);
+void DequantizeRow(const std::uint16_t* In, std::size_t Count, double Offset,
+    double Scale, float* Out);
+
+// Lossless coding of rows as differences to the row above. Differences are
+// stored in blocks of 128 values, with only the non-zero ones taking space.
+class DeltaCoder {
+private:
+    std::size_t count;
+    std::vector<std::uint32_t> previous, work;
+
+public:
+    static const std::size_t Block = 128;
+
+    DeltaCoder(std::size_t Count);
+    // Largest possible size of an encoded row of Count values.
+    static std::size_t MaxEncodedSize(std::size_t Count) {
+        return ((Count + Block - 1) / Block) *
+            (1 + Block / 8 + Block / 4 + 4 * Block);
+    }
+    // Appends encoded Row to Out.
+    void Encode(const float* Row, std::vector<char>& Out);
+    // Decodes a row from In to Row. Returns end of the encoded row. Throws
+    // if the row does not fit before End.
+    const char* Decode(const char* In, const char* End, float* Row);
+};
+
+#endif
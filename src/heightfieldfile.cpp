@@ -0,0 +1,1134 @@
+//
+//  heightfieldfile.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "heightfieldfile.hpp"
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <cstdio>
+#include <cmath>
+#endif
+
+
+static const char magic[4] = { 'T', 'H', 'F', '1' };
+static const char tiled_magic[4] = { 'T', 'H', 'T', '1' };
+
+static bool little_endian() {
+    const std::uint32_t one = 1;
+    return *reinterpret_cast<const unsigned char*>(&one) == 1;
+}
+
+static void put_u32(char* Out, std::uint32_t V) {
+    for (int k = 0; k < 4; ++k)
+        Out[k] = static_cast<char>((V >> (8 * k)) & 0xff);
+}
+
+static std::uint32_t get_u32(const char* In) {
+    std::uint32_t v = 0;
+    for (int k = 3; 0 <= k; --k)
+        v = (v << 8) | static_cast<unsigned char>(In[k]);
+    return v;
+}
+
+static void put_f32(char* Out, float V) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &V, 4);
+    put_u32(Out, bits);
+}
+
+static float get_f32(const char* In) {
+    std::uint32_t bits = get_u32(In);
+    float v;
+    std::memcpy(&v, &bits, 4);
+    return v;
+}
+
+static void put_f64(char* Out, double V) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &V, 8);
+    put_u32(Out, std::uint32_t(bits));
+    put_u32(Out + 4, std::uint32_t(bits >> 32));
+}
+
+static double get_f64(const char* In) {
+    std::uint64_t bits =
+        (std::uint64_t(get_u32(In + 4)) << 32) | std::uint64_t(get_u32(In));
+    double v;
+    std::memcpy(&v, &bits, 8);
+    return v;
+}
+
+HeightFieldDataType HeightFieldEncoding(const std::string& Name) {
+    if (Name == "float32")
+        return HeightFieldFloat32;
+    if (Name == "uint16")
+        return HeightFieldUInt16;
+    if (Name == "delta")
+        return HeightFieldDelta;
+    throw std::runtime_error("Unknown height field encoding: " + Name);
+}
+
+const char* HeightFieldEncodingName(HeightFieldDataType Type) {
+    switch (Type) {
+    case HeightFieldFloat32: return "float32";
+    case HeightFieldUInt16: return "uint16";
+    case HeightFieldDelta: return "delta";
+    }
+    return "unknown";
+}
+
+HeightFieldHeader::HeightFieldHeader()
+    : width(0), height(0), type(HeightFieldFloat32), flags(0), min(0.0f),
+    max(0.0f), origin_x(0), origin_y(0), offset(0.0), scale(0.0), readers(0)
+{ }
+
+// Fields common to tiled and untiled files.
+static void encode_common(const HeightFieldHeader& H, const char* Magic,
+    char* Out)
+{
+    std::memset(Out, 0, HeightFieldHeader::Size);
+    std::memcpy(Out, Magic, 4);
+    put_u32(Out + 4, H.width);
+    put_u32(Out + 8, H.height);
+    put_u32(Out + 12, H.type);
+    put_u32(Out + 16, H.flags);
+    put_f32(Out + 20, H.min);
+    put_f32(Out + 24, H.max);
+    put_u32(Out + 28, H.origin_x);
+    put_u32(Out + 32, H.origin_y);
+}
+
+static void decode_common(HeightFieldHeader& H, const char* Magic,
+    const char* In, std::size_t Length)
+{
+    if (Length < HeightFieldHeader::Size || std::memcmp(In, Magic, 4) != 0)
+        throw std::runtime_error("Not a height field file.");
+    H.width = get_u32(In + 4);
+    H.height = get_u32(In + 8);
+    H.type = get_u32(In + 12);
+    H.flags = get_u32(In + 16);
+    H.min = get_f32(In + 20);
+    H.max = get_f32(In + 24);
+    H.origin_x = get_u32(In + 28);
+    H.origin_y = get_u32(In + 32);
+    if (H.type != HeightFieldFloat32 && H.type != HeightFieldUInt16 &&
+        H.type != HeightFieldDelta)
+        throw std::runtime_error("Unknown height field data type.");
+}
+
+void HeightFieldHeader::Encode(char* Out) const {
+    encode_common(*this, magic, Out);
+    put_f64(Out + 40, offset);
+    put_f64(Out + 48, scale);
+    std::memcpy(Out + 56, &readers, 4);
+}
+
+void HeightFieldHeader::Decode(const char* In, std::size_t Length) {
+    decode_common(*this, magic, In, Length);
+    offset = get_f64(In + 40);
+    scale = get_f64(In + 48);
+    std::memcpy(&readers, In + 56, 4);
+}
+
+static int create(const std::string& Path) {
+    int fd = open(Path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        throw std::runtime_error("Failed to create " + Path);
+    return fd;
+}
+
+HeightFieldFileWriter::HeightFieldFileWriter(const std::string& Path,
+    std::uint32_t Width, std::uint32_t Height, HeightFieldDataType Type)
+    : fd(create(Path)), rows(0), size(0), capacity(0), map(nullptr),
+    buffer(1 << 20)
+{
+    start(Width, Height, Type);
+}
+
+HeightFieldFileWriter::HeightFieldFileWriter(int Fd,
+    std::uint32_t Width, std::uint32_t Height, HeightFieldDataType Type)
+    : fd(Fd), rows(0), size(0), capacity(0), map(nullptr), buffer(1 << 20)
+{
+    try {
+        start(Width, Height, Type);
+        const std::uint64_t row = (Type == HeightFieldDelta) ?
+            DeltaCoder::MaxEncodedSize(Width) :
+            ((Type == HeightFieldUInt16) ? 2 : 4) * std::uint64_t(Width);
+        capacity = HeightFieldHeader::Size + row * Height;
+        if (ftruncate(fd, off_t(capacity)) != 0)
+            throw std::runtime_error("Failed to size shared memory.");
+        void* m = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0);
+        if (m == MAP_FAILED)
+            throw std::runtime_error("Failed to map shared memory.");
+        map = static_cast<char*>(m);
+    }
+    catch (...) {
+        close(fd);
+        throw;
+    }
+}
+
+void HeightFieldFileWriter::start(std::uint32_t Width, std::uint32_t Height,
+    HeightFieldDataType Type)
+{
+    header.width = Width;
+    header.height = Height;
+    header.type = Type;
+    if (Type == HeightFieldDelta)
+        delta.reset(new DeltaCoder(Width));
+    buffer.resize(HeightFieldHeader::Size);
+    header.Encode(buffer.data());
+}
+
+HeightFieldFileWriter::~HeightFieldFileWriter() {
+    if (map != nullptr)
+        munmap(map, capacity);
+    close(fd);
+}
+
+static void write_all(int fd, const char* Data, std::size_t Length) {
+    while (Length) {
+        ssize_t n = ::write(fd, Data, Length);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            throw std::runtime_error("Failed to write height field file.");
+        }
+        Data += n;
+        Length -= n;
+    }
+}
+
+static void pread_all(int fd, char* Data, std::size_t Length, off_t Offset) {
+    while (Length) {
+        ssize_t n = pread(fd, Data, Length, Offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            throw std::runtime_error("Failed to read height field file.");
+        Data += n;
+        Length -= n;
+        Offset += n;
+    }
+}
+
+void HeightFieldFileWriter::write(const char* Data, std::size_t Length) {
+    if (map != nullptr) {
+        if (capacity - size < Length)
+            throw std::runtime_error("Height field exceeds shared memory.");
+        std::memcpy(map + size, Data, Length);
+    } else
+        write_all(fd, Data, Length);
+    size += Length;
+}
+
+void HeightFieldFileWriter::SetOrigin(std::uint32_t X, std::uint32_t Y) {
+    header.flags |= HeightFieldHasOrigin;
+    header.origin_x = X;
+    header.origin_y = Y;
+}
+
+void HeightFieldFileWriter::SetReaders(std::uint32_t Count) {
+    header.readers = Count;
+    if (rows == 0)
+        header.Encode(buffer.data());
+}
+
+void HeightFieldFileWriter::flush() {
+    if (buffer.size() >= (1 << 20)) {
+        write(buffer.data(), buffer.size());
+        buffer.resize(0);
+    }
+}
+
+void HeightFieldFileWriter::SetQuantization(double Offset, double Scale) {
+    header.offset = Offset;
+    header.scale = Scale;
+    // The range is what the codes decode to.
+    header.min = Dequantize(0, Offset, Scale);
+    header.max = Dequantize(65535, Offset, Scale);
+    header.flags |= HeightFieldHasRange;
+    if (rows == 0)
+        header.Encode(buffer.data());
+}
+
+void HeightFieldFileWriter::WriteRow(const std::uint16_t* Codes) {
+    if (header.type != HeightFieldUInt16)
+        throw std::runtime_error("Height field file is not uint16.");
+    const std::size_t start = buffer.size();
+    buffer.resize(start + 2 * header.width);
+    char* out = buffer.data() + start;
+    if (little_endian())
+        std::memcpy(out, Codes, 2 * header.width);
+    else
+        for (std::uint32_t x = 0; x < header.width; ++x) {
+            out[2 * x] = static_cast<char>(Codes[x] & 0xff);
+            out[2 * x + 1] = static_cast<char>(Codes[x] >> 8);
+        }
+    flush();
+    ++rows;
+}
+
+void HeightFieldFileWriter::WriteRow(const float* Row) {
+    if (header.width == 0) {
+        ++rows;
+        return;
+    }
+    if (header.type == HeightFieldUInt16) {
+        if (!(header.flags & HeightFieldHasRange))
+            throw std::runtime_error("Quantization not set.");
+        codes.resize(header.width);
+        QuantizeRow(Row, header.width, header.offset, header.scale,
+            codes.data());
+        WriteRow(codes.data());
+        return;
+    }
+    if (!(header.flags & HeightFieldHasRange)) {
+        header.min = header.max = Row[0];
+        header.flags |= HeightFieldHasRange;
+    }
+    const std::size_t start = buffer.size();
+    buffer.resize(start + 4 * header.width);
+    char* out = buffer.data() + start;
+    for (std::uint32_t x = 0; x < header.width; ++x) {
+        if (Row[x] < header.min)
+            header.min = Row[x];
+        else if (header.max < Row[x])
+            header.max = Row[x];
+    }
+    if (delta) {
+        buffer.resize(start);
+        delta->Encode(Row, buffer);
+    } else if (little_endian())
+        std::memcpy(out, Row, 4 * header.width);
+    else
+        for (std::uint32_t x = 0; x < header.width; ++x)
+            put_f32(out + 4 * x, Row[x]);
+    flush();
+    ++rows;
+}
+
+void HeightFieldFileWriter::Finish() {
+    if (rows != header.height)
+        throw std::runtime_error("Height field file row count mismatch.");
+    write(buffer.data(), buffer.size());
+    buffer.resize(0);
+    char head[HeightFieldHeader::Size];
+    header.Encode(head);
+    if (map != nullptr) {
+        std::memcpy(map, head, sizeof(head));
+        munmap(map, capacity);
+        map = nullptr;
+        // Delta encoding used less than the room for the largest rows. Some
+        // systems size shared memory only once, and keep the room then.
+        if (size < capacity && ftruncate(fd, off_t(size)) == 0)
+            capacity = size;
+        return;
+    }
+    // Without the range at the start, readers find the range themselves.
+    if (pwrite(fd, head, sizeof(head), 0) != sizeof(head) && errno != ESPIPE)
+        throw std::runtime_error("Failed to write height field file.");
+}
+
+std::string SharedMemoryName(const std::string& Name) {
+    if (!Name.empty() && Name[0] == '/')
+        return Name;
+    return "/" + Name;
+}
+
+int CreateSharedMemory(const std::string& Name) {
+    int fd = shm_open(SharedMemoryName(Name).c_str(),
+        O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1)
+        throw std::runtime_error("Failed to create shared memory " + Name);
+    return fd;
+}
+
+void RemoveSharedMemory(const std::string& Name) {
+    shm_unlink(SharedMemoryName(Name).c_str());
+}
+
+// Returns true if this was the last reader.
+static bool count_reader(int fd) {
+    void* map = mmap(nullptr, HeightFieldHeader::Size, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        return false;
+    std::uint32_t* readers = reinterpret_cast<std::uint32_t*>(
+        static_cast<char*>(map) + 56);
+    std::uint32_t left = __atomic_load_n(readers, __ATOMIC_ACQUIRE);
+    while (left != 0 && !__atomic_compare_exchange_n(readers, &left, left - 1,
+        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    munmap(map, HeightFieldHeader::Size);
+    return left == 1;
+}
+
+static void tile_range(const HeightField& Band, std::uint32_t X,
+    std::uint32_t Width, std::uint32_t Height, float& Min, float& Max)
+{
+    Min = Max = Band.Row(0)[X];
+    for (std::uint32_t y = 0; y < Height; ++y) {
+        const float* row = Band.Row(y) + X;
+        for (std::uint32_t x = 0; x < Width; ++x) {
+            Min = (row[x] < Min) ? row[x] : Min;
+            Max = (Max < row[x]) ? row[x] : Max;
+        }
+    }
+}
+
+// Appends the tile of Width columns from X in the first Height rows of Band.
+static void encode_tile(const HeightField& Band, std::uint32_t X,
+    std::uint32_t Width, std::uint32_t Height, std::uint32_t Type,
+    float Min, float Max, std::vector<char>& Out,
+    std::vector<std::uint16_t>& Codes)
+{
+    if (Type == HeightFieldDelta) {
+        DeltaCoder coder(Width);
+        for (std::uint32_t y = 0; y < Height; ++y)
+            coder.Encode(Band.Row(y) + X, Out);
+        return;
+    }
+    std::size_t start = Out.size();
+    if (Type == HeightFieldUInt16) {
+        const double offset = Min;
+        const double scale = (double(Max) - double(Min)) / 65535.0;
+        Out.resize(start + 16 + 2 * std::size_t(Width) * Height);
+        put_f64(Out.data() + start, offset);
+        put_f64(Out.data() + start + 8, scale);
+        start += 16;
+        Codes.resize(Width);
+        for (std::uint32_t y = 0; y < Height; ++y) {
+            QuantizeRow(Band.Row(y) + X, Width, offset, scale, Codes.data());
+            char* out = Out.data() + start + 2 * std::size_t(y) * Width;
+            for (std::uint32_t x = 0; x < Width; ++x) {
+                out[2 * x] = static_cast<char>(Codes[x] & 0xff);
+                out[2 * x + 1] = static_cast<char>(Codes[x] >> 8);
+            }
+        }
+        return;
+    }
+    Out.resize(start + 4 * std::size_t(Width) * Height);
+    for (std::uint32_t y = 0; y < Height; ++y) {
+        char* out = Out.data() + start + 4 * std::size_t(y) * Width;
+        if (little_endian())
+            std::memcpy(out, Band.Row(y) + X, 4 * Width);
+        else
+            for (std::uint32_t x = 0; x < Width; ++x)
+                put_f32(out + 4 * x, Band.Row(y)[X + x]);
+    }
+}
+
+// Decodes a tile to Out that has the size of the tile.
+static void decode_tile(const char* In, std::size_t Length, std::uint32_t Type,
+    HeightField& Out)
+{
+    const std::size_t width = Out.Width();
+    const std::size_t count = width * Out.Height();
+    if (Type == HeightFieldDelta) {
+        const char* end = In + Length;
+        DeltaCoder coder(width);
+        for (std::size_t y = 0; y < Out.Height(); ++y)
+            In = coder.Decode(In, end, Out.Row(y));
+        if (In != end)
+            throw std::runtime_error("Height field tile size mismatch.");
+        return;
+    }
+    if (Type == HeightFieldUInt16) {
+        if (Length != 16 + 2 * count)
+            throw std::runtime_error("Height field tile size mismatch.");
+        const double offset = get_f64(In);
+        const double scale = get_f64(In + 8);
+        std::vector<std::uint16_t> codes(width);
+        for (std::size_t y = 0; y < Out.Height(); ++y) {
+            const char* row = In + 16 + 2 * y * width;
+            for (std::size_t x = 0; x < width; ++x)
+                codes[x] = std::uint16_t(static_cast<unsigned char>(row[2 * x]) |
+                    (static_cast<unsigned char>(row[2 * x + 1]) << 8));
+            DequantizeRow(codes.data(), width, offset, scale, Out.Row(y));
+        }
+        return;
+    }
+    if (Length != 4 * count)
+        throw std::runtime_error("Height field tile size mismatch.");
+    for (std::size_t y = 0; y < Out.Height(); ++y) {
+        const char* row = In + 4 * y * width;
+        if (little_endian())
+            std::memcpy(Out.Row(y), row, 4 * width);
+        else
+            for (std::size_t x = 0; x < width; ++x)
+                Out.Row(y)[x] = get_f32(row + 4 * x);
+    }
+}
+
+static std::uint32_t tile_count(std::uint32_t Size, std::uint32_t TileSize) {
+    if (TileSize == 0)
+        throw std::runtime_error("Tile size must be positive.");
+    return std::uint32_t((std::uint64_t(Size) + TileSize - 1) / TileSize);
+}
+
+TiledHeightFieldWriter::TiledHeightFieldWriter(const std::string& Path,
+    std::uint32_t Width, std::uint32_t Height, std::uint32_t TileSize,
+    HeightFieldDataType Type)
+    : fd(-1), tile_size(TileSize), tiles_x(tile_count(Width, TileSize)),
+    tiles_y(tile_count(Height, TileSize)), rows(0),
+    index(std::size_t(tiles_x) * tiles_y),
+    band(Width, std::min(TileSize, Height)),
+    offset(HeightFieldHeader::Size + HeightFieldTile::Size * index.size())
+{
+    header.width = Width;
+    header.height = Height;
+    header.type = Type;
+    fd = create(Path);
+    // Header and index are written at the end. Tiles follow them.
+    buffer.resize(offset, 0);
+    write_all(fd, buffer.data(), buffer.size());
+}
+
+TiledHeightFieldWriter::~TiledHeightFieldWriter() {
+    if (fd != -1)
+        close(fd);
+}
+
+void TiledHeightFieldWriter::SetOrigin(std::uint32_t X, std::uint32_t Y) {
+    header.flags |= HeightFieldHasOrigin;
+    header.origin_x = X;
+    header.origin_y = Y;
+}
+
+void TiledHeightFieldWriter::WriteRow(const float* Row) {
+    if (header.width != 0)
+        std::memcpy(band.Row(rows % tile_size), Row, 4 * header.width);
+    ++rows;
+    if (header.width != 0 && (rows % tile_size == 0 || rows == header.height))
+        write_band();
+}
+
+void TiledHeightFieldWriter::write_band() {
+    const std::uint32_t ty = (rows - 1) / tile_size;
+    const std::uint32_t height = rows - ty * tile_size;
+    for (std::uint32_t tx = 0; tx < tiles_x; ++tx) {
+        const std::uint32_t x = tx * tile_size;
+        const std::uint32_t width = std::min(tile_size, header.width - x);
+        HeightFieldTile& tile(index[std::size_t(ty) * tiles_x + tx]);
+        tile_range(band, x, width, height, tile.min, tile.max);
+        if (!(header.flags & HeightFieldHasRange)) {
+            header.min = tile.min;
+            header.max = tile.max;
+            header.flags |= HeightFieldHasRange;
+        }
+        header.min = std::min(header.min, tile.min);
+        header.max = std::max(header.max, tile.max);
+        buffer.resize(0);
+        encode_tile(band, x, width, height, header.type, tile.min, tile.max,
+            buffer, codes);
+        write_all(fd, buffer.data(), buffer.size());
+        tile.offset = offset;
+        tile.bytes = std::uint32_t(buffer.size());
+        offset += buffer.size();
+    }
+}
+
+void TiledHeightFieldWriter::Finish() {
+    if (rows != header.height)
+        throw std::runtime_error("Height field file row count mismatch.");
+    buffer.resize(HeightFieldHeader::Size + HeightFieldTile::Size * index.size());
+    encode_common(header, tiled_magic, buffer.data());
+    put_u32(buffer.data() + 40, tile_size);
+    put_u32(buffer.data() + 44, tiles_x);
+    put_u32(buffer.data() + 48, tiles_y);
+    char* entry = buffer.data() + HeightFieldHeader::Size;
+    for (auto& tile : index) {
+        std::memset(entry, 0, HeightFieldTile::Size);
+        put_u32(entry, std::uint32_t(tile.offset));
+        put_u32(entry + 4, std::uint32_t(tile.offset >> 32));
+        put_u32(entry + 8, tile.bytes);
+        put_f32(entry + 12, tile.min);
+        put_f32(entry + 16, tile.max);
+        entry += HeightFieldTile::Size;
+    }
+    if (pwrite(fd, buffer.data(), buffer.size(), 0) != ssize_t(buffer.size()))
+        throw std::runtime_error("Failed to write height field file.");
+}
+
+TiledHeightFieldFile::TiledHeightFieldFile(const std::string& Path)
+    : fd(open(Path.c_str(), O_RDONLY))
+{
+    if (fd == -1)
+        throw std::runtime_error("Failed to open " + Path);
+    try {
+        char head[HeightFieldHeader::Size];
+        pread_all(fd, head, sizeof(head), 0);
+        decode_common(header, tiled_magic, head, sizeof(head));
+        tile_size = get_u32(head + 40);
+        tiles_x = get_u32(head + 44);
+        tiles_y = get_u32(head + 48);
+        if (tiles_x != tile_count(header.width, tile_size) ||
+            tiles_y != tile_count(header.height, tile_size))
+            throw std::runtime_error("Tile counts do not match the size.");
+        index.resize(std::size_t(tiles_x) * tiles_y);
+        buffer.resize(HeightFieldTile::Size * index.size());
+        pread_all(fd, buffer.data(), buffer.size(), HeightFieldHeader::Size);
+        const char* entry = buffer.data();
+        for (auto& tile : index) {
+            tile.offset = (std::uint64_t(get_u32(entry + 4)) << 32) |
+                get_u32(entry);
+            tile.bytes = get_u32(entry + 8);
+            tile.min = get_f32(entry + 12);
+            tile.max = get_f32(entry + 16);
+            entry += HeightFieldTile::Size;
+        }
+    }
+    catch (...) {
+        close(fd);
+        throw;
+    }
+}
+
+TiledHeightFieldFile::~TiledHeightFieldFile() {
+    close(fd);
+}
+
+void TiledHeightFieldFile::ReadTile(
+    std::uint32_t X, std::uint32_t Y, HeightField& Out)
+{
+    if (tiles_x <= X || tiles_y <= Y)
+        throw std::runtime_error("Tile is outside the height field.");
+    const HeightFieldTile& tile(Tile(X, Y));
+    buffer.resize(tile.bytes);
+    pread_all(fd, buffer.data(), buffer.size(), off_t(tile.offset));
+    Out = HeightField(std::min(tile_size, header.width - X * tile_size),
+        std::min(tile_size, header.height - Y * tile_size));
+    decode_tile(buffer.data(), buffer.size(), header.type, Out);
+}
+
+static void check_window(std::uint64_t X, std::uint64_t Y, std::uint64_t Width,
+    std::uint64_t Height, std::uint64_t FieldWidth, std::uint64_t FieldHeight)
+{
+    if (Width == 0 || Height == 0 || FieldWidth < X + Width ||
+        FieldHeight < Y + Height)
+        throw std::runtime_error("Window is not inside the height field.");
+}
+
+HeightField TiledHeightFieldFile::ReadWindow(std::uint32_t X, std::uint32_t Y,
+    std::uint32_t Width, std::uint32_t Height)
+{
+    check_window(X, Y, Width, Height, header.width, header.height);
+    HeightField out(Width, Height), tile;
+    for (std::uint32_t ty = Y / tile_size; ty <= (Y + Height - 1) / tile_size;
+        ++ty)
+    {
+        const std::uint32_t y0 = std::max(Y, ty * tile_size);
+        const std::uint32_t y1 = std::min(Y + Height, (ty + 1) * tile_size);
+        for (std::uint32_t tx = X / tile_size;
+            tx <= (X + Width - 1) / tile_size; ++tx)
+        {
+            ReadTile(tx, ty, tile);
+            const std::uint32_t x0 = std::max(X, tx * tile_size);
+            const std::uint32_t x1 = std::min(X + Width, (tx + 1) * tile_size);
+            for (std::uint32_t y = y0; y < y1; ++y)
+                std::memcpy(out.Row(y - Y) + (x0 - X),
+                    tile.Row(y - ty * tile_size) + (x0 - tx * tile_size),
+                    4 * (x1 - x0));
+        }
+    }
+    return out;
+}
+
+bool IsTiledHeightField(const std::string& Path) {
+    int fd = open(Path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    char head[4];
+    bool tiled = pread(fd, head, 4, 0) == 4 &&
+        std::memcmp(head, tiled_magic, 4) == 0;
+    close(fd);
+    return tiled;
+}
+
+// Header of a window that is not all of the field.
+static void window_header(HeightFieldHeader& Header, std::uint32_t X,
+    std::uint32_t Y, std::uint32_t Width, std::uint32_t Height)
+{
+    Header.width = Width;
+    Header.height = Height;
+    Header.flags &= ~std::uint32_t(HeightFieldHasRange);
+    Header.flags |= HeightFieldHasOrigin;
+    Header.origin_x += X;
+    Header.origin_y += Y;
+}
+
+static bool whole(const std::vector<std::uint32_t>& Window,
+    std::size_t Width, std::size_t Height)
+{
+    if (Window.empty())
+        return true;
+    if (Window.size() != 4)
+        throw std::runtime_error("Window must be x, y, width, and height.");
+    check_window(Window[0], Window[1], Window[2], Window[3], Width, Height);
+    return Window[0] == 0 && Window[1] == 0 && Window[2] == Width &&
+        Window[3] == Height;
+}
+
+HeightFieldRowReader::HeightFieldRowReader(const HeightField& Field,
+    const std::vector<std::uint32_t>& Window)
+    : memory(&Field), map(nullptr), map_size(0), columns(Field.Width()),
+    x0(0), y0(0), width(Field.Width()), height(Field.Height()), next(0),
+    position(0), row_bytes(0), band_y(0)
+{
+    header.width = width;
+    header.height = height;
+    set_window(Window);
+}
+
+HeightFieldRowReader::HeightFieldRowReader(const std::string& Path,
+    const std::vector<std::uint32_t>& Window, bool Shared)
+    : memory(nullptr), map(nullptr), map_size(0), columns(0), x0(0), y0(0),
+    width(0), height(0), next(0), position(0), row_bytes(0), band_y(0)
+{
+    try {
+        if (Shared) {
+            const std::string name = SharedMemoryName(Path);
+            int shm = shm_open(name.c_str(), O_RDWR, 0);
+            if (shm == -1)
+                throw std::runtime_error(
+                    "Failed to open shared memory " + Path);
+            // Mapping keeps the memory after the name is gone.
+            if (count_reader(shm))
+                shm_unlink(name.c_str());
+            attach(shm, Path);
+        } else if (IsTiledHeightField(Path)) {
+            tiled.reset(new TiledHeightFieldFile(Path));
+            header = tiled->Header();
+            width = header.width;
+            height = header.height;
+        } else {
+            int file = open(Path.c_str(), O_RDONLY);
+            if (file == -1)
+                throw std::runtime_error("Failed to open " + Path);
+            attach(file, Path);
+        }
+        set_window(Window);
+        Rewind();
+    }
+    catch (...) {
+        if (map != nullptr)
+            munmap(map, map_size);
+        throw;
+    }
+}
+
+HeightFieldRowReader::~HeightFieldRowReader() {
+    if (map != nullptr)
+        munmap(map, map_size);
+}
+
+void HeightFieldRowReader::set_window(
+    const std::vector<std::uint32_t>& Window)
+{
+    if (whole(Window, width, height))
+        return;
+    x0 = Window[0];
+    y0 = Window[1];
+    width = Window[2];
+    height = Window[3];
+    window_header(header, x0, y0, width, height);
+}
+
+void HeightFieldRowReader::attach(int Fd, const std::string& Name) {
+    struct stat st;
+    void* mapped = MAP_FAILED;
+    if (fstat(Fd, &st) == 0 &&
+        HeightFieldHeader::Size <= std::uint64_t(st.st_size))
+        mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, Fd, 0);
+    close(Fd);
+    if (mapped == MAP_FAILED)
+        throw std::runtime_error("Failed to map " + Name);
+    map = static_cast<char*>(mapped);
+    map_size = st.st_size;
+    madvise(map, map_size, MADV_SEQUENTIAL);
+    header.Decode(map, map_size);
+    columns = width = header.width;
+    height = header.height;
+    switch (header.type) {
+    case HeightFieldDelta:
+        row_bytes = DeltaCoder::MaxEncodedSize(columns);
+        return;
+    case HeightFieldUInt16:
+        row_bytes = 2 * std::size_t(columns);
+        codes.resize(columns);
+        break;
+    default:
+        row_bytes = 4 * std::size_t(columns);
+        break;
+    }
+    if (map_size < HeightFieldHeader::Size + std::uint64_t(row_bytes) * height)
+        throw std::runtime_error("Height field file is truncated: " + Name);
+}
+
+void HeightFieldRowReader::Rewind() {
+    next = 0;
+    if (memory != nullptr)
+        return;
+    if (tiled) {
+        band = HeightField();
+        return;
+    }
+    position = HeightFieldHeader::Size;
+    if (header.type == HeightFieldDelta)
+        delta.reset(new DeltaCoder(columns));
+    else
+        position += row_bytes * y0;
+    row.resize(header.type == HeightFieldDelta ? columns : width);
+}
+
+const float* HeightFieldRowReader::file_row() {
+    const char* in = map + position;
+    if (header.type == HeightFieldDelta) {
+        position = delta->Decode(in, map + map_size, row.data()) - map;
+        return row.data() + x0;
+    }
+    position += row_bytes;
+    if (header.type == HeightFieldUInt16) {
+        in += 2 * std::size_t(x0);
+        for (std::uint32_t x = 0; x < width; ++x)
+            codes[x] = std::uint16_t(static_cast<unsigned char>(in[2 * x]) |
+                (static_cast<unsigned char>(in[2 * x + 1]) << 8));
+        DequantizeRow(codes.data(), width, header.offset, header.scale,
+            row.data());
+        return row.data();
+    }
+    in += 4 * std::size_t(x0);
+    // Header and rows keep the values 4-byte aligned in the mapping.
+    if (little_endian())
+        return reinterpret_cast<const float*>(in);
+    for (std::uint32_t x = 0; x < width; ++x)
+        row[x] = get_f32(in + 4 * x);
+    return row.data();
+}
+
+const float* HeightFieldRowReader::Next() {
+    if (next == height)
+        return nullptr;
+    const std::uint32_t y = y0 + next;
+    if (memory != nullptr) {
+        ++next;
+        return memory->Row(y) + x0;
+    }
+    if (tiled) {
+        if (band.Height() == 0 || band_y + band.Height() <= y) {
+            const std::uint32_t stop = std::min(y0 + height,
+                (y / tiled->TileSize() + 1) * tiled->TileSize());
+            band = tiled->ReadWindow(x0, y, width, stop - y);
+            band_y = y;
+        }
+        ++next;
+        return band.Row(y - band_y);
+    }
+    if (next == 0 && header.type == HeightFieldDelta)
+        for (std::uint32_t k = 0; k < y0; ++k)
+            file_row();
+    ++next;
+    return file_row();
+}
+
+void MinMax(HeightFieldRowReader& Rows, float& Min, float& Max) {
+    if (Rows.Header().flags & HeightFieldHasRange) {
+        Min = Rows.Header().min;
+        Max = Rows.Header().max;
+        return;
+    }
+    Min = Max = 0.0f;
+    bool first = true;
+    while (const float* row = Rows.Next()) {
+        if (first && Rows.Width())
+            Min = Max = row[0];
+        first = false;
+        MinMax(row, Rows.Width(), Min, Max);
+    }
+    Rows.Rewind();
+}
+
+#if defined(UNITTEST)
+
+TEST_CASE("HeightFieldFile") {
+    char name[] = "/tmp/heightfieldfileXXXXXX";
+    int fd = mkstemp(name);
+    REQUIRE(fd != -1);
+    close(fd);
+    SUBCASE("Round trip") {
+        {
+            HeightFieldFileWriter writer(name, 3, 2);
+            writer.SetOrigin(5, 7);
+            const float a[3] = { 1.0f, -2.0f, 3.0f };
+            const float b[3] = { 4.0f, 0.5f, 6.0f };
+            writer.WriteRow(a);
+            writer.WriteRow(b);
+            writer.Finish();
+        }
+        HeightFieldRowReader rows(name, {});
+        REQUIRE(rows.Width() == 3);
+        REQUIRE(rows.Height() == 2);
+        REQUIRE(rows.Header().origin_x == 5);
+        REQUIRE(rows.Header().origin_y == 7);
+        float min, max;
+        MinMax(rows, min, max);
+        REQUIRE(min == -2.0f);
+        REQUIRE(max == 6.0f);
+        const float* first = rows.Next();
+        const float* second = rows.Next();
+        REQUIRE(first[1] == -2.0f);
+        REQUIRE(second[1] == 0.5f);
+        // Rows are in the mapping one after another.
+        if (little_endian())
+            REQUIRE(second == first + 3);
+    }
+    SUBCASE("UInt16") {
+        {
+            HeightFieldFileWriter writer(name, 3, 2, HeightFieldUInt16);
+            writer.SetQuantization(-2.0, 8.0 / 65535.0);
+            const float a[3] = { 1.0f, -2.0f, 3.0f };
+            const float b[3] = { 4.0f, 0.5f, 6.0f };
+            writer.WriteRow(a);
+            writer.WriteRow(b);
+            writer.Finish();
+        }
+        HeightFieldRowReader rows(name, {});
+        REQUIRE(rows.Header().type == HeightFieldUInt16);
+        float min, max;
+        MinMax(rows, min, max);
+        REQUIRE(min == -2.0f);
+        REQUIRE(max == 6.0f);
+        REQUIRE(rows.Next()[1] == -2.0f);
+        const float* row = rows.Next();
+        REQUIRE(row[2] == 6.0f);
+        REQUIRE(std::fabs(row[1] - 0.5f) < 1e-4f);
+    }
+    SUBCASE("Delta") {
+        {
+            HeightFieldFileWriter writer(name, 3, 2, HeightFieldDelta);
+            const float a[3] = { 1.0f, -2.0f, 3.0f };
+            const float b[3] = { 4.0f, 0.5f, 6.0f };
+            writer.WriteRow(a);
+            writer.WriteRow(b);
+            writer.Finish();
+        }
+        HeightFieldRowReader rows(name, {});
+        REQUIRE(rows.Header().type == HeightFieldDelta);
+        REQUIRE(rows.Header().max == 6.0f);
+        REQUIRE(rows.Next()[1] == -2.0f);
+        REQUIRE(rows.Next()[1] == 0.5f);
+        REQUIRE(rows.Next() == nullptr);
+    }
+    SUBCASE("Shared memory") {
+        std::string shm(name + 4);
+        shm.back() = 'S';
+        {
+            HeightFieldFileWriter writer(CreateSharedMemory(shm), 3, 2);
+            writer.SetReaders(2);
+            const float a[3] = { 1.0f, -2.0f, 3.0f };
+            const float b[3] = { 4.0f, 0.5f, 6.0f };
+            writer.WriteRow(a);
+            writer.WriteRow(b);
+            writer.Finish();
+            REQUIRE(writer.Size() == HeightFieldHeader::Size + 24);
+        }
+        REQUIRE_THROWS(CreateSharedMemory(shm));
+        HeightFieldRowReader first(shm, {}, true);
+        REQUIRE(first.Header().readers == 1);
+        HeightFieldRowReader second(shm, {}, true);
+        REQUIRE(second.Header().readers == 0);
+        REQUIRE_THROWS(HeightFieldRowReader(shm, {}, true));
+        first.Next();
+        REQUIRE(first.Next()[1] == 0.5f);
+        const float* row = second.Next();
+        REQUIRE(row[2] == 3.0f);
+        if (little_endian())
+            REQUIRE(second.Next() == row + 3);
+    }
+    SUBCASE("Shared memory delta") {
+        std::string shm(name + 4);
+        shm.back() = 'D';
+        const std::uint32_t width = 300;
+        std::vector<float> row(width, 1.0f);
+        {
+            HeightFieldFileWriter writer(
+                CreateSharedMemory(shm), width, 2, HeightFieldDelta);
+            writer.SetReaders(1);
+            writer.WriteRow(row.data());
+            row[299] = 2.0f;
+            writer.WriteRow(row.data());
+            writer.Finish();
+            REQUIRE(writer.Size() < HeightFieldHeader::Size + 8 * width);
+        }
+        HeightFieldRowReader rows(shm, {}, true);
+        REQUIRE(rows.Next()[299] == 1.0f);
+        REQUIRE(rows.Next()[299] == 2.0f);
+        REQUIRE(rows.Next() == nullptr);
+        REQUIRE_THROWS(HeightFieldRowReader(shm, {}, true));
+    }
+    SUBCASE("Tiled") {
+        const std::uint32_t width = 10, height = 7;
+        std::vector<float> row(width);
+        for (std::uint32_t type = HeightFieldFloat32; type <= HeightFieldDelta;
+            ++type)
+        {
+            {
+                TiledHeightFieldWriter writer(name, width, height, 4,
+                    HeightFieldDataType(type));
+                for (std::uint32_t y = 0; y < height; ++y) {
+                    for (std::uint32_t x = 0; x < width; ++x)
+                        row[x] = float(y * width + x);
+                    writer.WriteRow(row.data());
+                }
+                writer.Finish();
+            }
+            REQUIRE(IsTiledHeightField(name));
+            TiledHeightFieldFile file(name);
+            REQUIRE(file.TilesX() == 3);
+            REQUIRE(file.TilesY() == 2);
+            REQUIRE(file.Tile(2, 1).min == 48.0f);
+            REQUIRE(file.Tile(2, 1).max == 69.0f);
+            HeightField tile;
+            file.ReadTile(2, 1, tile);
+            REQUIRE(tile.Width() == 2);
+            REQUIRE(tile.Height() == 3);
+            REQUIRE(std::fabs(tile.Row(1)[1] - 59.0f) < 1e-3f);
+            std::vector<std::uint32_t> window { 3, 2, 5, 4 };
+            HeightFieldRowReader part(name, window);
+            REQUIRE(part.Width() == 5);
+            REQUIRE(part.Header().origin_x == 3);
+            REQUIRE(!(part.Header().flags & HeightFieldHasRange));
+            for (std::uint32_t y = 0; y < 4; ++y) {
+                const float* values = part.Next();
+                for (std::uint32_t x = 0; x < 5; ++x)
+                    REQUIRE(std::fabs(values[x] -
+                        float((y + 2) * width + x + 3)) < 1e-3f);
+            }
+            HeightFieldRowReader all(name, {});
+            REQUIRE(all.Height() == height);
+            REQUIRE(all.Header().max == 69.0f);
+            window[2] = 8;
+            REQUIRE_THROWS(HeightFieldRowReader(name, window));
+        }
+    }
+    SUBCASE("Delta tile size") {
+        const float values[6] = { 1.0f, 2.0f, 4.0f, 3.0f, 5.0f, -1.0f };
+        DeltaCoder coder(3);
+        std::vector<char> tile;
+        coder.Encode(values, tile);
+        coder.Encode(values + 3, tile);
+        HeightField out(3, 2);
+        decode_tile(tile.data(), tile.size(), HeightFieldDelta, out);
+        REQUIRE(out.Row(1)[2] == -1.0f);
+        REQUIRE_THROWS(decode_tile(
+            tile.data(), tile.size() - 1, HeightFieldDelta, out));
+        tile.push_back(0);
+        REQUIRE_THROWS(decode_tile(
+            tile.data(), tile.size(), HeightFieldDelta, out));
+    }
+    SUBCASE("Window") {
+        HeightField hf;
+        hf.push_back(std::vector<float> { 1.0f, 2.0f, 3.0f });
+        hf.push_back(std::vector<float> { 4.0f, 5.0f, 6.0f });
+        HeightFieldRowReader all(hf, { 0, 0, 3, 2 });
+        REQUIRE(all.Width() == 3);
+        REQUIRE(all.Header().flags == 0);
+        HeightFieldRowReader part(hf, { 1, 1, 2, 1 });
+        REQUIRE(part.Width() == 2);
+        REQUIRE(part.Next()[0] == 5.0f);
+        REQUIRE(part.Header().flags == HeightFieldHasOrigin);
+        REQUIRE_THROWS(HeightFieldRowReader(hf, { 1 }));
+    }
+    SUBCASE("Row reader") {
+        const std::uint32_t width = 300, height = 5;
+        std::vector<float> values(width);
+        const std::vector<std::uint32_t> window { 131, 2, 150, 3 };
+        for (int type = HeightFieldFloat32; type <= HeightFieldDelta + 1;
+            ++type)
+        {
+            if (type <= HeightFieldDelta) {
+                HeightFieldFileWriter writer(name, width, height,
+                    HeightFieldDataType(type));
+                if (type == HeightFieldUInt16)
+                    writer.SetQuantization(0.0, 1.0);
+                for (std::uint32_t y = 0; y < height; ++y) {
+                    for (std::uint32_t x = 0; x < width; ++x)
+                        values[x] = float((y * 7 + x) % 97);
+                    writer.WriteRow(values.data());
+                }
+                writer.Finish();
+            } else {
+                TiledHeightFieldWriter writer(name, width, height, 64);
+                for (std::uint32_t y = 0; y < height; ++y) {
+                    for (std::uint32_t x = 0; x < width; ++x)
+                        values[x] = float((y * 7 + x) % 97);
+                    writer.WriteRow(values.data());
+                }
+                writer.Finish();
+            }
+            HeightFieldRowReader all(name, {});
+            float min, max;
+            MinMax(all, min, max);
+            REQUIRE(min == 0.0f);
+            REQUIRE(max == ((type == HeightFieldUInt16) ? 65535.0f : 96.0f));
+            HeightFieldRowReader rows(name, window);
+            REQUIRE(rows.Width() == 150);
+            REQUIRE(rows.Height() == 3);
+            REQUIRE(rows.Header().origin_x == 131);
+            for (int pass = 0; pass < 2; ++pass) {
+                for (std::uint32_t y = 2; y < 5; ++y) {
+                    const float* row = rows.Next();
+                    REQUIRE(row != nullptr);
+                    for (std::uint32_t x = 0; x < 150; ++x)
+                        REQUIRE(row[x] == float((y * 7 + x + 131) % 97));
+                }
+                REQUIRE(rows.Next() == nullptr);
+                rows.Rewind();
+            }
+        }
+        HeightField hf;
+        hf.push_back(std::vector<float> { 1.0f, 2.0f, 3.0f });
+        hf.push_back(std::vector<float> { 4.0f, 5.0f, 6.0f });
+        const std::vector<std::uint32_t> part { 1, 1, 2, 1 };
+        HeightFieldRowReader rows(hf, part);
+        float min, max;
+        MinMax(rows, min, max);
+        REQUIRE(min == 5.0f);
+        REQUIRE(max == 6.0f);
+        REQUIRE(rows.Next()[1] == 6.0f);
+        REQUIRE(rows.Next() == nullptr);
+    }
+    SUBCASE("Encoding names") {
+        REQUIRE(HeightFieldEncoding("delta") == HeightFieldDelta);
+        REQUIRE_THROWS(HeightFieldEncoding("png"));
+    }
+    SUBCASE("Missing rows") {
+        HeightFieldFileWriter writer(name, 3, 2);
+        const float a[3] = { 1.0f, -2.0f, 3.0f };
+        writer.WriteRow(a);
+        REQUIRE_THROWS(writer.Finish());
+    }
+    SUBCASE("Not a height field") {
+        FILE* f = std::fopen(name, "w");
+        std::fputs("{\"heightfield\":[[1]]}", f);
+        std::fclose(f);
+        REQUIRE_THROWS(HeightFieldRowReader(name, {}));
+    }
+    unlink(name);
+}
+
+#endif
@@ -0,0 +1,302 @@
+//
+//  heightfieldfile.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(HEIGHTFIELDFILE_HPP)
+#define HEIGHTFIELDFILE_HPP
+
+// Binary height field file. A 64-byte header is followed by the rows as
+// little-endian values. All header fields are little-endian too:
+//
+//   0  "THF1"
+//   4  uint32 width
+//   8  uint32 height
+//  12  uint32 data type, HeightFieldDataType
+//  16  uint32 flags, HeightFieldHasRange and HeightFieldHasOrigin
+//  20  float32 minimum
+//  24  float32 maximum
+//  28  uint32 origin x, left edge of a cropped area
+//  32  uint32 origin y, low edge of a cropped area
+//  36  zero
+//  40  float64 offset, value of uint16 code 0
+//  48  float64 scale, value difference of consecutive uint16 codes
+//  56  uint32 readers left, in host byte order, only in shared memory
+//  60  zero up to 64
+//
+// Rows of HeightFieldUInt16 are uint16 codes. Rows of HeightFieldDelta are
+// coded by DeltaCoder one after another.
+//
+// Tiled file has the same header with "THT1" and fields from 40 on being:
+//
+//  40  uint32 tile size
+//  44  uint32 tiles in x-direction
+//  48  uint32 tiles in y-direction
+//  52  zero up to 64
+//
+// Header is followed by an index entry for each tile, row of tiles after
+// another from y = 0, and then the tiles in the same order. Each entry is:
+//
+//   0  uint64 offset of tile from file start
+//   8  uint32 tile size in bytes
+//  12  float32 minimum in tile
+//  16  float32 maximum in tile
+//  20  zero up to 24
+//
+// Tiles at high x and y edges are cut to the field size. Each tile is rows
+// like in the untiled file but as wide as the tile. HeightFieldUInt16 tile
+// starts with float64 offset and scale for the tile.
+
+#include "heightfield.hpp"
+#include "heightfieldcodec.hpp"
+#include <string>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+enum HeightFieldDataType {
+    HeightFieldFloat32 = 1,
+    HeightFieldUInt16 = 2,
+    HeightFieldDelta = 3
+};
+
+// Type for encoding name float32, uint16, or delta. Throws if unknown.
+HeightFieldDataType HeightFieldEncoding(const std::string& Name);
+const char* HeightFieldEncodingName(HeightFieldDataType Type);
+
+enum HeightFieldFlags {
+    HeightFieldHasRange = 1,
+    HeightFieldHasOrigin = 2
+};
+
+struct HeightFieldHeader {
+    static const std::size_t Size = 64;
+    std::uint32_t width, height, type, flags;
+    float min, max;
+    std::uint32_t origin_x, origin_y;
+    double offset, scale;
+    std::uint32_t readers;
+
+    HeightFieldHeader();
+    void Encode(char* Out) const;
+    // Throws if the buffer does not hold a valid header.
+    void Decode(const char* In, std::size_t Length);
+};
+
+// Writes rows to a binary file as they come, and the range at the end.
+class HeightFieldFileWriter {
+private:
+    int fd;
+    HeightFieldHeader header;
+    std::uint32_t rows;
+    std::uint64_t size, capacity;
+    // Mapping of shared memory, which is not written to with write.
+    char* map;
+    std::vector<char> buffer;
+    std::vector<std::uint16_t> codes;
+    std::unique_ptr<DeltaCoder> delta;
+
+    void start(std::uint32_t Width, std::uint32_t Height,
+        HeightFieldDataType Type);
+    void write(const char* Data, std::size_t Length);
+    void flush();
+
+public:
+    // Throws if the file can not be created.
+    HeightFieldFileWriter(const std::string& Path, std::uint32_t Width,
+        std::uint32_t Height, HeightFieldDataType Type = HeightFieldFloat32);
+    // Writes to shared memory object Fd and closes it when done. The object
+    // is sized for the largest possible encoding once and mapped, as some
+    // systems do not allow resizing it or writing to it with write. Throws if
+    // it can not be sized or mapped.
+    HeightFieldFileWriter(int Fd, std::uint32_t Width, std::uint32_t Height,
+        HeightFieldDataType Type = HeightFieldFloat32);
+    ~HeightFieldFileWriter();
+    HeightFieldFileWriter(const HeightFieldFileWriter&) = delete;
+    HeightFieldFileWriter& operator=(const HeightFieldFileWriter&) = delete;
+
+    HeightFieldDataType Type() const { return HeightFieldDataType(header.type); }
+    // Bytes written so far, header included.
+    std::uint64_t Size() const { return size; }
+    void SetOrigin(std::uint32_t X, std::uint32_t Y);
+    // Number of shared memory readers after which the name is removed.
+    void SetReaders(std::uint32_t Count);
+    // Required for HeightFieldUInt16 before the rows.
+    void SetQuantization(double Offset, double Scale);
+    void WriteRow(const float* Row);
+    // Only for HeightFieldUInt16.
+    void WriteRow(const std::uint16_t* Codes);
+    // Writes the header with the range. Throws if not all rows were written.
+    void Finish();
+};
+
+// POSIX shared memory object name with the leading / added if missing.
+std::string SharedMemoryName(const std::string& Name);
+// Creates a new shared memory object for writing. Throws if it exists.
+int CreateSharedMemory(const std::string& Name);
+void RemoveSharedMemory(const std::string& Name);
+
+struct HeightFieldTile {
+    static const std::size_t Size = 24;
+    std::uint64_t offset;
+    std::uint32_t bytes;
+    float min, max;
+};
+
+// Writes rows in tiles. Holds one row of tiles at a time.
+class TiledHeightFieldWriter {
+private:
+    int fd;
+    HeightFieldHeader header;
+    std::uint32_t tile_size, tiles_x, tiles_y, rows;
+    std::vector<HeightFieldTile> index;
+    HeightField band;
+    std::vector<char> buffer;
+    std::vector<std::uint16_t> codes;
+    std::uint64_t offset;
+
+    void write_band();
+
+public:
+    // Throws if the file can not be created.
+    TiledHeightFieldWriter(const std::string& Path, std::uint32_t Width,
+        std::uint32_t Height, std::uint32_t TileSize,
+        HeightFieldDataType Type = HeightFieldFloat32);
+    ~TiledHeightFieldWriter();
+    TiledHeightFieldWriter(const TiledHeightFieldWriter&) = delete;
+    TiledHeightFieldWriter& operator=(const TiledHeightFieldWriter&) = delete;
+
+    void SetOrigin(std::uint32_t X, std::uint32_t Y);
+    void WriteRow(const float* Row);
+    // Writes header and index. Throws if not all rows were written.
+    void Finish();
+};
+
+// Reads tiles with pread, so a tile costs its own size in I/O.
+class TiledHeightFieldFile {
+private:
+    int fd;
+    HeightFieldHeader header;
+    std::uint32_t tile_size, tiles_x, tiles_y;
+    std::vector<HeightFieldTile> index;
+    std::vector<char> buffer;
+
+public:
+    // Throws if the file can not be read or is not a tiled height field.
+    TiledHeightFieldFile(const std::string& Path);
+    ~TiledHeightFieldFile();
+    TiledHeightFieldFile(const TiledHeightFieldFile&) = delete;
+    TiledHeightFieldFile& operator=(const TiledHeightFieldFile&) = delete;
+
+    const HeightFieldHeader& Header() const { return header; }
+    std::uint32_t TileSize() const { return tile_size; }
+    std::uint32_t TilesX() const { return tiles_x; }
+    std::uint32_t TilesY() const { return tiles_y; }
+    const HeightFieldTile& Tile(std::uint32_t X, std::uint32_t Y) const {
+        return index[Y * tiles_x + X];
+    }
+    // Reads tile at tile coordinates X, Y to Out.
+    void ReadTile(std::uint32_t X, std::uint32_t Y, HeightField& Out);
+    // Reads the area from the tiles that overlap it.
+    HeightField ReadWindow(std::uint32_t X, std::uint32_t Y,
+        std::uint32_t Width, std::uint32_t Height);
+};
+
+// True if the file starts like a tiled height field file.
+bool IsTiledHeightField(const std::string& Path);
+
+// Gives rows of a height field one at a time, cut to a window of x, y,
+// width, and height if one is given. Files and shared memory are mapped
+// read-only and float32 rows are given in place. Encoded rows are decoded a
+// row at a time, and a tiled file is read a row of tiles at a time, so memory
+// use does not depend on the height.
+class HeightFieldRowReader {
+private:
+    const HeightField* memory;
+    char* map;
+    std::size_t map_size;
+    HeightFieldHeader header;
+    std::uint32_t columns, x0, y0, width, height, next;
+    std::size_t position, row_bytes;
+    std::vector<std::uint16_t> codes;
+    std::vector<float> row;
+    std::unique_ptr<DeltaCoder> delta;
+    std::unique_ptr<TiledHeightFieldFile> tiled;
+    HeightField band;
+    std::uint32_t band_y;
+
+    void set_window(const std::vector<std::uint32_t>& Window);
+    void attach(int Fd, const std::string& Name);
+    const float* file_row();
+
+public:
+    // Rows of Field, which must stay around while rows are read.
+    HeightFieldRowReader(const HeightField& Field,
+        const std::vector<std::uint32_t>& Window);
+    // Rows of a tiled or untiled file, or of shared memory if Shared. Counts
+    // down the readers left in shared memory and removes the name when the
+    // count reaches zero. The mapping keeps the memory after that. Throws if
+    // the file can not be read or is not a height field file.
+    HeightFieldRowReader(const std::string& Path,
+        const std::vector<std::uint32_t>& Window, bool Shared = false);
+    ~HeightFieldRowReader();
+    HeightFieldRowReader(const HeightFieldRowReader&) = delete;
+    HeightFieldRowReader& operator=(const HeightFieldRowReader&) = delete;
+
+    // Header with the window size, origin moved by the window, and no range
+    // if the window is not all of the field.
+    const HeightFieldHeader& Header() const { return header; }
+    std::uint32_t Width() const { return width; }
+    std::uint32_t Height() const { return height; }
+    // Next row, or nullptr after the last row. Valid until the next call.
+    // Throws if the file is truncated.
+    const float* Next();
+    // Starts again from the first row.
+    void Rewind();
+};
+
+// Range from the header when present, otherwise from the rows, after which
+// Rows is rewound. Zero range for a field without rows.
+void MinMax(HeightFieldRowReader& Rows, float& Min, float& Max);
+
+// Row reader for heightfield_shm, heightfield_file, or the inline height
+// field, in that order, cut to heightfield_window if given.
+template<typename Request>
+std::unique_ptr<HeightFieldRowReader> HeightFieldRows(Request& Val) {
+    static const std::vector<std::uint32_t> all;
+    const std::vector<std::uint32_t>& window =
+        Val.heightfield_windowGiven() ? Val.heightfield_window() : all;
+    if (Val.heightfield_shmGiven())
+        return std::unique_ptr<HeightFieldRowReader>(
+            new HeightFieldRowReader(Val.heightfield_shm(), window, true));
+    if (Val.heightfield_fileGiven())
+        return std::unique_ptr<HeightFieldRowReader>(
+            new HeightFieldRowReader(Val.heightfield_file(), window));
+    if (!Val.heightfieldGiven())
+        throw std::runtime_error(
+            "None of heightfield, heightfield_file, heightfield_shm.");
+    return std::unique_ptr<HeightFieldRowReader>(
+        new HeightFieldRowReader(Val.heightfield(), window));
+}
+
+// Range from heightfield_min and heightfield_max in the request when given.
+// Otherwise as MinMax for Rows.
+template<typename Request>
+void HeightFieldRange(Request& Val, HeightFieldRowReader& Rows,
+    float& Min, float& Max)
+{
+    if (!Val.heightfield_minGiven() || !Val.heightfield_maxGiven())
+        MinMax(Rows, Min, Max);
+    if (Val.heightfield_minGiven())
+        Min = Val.heightfield_min();
+    if (Val.heightfield_maxGiven())
+        Max = Val.heightfield_max();
+}
+
+#endif
@@ -0,0 +1,156 @@
+//
+//  heightfieldfilter.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if defined(UNITTEST)
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#else
+#include "convenience.hpp"
+#endif
+#include "heightfieldfile.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <memory>
+#define IO_HEIGHTFIELDFILTERIN_TYPE HeightFieldFilterIn_Template<HeightField,std::string,std::string,std::vector<std::uint32_t>,std::string,std::uint32_t,bool,std::uint32_t,std::string,std::string,std::uint32_t,std::string>
+#include "heightfieldfilter_io.hpp"
+#include "filter.hpp"
+#include "rowwriter.hpp"
+#include "threadpool.hpp"
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+// Filters Rows to Out, keeping the origin of a cropped input.
+static void filter_rows(HeightFieldRowReader& Rows, const FilterSpec& Spec,
+    ThreadPool& Pool, RowWriter& Out)
+{
+    const HeightFieldHeader& header(Rows.Header());
+    const bool origin = header.flags & HeightFieldHasOrigin;
+    Out.Begin(Rows.Width(), Rows.Height(),
+        origin ? header.origin_x : 0, origin ? header.origin_y : 0);
+    std::vector<float> row(Rows.Width());
+    FilterRows(Rows, Spec, Pool, [&](const float* Row) {
+        row.assign(Row, Row + row.size());
+        Out.Row(row);
+    });
+    Out.End();
+}
+
+#if !defined(UNITTEST)
+
+// Writer for output_file or output_shm, otherwise for JSON output.
+static std::unique_ptr<RowWriter> new_writer(io::HeightFieldFilterIn& Val) {
+    const HeightFieldDataType type = Val.output_encodingGiven() ?
+        HeightFieldEncoding(Val.output_encoding()) : HeightFieldFloat32;
+    if (Val.output_shmGiven())
+        return std::unique_ptr<RowWriter>(new FileRowWriter(
+            Val.output_shm(), type, Val.output_shm_readersGiven() ?
+                Val.output_shm_readers() : 1));
+    if (Val.output_fileGiven())
+        return std::unique_ptr<RowWriter>(
+            new FileRowWriter(Val.output_file(), type));
+    if (Val.output_encodingGiven())
+        throw std::runtime_error(
+            "output_encoding needs output_file or output_shm.");
+    return std::unique_ptr<RowWriter>(new JSONRowWriter(NumberFormat(
+        Val.output_precisionGiven() ? Val.output_precision() : 0)));
+}
+
+static int filter(io::HeightFieldFilterIn& Val) {
+    try {
+        const FilterSpec spec {
+            FilterKindFromName(Val.filter()),
+            Val.radiusGiven() ? Val.radius() : 1,
+            Val.wrapGiven() && Val.wrap() };
+        std::unique_ptr<HeightFieldRowReader> rows = HeightFieldRows(Val);
+        std::unique_ptr<RowWriter> writer = new_writer(Val);
+        ThreadPool pool;
+        filter_rows(*rows, spec, pool, *writer);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int f = 0;
+    if (argc > 1)
+        f = open(argv[1], O_RDONLY);
+    InputParser<io::ParserPool, io::HeightFieldFilterIn_Parser,
+        io::HeightFieldFilterIn> ip(f);
+    ip.AddNumberArray<float>("heightfield", [](io::HeightFieldFilterIn& Val)
+        -> HeightField& { return Val.heightfield(); });
+    int status = ip.ReadAndParse(filter);
+    if (f)
+        close(f);
+    return status;
+}
+
+#else
+
+// Keeps the rows given to it.
+class KeptRows : public RowWriter {
+public:
+    std::uint32_t width, height, left, low;
+    std::vector<std::vector<float>> rows;
+    bool ended;
+
+    KeptRows() : width(0), height(0), left(0), low(0), ended(false) { }
+    void Begin(std::uint32_t Width, std::uint32_t Height,
+        std::uint32_t Left, std::uint32_t Low)
+    {
+        width = Width;
+        height = Height;
+        left = Left;
+        low = Low;
+    }
+    void Row(const std::vector<float>& Values) { rows.push_back(Values); }
+    void End() { ended = true; }
+};
+
+TEST_CASE("filter_rows") {
+    HeightField hf;
+    hf.push_back(std::vector<float> { 0.0f, 3.0f, 0.0f, 0.0f });
+    hf.push_back(std::vector<float> { 0.0f, 0.0f, 0.0f, 0.0f });
+    hf.push_back(std::vector<float> { 0.0f, 0.0f, 0.0f, 6.0f });
+    ThreadPool pool(2);
+    KeptRows out;
+    SUBCASE("Box") {
+        HeightFieldRowReader rows(hf, {});
+        filter_rows(rows, FilterSpec { FilterBox, 1, false }, pool, out);
+        REQUIRE(out.ended);
+        REQUIRE(out.width == 4);
+        REQUIRE(out.height == 3);
+        REQUIRE(out.rows.size() == 3);
+        // Edge rows and columns repeat.
+        REQUIRE(out.rows[0][0] == doctest::Approx(6.0f / 9.0f));
+        REQUIRE(out.rows[1][2] == doctest::Approx(9.0f / 9.0f));
+        REQUIRE(out.rows[2][3] == doctest::Approx(24.0f / 9.0f));
+    }
+    SUBCASE("Wrap") {
+        HeightFieldRowReader rows(hf, {});
+        filter_rows(rows, FilterSpec { FilterBox, 1, true }, pool, out);
+        REQUIRE(out.rows[0][0] == doctest::Approx(9.0f / 9.0f));
+        REQUIRE(out.rows[1][2] == doctest::Approx(9.0f / 9.0f));
+        REQUIRE(out.rows[2][3] == doctest::Approx(6.0f / 9.0f));
+    }
+    SUBCASE("Window") {
+        HeightFieldRowReader rows(hf, { 1, 1, 3, 2 });
+        filter_rows(rows, FilterSpec { FilterMax, 1, false }, pool, out);
+        REQUIRE(out.width == 3);
+        REQUIRE(out.rows.size() == 2);
+        REQUIRE(out.rows[0] == std::vector<float> { 0.0f, 6.0f, 6.0f });
+        REQUIRE(out.rows[1] == std::vector<float> { 0.0f, 6.0f, 6.0f });
+    }
+}
+
+#endif
@@ -0,0 +1,186 @@
+//
+//  heightfieldjson.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "heightfieldjson.hpp"
+
+
+void VertexRow(std::vector<float>& Out, const float* Row, std::size_t Columns,
+    std::size_t Y, float Width, float ZScale)
+{
+    const float yc = (Y * Width) / (Columns - 1);
+    for (std::size_t x = 0; x < Columns; ++x) {
+        Out.push_back((x * Width) / (Columns - 1));
+        Out.push_back(yc);
+        Out.push_back(ZScale * Row[x]);
+    }
+}
+
+void QuantizedRow(std::vector<std::uint16_t>& Out, const float* Row,
+    std::size_t Columns, std::uint16_t Y, float Min, float Max)
+{
+    const float scale = (Min < Max) ? 65535.0f / (Max - Min) : 0.0f;
+    for (std::size_t x = 0; x < Columns; ++x) {
+        const float q = (Row[x] - Min) * scale + 0.5f;
+        Out.push_back(static_cast<std::uint16_t>(x));
+        Out.push_back(Y);
+        // Comparisons are false for NaN, which ends up as 0.
+        Out.push_back((q < 65535.0f) ?
+            ((0.0f < q) ? static_cast<std::uint16_t>(q) : 0) : 65535);
+    }
+}
+
+void StripRow(
+    std::vector<std::uint32_t>& Strip, std::uint32_t Y, std::size_t Columns)
+{
+    Strip.reserve(Strip.size() + 2 * Columns);
+    for (std::uint32_t x = 0; x < Columns; ++x) {
+        Strip.push_back(Y * Columns + x);
+        Strip.push_back((Y + 1) * Columns + x);
+    }
+}
+
+void CoordinateRow(std::vector<float>& Out, const float* Row,
+    std::size_t Count, const ColorMap& Map, float Min, float Range)
+{
+    const std::size_t last = Map.Size() - 1;
+    for (std::size_t x = 0; x < Count; ++x) {
+        float v = (Row[x] - Min) / Range;
+        std::size_t idx = Map.Index(v);
+        float s;
+        if (idx == 0 && v <= Map.Threshold(0))
+            s = 0.0f;
+        else if (idx == last)
+            s = 1.0f;
+        else // idx + relative location of v in range, mapped to [0, 1].
+            s = (idx
+                + (v - Map.Threshold(idx))
+                    / (Map.Threshold(idx + 1) - Map.Threshold(idx)))
+                / last;
+        Out.push_back(s);
+        Out.push_back(0.5f);
+    }
+}
+
+void WriteImage(std::ostream& Out, HeightFieldRowReader& Rows,
+    const ColorMap& Map, float Min, float Max, const NumberFormat& Format)
+{
+    const float range = (Min < Max) ? Max - Min : 1.0f;
+    std::vector<float> line(std::size_t(Rows.Width()) * Map.Channels());
+    std::vector<char> buffer;
+    Rows.Rewind();
+    Out << '[';
+    for (std::uint32_t y = 0; const float* row = Rows.Next(); ++y) {
+        Map.MapRow(row, Rows.Width(), Min, range, line.data());
+        Out << (y ? ",[" : "[");
+        Format.WriteGroups(
+            Out, line.data(), Rows.Width(), Map.Channels(), false, buffer);
+        Out << ']';
+    }
+    Out << ']';
+}
+
+void WriteVertices(std::ostream& Out, HeightFieldRowReader& Rows,
+    float Width, float ZScale, const NumberFormat& Format)
+{
+    std::vector<float> line;
+    std::vector<char> buffer;
+    Rows.Rewind();
+    Out << '[';
+    for (std::uint32_t y = 0; const float* row = Rows.Next(); ++y) {
+        line.resize(0);
+        VertexRow(line, row, Rows.Width(), y, Width, ZScale);
+        Format.WriteGroups(Out, line.data(), Rows.Width(), 3, y != 0, buffer);
+    }
+    Out << ']';
+}
+
+void WriteQuantizedVertices(std::ostream& Out, HeightFieldRowReader& Rows,
+    float Min, float Max, const NumberFormat& Format)
+{
+    std::vector<std::uint16_t> line;
+    std::vector<char> buffer;
+    Rows.Rewind();
+    Out << '[';
+    for (std::uint32_t y = 0; const float* row = Rows.Next(); ++y) {
+        line.resize(0);
+        QuantizedRow(line, row, Rows.Width(), y, Min, Max);
+        Format.WriteGroups(Out, line.data(), Rows.Width(), 3, y != 0, buffer);
+    }
+    Out << ']';
+}
+
+void WriteHeights(std::ostream& Out, HeightFieldRowReader& Rows,
+    float ZScale, const NumberFormat& Format)
+{
+    std::vector<float> line(Rows.Width());
+    std::vector<char> buffer;
+    Rows.Rewind();
+    Out << '[';
+    for (std::uint32_t y = 0; const float* row = Rows.Next(); ++y) {
+        for (std::uint32_t x = 0; x < Rows.Width(); ++x)
+            line[x] = ZScale * row[x];
+        Format.WriteItems(Out, line, y != 0, buffer);
+    }
+    Out << ']';
+}
+
+void WriteColors(std::ostream& Out, HeightFieldRowReader& Rows,
+    const ColorMap& Map, float Min, float Max, const NumberFormat& Format)
+{
+    const float range = (Min < Max) ? Max - Min : 1.0f;
+    std::vector<float> colors(std::size_t(Rows.Width()) * Map.Channels());
+    std::vector<char> buffer;
+    Rows.Rewind();
+    Out << '[';
+    for (std::uint32_t y = 0; const float* row = Rows.Next(); ++y) {
+        Map.MapRow(row, Rows.Width(), Min, range, colors.data());
+        Format.WriteGroups(Out, colors.data(), Rows.Width(), Map.Channels(),
+            y != 0, buffer);
+    }
+    Out << ']';
+}
+
+void WriteTriStrips(std::ostream& Out, std::uint32_t Width,
+    std::uint32_t Height, const NumberFormat& Format)
+{
+    std::vector<std::vector<std::uint32_t>> strip(1);
+    std::vector<char> buffer;
+    Out << '[';
+    for (std::uint32_t y = 0; y + 1 < Height; ++y) {
+        strip[0].resize(0);
+        StripRow(strip[0], y, Width);
+        Format.WriteItems(Out, strip, y != 0, buffer);
+    }
+    Out << ']';
+}
+
+void WriteTexture(
+    std::ostream& Out, const ColorMap& Map, const NumberFormat& Format)
+{
+    std::vector<char> buffer;
+    Out << "[[";
+    Format.WriteGroups(
+        Out, Map.Color(0), Map.Size(), Map.Channels(), false, buffer);
+    Out << "]]";
+}
+
+void WriteCoordinates(std::ostream& Out, HeightFieldRowReader& Rows,
+    const ColorMap& Map, float Min, float Max, const NumberFormat& Format)
+{
+    const float range = (Min < Max) ? Max - Min : 1.0f;
+    std::vector<float> line;
+    std::vector<char> buffer;
+    Rows.Rewind();
+    Out << '[';
+    for (std::uint32_t y = 0; const float* row = Rows.Next(); ++y) {
+        line.resize(0);
+        CoordinateRow(line, row, Rows.Width(), Map, Min, range);
+        Format.WriteGroups(Out, line.data(), Rows.Width(), 2, y != 0, buffer);
+    }
+    Out << ']';
+}
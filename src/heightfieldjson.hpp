@@ -0,0 +1,61 @@
+//
+//  heightfieldjson.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(HEIGHTFIELDJSON_HPP)
+#define HEIGHTFIELDJSON_HPP
+
+// JSON arrays that the heightfield2 programs make of height field rows. The
+// Write functions read the rows from the start and write a row at a time.
+
+#include "heightfieldfile.hpp"
+#include "colormap.hpp"
+#include "numberformat.hpp"
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+
+// Appends x, y, and z of each vertex of row Y. Columns span Width.
+void VertexRow(std::vector<float>& Out, const float* Row, std::size_t Columns,
+    std::size_t Y, float Width, float ZScale);
+// Appends column, row, and height quantized from [Min, Max] to [0, 65535]
+// for each vertex of row Y.
+void QuantizedRow(std::vector<std::uint16_t>& Out, const float* Row,
+    std::size_t Columns, std::uint16_t Y, float Min, float Max);
+// Row into triangle strip using the indexes of the next row, too.
+void StripRow(
+    std::vector<std::uint32_t>& Strip, std::uint32_t Y, std::size_t Columns);
+// Appends s and t of texture coordinate for each value.
+void CoordinateRow(std::vector<float>& Out, const float* Row,
+    std::size_t Count, const ColorMap& Map, float Min, float Range);
+
+// Array of rows of colors.
+void WriteImage(std::ostream& Out, HeightFieldRowReader& Rows,
+    const ColorMap& Map, float Min, float Max, const NumberFormat& Format);
+void WriteVertices(std::ostream& Out, HeightFieldRowReader& Rows,
+    float Width, float ZScale, const NumberFormat& Format);
+// Array of quantized vertices.
+void WriteQuantizedVertices(std::ostream& Out, HeightFieldRowReader& Rows,
+    float Min, float Max, const NumberFormat& Format);
+// Array of heights times ZScale of all rows.
+void WriteHeights(std::ostream& Out, HeightFieldRowReader& Rows,
+    float ZScale, const NumberFormat& Format);
+// Array of colors, one per vertex.
+void WriteColors(std::ostream& Out, HeightFieldRowReader& Rows,
+    const ColorMap& Map, float Min, float Max, const NumberFormat& Format);
+// Strip for each row except the last, no rows read.
+void WriteTriStrips(std::ostream& Out, std::uint32_t Width,
+    std::uint32_t Height, const NumberFormat& Format);
+// Image that has a texel for each color map entry.
+void WriteTexture(
+    std::ostream& Out, const ColorMap& Map, const NumberFormat& Format);
+void WriteCoordinates(std::ostream& Out, HeightFieldRowReader& Rows,
+    const ColorMap& Map, float Min, float Max, const NumberFormat& Format);
+
+#endif
@@ -0,0 +1,218 @@
+//
+//  hillshade.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "hillshade.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+ShadingMode ShadingModeFromName(const std::string& Name) {
+    if (Name == "hillshade")
+        return ShadingHillshade;
+    if (Name == "slope")
+        return ShadingSlope;
+    if (Name == "both")
+        return ShadingBoth;
+    throw std::runtime_error("Unknown shading: " + Name);
+}
+
+HillShade::HillShade(
+    ShadingMode Mode, float Azimuth, float Altitude, float ZFactor)
+    : mode(Mode), scale(ZFactor / 8.0f)
+{
+    const double radian = 3.14159265358979323846 / 180.0;
+    const double horizontal = std::cos(Altitude * radian);
+    // Rows grow southwards.
+    lx = static_cast<float>(horizontal * std::sin(Azimuth * radian));
+    ly = static_cast<float>(-horizontal * std::cos(Azimuth * radian));
+    lz = static_cast<float>(std::sin(Altitude * radian));
+}
+
+float HillShade::shade(float Gx, float Gy) const {
+    const float inv = 1.0f / std::sqrt(Gx * Gx + Gy * Gy + 1.0f);
+    if (mode == ShadingSlope)
+        return inv;
+    const float light = std::max(0.0f, (lz - Gx * lx - Gy * ly) * inv);
+    return (mode == ShadingBoth) ? light * inv : light;
+}
+
+void HillShade::ShadeRow(float* Out, const float* Up, const float* Row,
+    const float* Down, std::size_t Count) const
+{
+    if (!Count)
+        return;
+    const std::size_t last = Count - 1;
+    // Columns outside the row repeat the edge, so only these need clamping.
+    auto scalar = [&](std::size_t X) {
+        const std::size_t w = X ? X - 1 : 0;
+        const std::size_t e = (X < last) ? X + 1 : last;
+        const float gx = scale * ((Up[e] + 2.0f * Row[e] + Down[e]) -
+            (Up[w] + 2.0f * Row[w] + Down[w]));
+        const float gy = scale * ((Down[w] + 2.0f * Down[X] + Down[e]) -
+            (Up[w] + 2.0f * Up[X] + Up[e]));
+        Out[X] = shade(gx, gy);
+    };
+    scalar(0);
+    std::size_t x = 1;
+#if defined(__SSE2__)
+    const __m128 s = _mm_set1_ps(scale);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 vx = _mm_set1_ps(lx);
+    const __m128 vy = _mm_set1_ps(ly);
+    const __m128 vz = _mm_set1_ps(lz);
+    for (; x + 4 <= last; x += 4) {
+        const __m128 uw = _mm_loadu_ps(Up + x - 1);
+        const __m128 u = _mm_loadu_ps(Up + x);
+        const __m128 ue = _mm_loadu_ps(Up + x + 1);
+        const __m128 dw = _mm_loadu_ps(Down + x - 1);
+        const __m128 d = _mm_loadu_ps(Down + x);
+        const __m128 de = _mm_loadu_ps(Down + x + 1);
+        const __m128 gx = _mm_mul_ps(s, _mm_sub_ps(
+            _mm_add_ps(_mm_add_ps(ue,
+                _mm_mul_ps(two, _mm_loadu_ps(Row + x + 1))), de),
+            _mm_add_ps(_mm_add_ps(uw,
+                _mm_mul_ps(two, _mm_loadu_ps(Row + x - 1))), dw)));
+        const __m128 gy = _mm_mul_ps(s, _mm_sub_ps(
+            _mm_add_ps(_mm_add_ps(dw, _mm_mul_ps(two, d)), de),
+            _mm_add_ps(_mm_add_ps(uw, _mm_mul_ps(two, u)), ue)));
+        const __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy)), one)));
+        __m128 result = inv;
+        if (mode != ShadingSlope) {
+            const __m128 light = _mm_max_ps(zero, _mm_mul_ps(_mm_sub_ps(
+                _mm_sub_ps(vz, _mm_mul_ps(gx, vx)), _mm_mul_ps(gy, vy)), inv));
+            result = (mode == ShadingBoth) ? _mm_mul_ps(light, inv) : light;
+        }
+        _mm_storeu_ps(Out + x, result);
+    }
+#endif
+    for (; x <= last; ++x)
+        scalar(x);
+}
+
+void ApplyShade(float* Colors, const float* Shades, std::size_t Count,
+    std::size_t Channels)
+{
+    const std::size_t shaded = (Channels == 2 || Channels == 4) ?
+        Channels - 1 : Channels;
+    for (std::size_t k = 0; k < Count; ++k, Colors += Channels)
+        for (std::size_t c = 0; c < shaded; ++c)
+            Colors[c] *= Shades[k];
+}
+
+ShadedRows::ShadedRows(HeightFieldRowReader& Rows, const HillShade& Shading)
+    : rows(Rows), shading(Shading), window(Rows.Width(), 3),
+    shades(Rows.Width()), next(0)
+{
+    rows.Rewind();
+    if (rows.Height())
+        std::memcpy(window.Row(0), rows.Next(), sizeof(float) * rows.Width());
+}
+
+const float* ShadedRows::Next() {
+    const std::uint32_t height = rows.Height();
+    if (next == height)
+        return nullptr;
+    // Row y is in window row y % 3, so the row below replaces the one above
+    // the row before.
+    if (next + 1 < height)
+        std::memcpy(window.Row((next + 1) % 3), rows.Next(),
+            sizeof(float) * rows.Width());
+    const float* row = window.Row(next % 3);
+    shading.ShadeRow(shades.data(), next ? window.Row((next + 2) % 3) : row,
+        row, (next + 1 < height) ? window.Row((next + 1) % 3) : row,
+        rows.Width());
+    ++next;
+    return row;
+}
+
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+
+TEST_CASE("HillShade") {
+    // Slope rising eastwards at 45 degrees.
+    std::vector<float> up(11), row(11), down(11), out(11);
+    for (std::size_t x = 0; x < 11; ++x)
+        up[x] = row[x] = down[x] = float(x);
+    SUBCASE("Hillshade") {
+        HillShade west(ShadingHillshade, 270.0f, 45.0f);
+        west.ShadeRow(out.data(), up.data(), row.data(), down.data(), 11);
+        for (std::size_t x = 1; x < 10; ++x)
+            REQUIRE(out[x] == doctest::Approx(1.0f));
+        // Gradient is halved at the edges.
+        const float edge = (std::sqrt(0.5f) + 0.5f * std::sqrt(0.5f)) /
+            std::sqrt(1.25f);
+        REQUIRE(out[0] == doctest::Approx(edge));
+        REQUIRE(out[10] == doctest::Approx(edge));
+        HillShade east(ShadingHillshade, 90.0f, 0.0f);
+        east.ShadeRow(out.data(), up.data(), row.data(), down.data(), 11);
+        REQUIRE(out[5] == 0.0f);
+        HillShade north(ShadingHillshade, 0.0f, 0.0f, 2.0f);
+        north.ShadeRow(out.data(), row.data(), row.data(), row.data(), 11);
+        REQUIRE(out[5] == doctest::Approx(0.0f));
+        // Single column rising southwards faces north.
+        north.ShadeRow(out.data(), row.data(), row.data(), row.data() + 5, 1);
+        REQUIRE(out[0] == doctest::Approx(5.0f / std::sqrt(26.0f)));
+    }
+    SUBCASE("Slope") {
+        HillShade slope(ShadingSlope, 0.0f, 0.0f, 2.0f);
+        slope.ShadeRow(out.data(), up.data(), row.data(), down.data(), 11);
+        for (std::size_t x = 1; x < 10; ++x)
+            REQUIRE(out[x] == doctest::Approx(1.0f / std::sqrt(5.0f)));
+        HillShade both(ShadingBoth, 270.0f, 45.0f);
+        both.ShadeRow(out.data(), up.data(), row.data(), down.data(), 11);
+        REQUIRE(out[7] == doctest::Approx(std::sqrt(0.5f)));
+    }
+    REQUIRE(ShadingModeFromName("both") == ShadingBoth);
+    REQUIRE_THROWS_AS(ShadingModeFromName("dark"), std::runtime_error);
+}
+
+TEST_CASE("ApplyShade") {
+    float colors[8] = { 1.0f, 1.0f, 0.5f, 1.0f, 0.5f, 0.5f, 0.5f, 0.5f };
+    const float shades[2] = { 0.5f, 0.0f };
+    ApplyShade(colors, shades, 2, 4);
+    REQUIRE(colors[0] == 0.5f);
+    REQUIRE(colors[2] == 0.25f);
+    REQUIRE(colors[3] == 1.0f);
+    REQUIRE(colors[6] == 0.0f);
+    REQUIRE(colors[7] == 0.5f);
+    ApplyShade(colors, shades, 1, 1);
+    REQUIRE(colors[0] == 0.25f);
+}
+
+TEST_CASE("ShadedRows") {
+    HeightField hf;
+    for (int y = 0; y < 4; ++y)
+        hf.push_back(std::vector<float> { 0.0f, 0.0f, float(y) });
+    HeightFieldRowReader rows(hf, {});
+    const HillShade slope(ShadingSlope);
+    ShadedRows shaded(rows, slope);
+    for (int y = 0; y < 4; ++y) {
+        const float* row = shaded.Next();
+        REQUIRE(row != nullptr);
+        REQUIRE(row[2] == float(y));
+        const float* s = shaded.Shades();
+        // Columns 1 and 2 see the change of the third column.
+        REQUIRE(s[0] == 1.0f);
+        const float gx = (4.0f * y + ((0 < y) ? -1.0f : 0.0f) +
+            ((y < 3) ? 1.0f : 0.0f)) / 8.0f;
+        const float gy = ((y < 3) ? 1.0f : 0.0f) + ((0 < y) ? 1.0f : 0.0f);
+        REQUIRE(s[1] == doctest::Approx(
+            1.0f / std::sqrt(gx * gx + gy * gy / 64.0f + 1.0f)));
+    }
+    REQUIRE(shaded.Next() == nullptr);
+}
+
+#endif
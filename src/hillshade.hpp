@@ -0,0 +1,76 @@
+//
+//  hillshade.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(HILLSHADE_HPP)
+#define HILLSHADE_HPP
+
+// Shading of a height field from the gradient of the 3 by 3 neighbourhood of
+// each value, weighted as by Horn. Row 0 is north and the first column west.
+// Neighbours outside the field repeat the edge values.
+
+#include "heightfieldfile.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+enum ShadingMode {
+    ShadingHillshade,   // Light from a direction, not below 0.
+    ShadingSlope,       // Cosine of the slope angle, 1 for flat.
+    ShadingBoth         // Product of the two.
+};
+
+// Throws if Name is not hillshade, slope, or both.
+ShadingMode ShadingModeFromName(const std::string& Name);
+
+class HillShade {
+private:
+    ShadingMode mode;
+    float lx, ly, lz, scale;
+
+    float shade(float Gx, float Gy) const;
+
+public:
+    // Azimuth is clockwise from north and Altitude up from the horizon, in
+    // degrees. ZFactor multiplies heights to the units of the distance
+    // between neighbouring values.
+    HillShade(ShadingMode Mode, float Azimuth = 315.0f,
+        float Altitude = 45.0f, float ZFactor = 1.0f);
+
+    // Shade in [0, 1] of each of Count values of Row to Out. Up and Down are
+    // the rows to the north and to the south.
+    void ShadeRow(float* Out, const float* Up, const float* Row,
+        const float* Down, std::size_t Count) const;
+};
+
+// Multiplies the colors by the shades, leaving the alpha of 2 and 4
+// channel colors as is.
+void ApplyShade(float* Colors, const float* Shades, std::size_t Count,
+    std::size_t Channels);
+
+// Rows of a row reader with the shade of each row. Keeps three rows.
+class ShadedRows {
+private:
+    HeightFieldRowReader& rows;
+    const HillShade& shading;
+    HeightField window;
+    std::vector<float> shades;
+    std::uint32_t next;
+
+public:
+    // Rewinds Rows. Both must stay around while rows are read.
+    ShadedRows(HeightFieldRowReader& Rows, const HillShade& Shading);
+
+    // Next row, or nullptr after the last row. Valid until the next call.
+    const float* Next();
+    // Shades of the row returned by Next.
+    const float* Shades() const { return shades.data(); }
+};
+
+#endif
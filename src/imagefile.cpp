@@ -0,0 +1,534 @@
+//
+//  imagefile.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "imagefile.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <cstdio>
+#include <cstring>
+#endif
+
+
+ImageFileFormat ImageFileFormatFromName(const std::string& Name) {
+    if (Name == "pnm")
+        return ImagePNM;
+    if (Name == "png")
+        return ImagePNG;
+    if (Name == "png_palette")
+        return ImagePNGPalette;
+    throw std::runtime_error("Unknown image format: " + Name);
+}
+
+ImageFileFormat ImageFileFormatFromPath(const std::string& Path) {
+    std::size_t dot = Path.rfind('.');
+    std::string ext = (dot == std::string::npos) ? "" : Path.substr(dot + 1);
+    for (auto& c : ext)
+        c = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    if (ext == "png")
+        return ImagePNG;
+    if (ext == "pnm" || ext == "ppm" || ext == "pgm")
+        return ImagePNM;
+    throw std::runtime_error("Unknown image file extension: " + Path);
+}
+
+static const std::uint32_t* crc_table() {
+    static std::uint32_t table[256] = { 0 };
+    static bool filled = false;
+    if (!filled) {
+        for (std::uint32_t n = 0; n < 256; ++n) {
+            std::uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        filled = true;
+    }
+    return table;
+}
+
+std::uint32_t CRC32(
+    std::uint32_t CRC, const unsigned char* Data, std::size_t Length)
+{
+    const std::uint32_t* table = crc_table();
+    std::uint32_t c = CRC ^ 0xffffffffu;
+    for (std::size_t k = 0; k < Length; ++k)
+        c = table[(c ^ Data[k]) & 0xff] ^ (c >> 8);
+    return c ^ 0xffffffffu;
+}
+
+std::uint32_t Adler32(
+    std::uint32_t Adler, const unsigned char* Data, std::size_t Length)
+{
+    // Largest count for which sums do not overflow before the modulo.
+    const std::size_t most = 5552;
+    std::uint32_t a = Adler & 0xffff, b = Adler >> 16;
+    while (Length) {
+        std::size_t n = std::min(Length, most);
+        Length -= n;
+        for (; n; --n, ++Data) {
+            a += *Data;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+static long scaled(float V, float Scale) {
+    V = (0.0f < V) ? V : 0.0f;
+    V = (V < 1.0f) ? V : 1.0f;
+    return std::lrint(V * Scale);
+}
+
+void PackSamples8(const float* V, std::size_t Count, unsigned char* Out) {
+    std::size_t k = 0;
+#if defined(__SSE2__)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    __m128i q[4];
+    for (; k + 16 <= Count; k += 16) {
+        for (int j = 0; j < 4; ++j)
+            q[j] = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(
+                _mm_max_ps(_mm_loadu_ps(V + k + 4 * j), zero), one), scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(Out + k),
+            _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]),
+                _mm_packs_epi32(q[2], q[3])));
+    }
+#endif
+    for (; k < Count; ++k)
+        Out[k] = static_cast<unsigned char>(scaled(V[k], 255.0f));
+}
+
+void PackSamples16(const float* V, std::size_t Count, unsigned char* Out) {
+    std::size_t k = 0;
+#if defined(__SSE2__)
+    // Signed saturating pack needs values shifted to signed range.
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(65535.0f);
+    const __m128i half = _mm_set1_epi32(32768);
+    const __m128i flip = _mm_set1_epi16(-32768);
+    for (; k + 8 <= Count; k += 8) {
+        const __m128i a = _mm_sub_epi32(_mm_cvtps_epi32(_mm_mul_ps(
+            _mm_min_ps(_mm_max_ps(_mm_loadu_ps(V + k), zero), one), scale)),
+            half);
+        const __m128i b = _mm_sub_epi32(_mm_cvtps_epi32(_mm_mul_ps(
+            _mm_min_ps(_mm_max_ps(_mm_loadu_ps(V + k + 4), zero), one),
+            scale)), half);
+        const __m128i s = _mm_xor_si128(_mm_packs_epi32(a, b), flip);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(Out + 2 * k),
+            _mm_or_si128(_mm_slli_epi16(s, 8), _mm_srli_epi16(s, 8)));
+    }
+#endif
+    for (; k < Count; ++k) {
+        const long s = scaled(V[k], 65535.0f);
+        Out[2 * k] = static_cast<unsigned char>(s >> 8);
+        Out[2 * k + 1] = static_cast<unsigned char>(s & 0xff);
+    }
+}
+
+static void put32(std::vector<unsigned char>& Out, std::uint32_t V) {
+    Out.push_back(static_cast<unsigned char>(V >> 24));
+    Out.push_back(static_cast<unsigned char>((V >> 16) & 0xff));
+    Out.push_back(static_cast<unsigned char>((V >> 8) & 0xff));
+    Out.push_back(static_cast<unsigned char>(V & 0xff));
+}
+
+static int create(const std::string& Path) {
+    int fd = open(Path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        throw std::runtime_error("Failed to create " + Path);
+    return fd;
+}
+
+// Deflate stored block holds at most this many bytes.
+static const std::size_t stored_block = 65535;
+
+ImageFileWriter::ImageFileWriter(const std::string& Path,
+    ImageFileFormat Format, std::uint32_t Width, std::uint32_t Height,
+    std::size_t Channels, std::size_t Depth)
+    : fd(-1), format(Format), width(Width), height(Height), rows(0),
+    channels(Channels), depth(Depth), row_size(0), raw_left(0), adler(1),
+    palette(0), started(false)
+{
+    if (width == 0 || height == 0)
+        throw std::runtime_error("Image is empty.");
+    if (depth != 8 && depth != 16)
+        throw std::runtime_error("Image depth must be 8 or 16.");
+    if (format == ImagePNM && channels != 1 && channels != 3)
+        throw std::runtime_error("PNM image needs 1 or 3 channels.");
+    if (channels < 1 || 4 < channels)
+        throw std::runtime_error("Image needs 1 to 4 channels.");
+    if (format == ImagePNGPalette && depth != 8)
+        throw std::runtime_error("Palette image depth must be 8.");
+    row_size = std::size_t(width) *
+        ((format == ImagePNGPalette) ? 1 : channels * depth / 8);
+    // PNG rows start with filter type byte, which is zero.
+    line.resize(row_size + ((format == ImagePNM) ? 0 : 1), 0);
+    fd = create(Path);
+    if (format == ImagePNM) {
+        std::string header = std::string((channels == 1) ? "P5\n" : "P6\n") +
+            std::to_string(width) + " " + std::to_string(height) + "\n" +
+            std::to_string((depth == 8) ? 255 : 65535) + "\n";
+        write(reinterpret_cast<const unsigned char*>(header.data()),
+            header.size());
+        return;
+    }
+    const unsigned char signature[8] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    write(signature, sizeof(signature));
+    static const unsigned char color_types[5] = { 0, 0, 4, 2, 6 };
+    std::vector<unsigned char> ihdr;
+    put32(ihdr, width);
+    put32(ihdr, height);
+    ihdr.push_back(static_cast<unsigned char>(depth));
+    ihdr.push_back((format == ImagePNGPalette) ? 3 : color_types[channels]);
+    ihdr.push_back(0); // Deflate.
+    ihdr.push_back(0); // Adaptive filtering, only type none used.
+    ihdr.push_back(0); // No interlace.
+    chunk("IHDR", ihdr.data(), ihdr.size());
+    raw_left = std::uint64_t(height) * line.size();
+    pending.reserve(stored_block);
+}
+
+ImageFileWriter::~ImageFileWriter() {
+    if (fd != -1)
+        close(fd);
+}
+
+void ImageFileWriter::write(const unsigned char* Data, std::size_t Length) {
+    buffer.insert(buffer.end(), Data, Data + Length);
+    if (buffer.size() > (1 << 20))
+        flush();
+}
+
+void ImageFileWriter::flush() {
+    const unsigned char* data = buffer.data();
+    std::size_t length = buffer.size();
+    while (length) {
+        ssize_t n = ::write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            throw std::runtime_error("Failed to write image file.");
+        }
+        data += n;
+        length -= n;
+    }
+    buffer.resize(0);
+}
+
+void ImageFileWriter::chunk(const char* Type, const unsigned char* Data,
+    std::size_t Length)
+{
+    std::vector<unsigned char> head;
+    put32(head, std::uint32_t(Length));
+    head.insert(head.end(), Type, Type + 4);
+    write(head.data(), head.size());
+    write(Data, Length);
+    std::vector<unsigned char> crc;
+    put32(crc, CRC32(CRC32(0, head.data() + 4, 4), Data, Length));
+    write(crc.data(), crc.size());
+}
+
+// Pending bytes as one stored deflate block in its own IDAT chunk. The
+// first block is preceded by zlib header and last followed by checksum.
+void ImageFileWriter::block() {
+    std::vector<unsigned char> data;
+    data.reserve(pending.size() + 11);
+    if (!started) {
+        data.push_back(0x78);
+        data.push_back(0x01);
+        started = true;
+    }
+    raw_left -= pending.size();
+    const std::uint16_t length = static_cast<std::uint16_t>(pending.size());
+    data.push_back(raw_left ? 0 : 1);
+    data.push_back(length & 0xff);
+    data.push_back(length >> 8);
+    data.push_back(~length & 0xff);
+    data.push_back((~length >> 8) & 0xff);
+    data.insert(data.end(), pending.begin(), pending.end());
+    adler = Adler32(adler, pending.data(), pending.size());
+    if (!raw_left)
+        put32(data, adler);
+    chunk("IDAT", data.data(), data.size());
+    pending.resize(0);
+}
+
+void ImageFileWriter::row() {
+    if (rows == height)
+        throw std::runtime_error("Image has more rows than height.");
+    ++rows;
+    if (format == ImagePNM) {
+        write(line.data(), line.size());
+        return;
+    }
+    const unsigned char* src = line.data();
+    std::size_t left = line.size();
+    while (left) {
+        std::size_t n = std::min(left, stored_block - pending.size());
+        pending.insert(pending.end(), src, src + n);
+        src += n;
+        left -= n;
+        if (pending.size() == stored_block)
+            block();
+    }
+}
+
+void ImageFileWriter::SetPalette(const float* Colors, std::size_t Count) {
+    if (format != ImagePNGPalette)
+        throw std::runtime_error("Palette needs png_palette format.");
+    if (rows || palette)
+        throw std::runtime_error("Palette must be set once before rows.");
+    if (Count == 0 || MaxPalette < Count)
+        throw std::runtime_error("Palette needs 1 to 256 colors.");
+    std::vector<unsigned char> samples(Count * channels);
+    PackSamples8(Colors, samples.size(), samples.data());
+    std::vector<unsigned char> plte, trns;
+    for (std::size_t k = 0; k < Count; ++k) {
+        const unsigned char* s = samples.data() + k * channels;
+        if (channels < 3)
+            plte.insert(plte.end(), 3, s[0]);
+        else
+            plte.insert(plte.end(), s, s + 3);
+        if (channels == 2 || channels == 4)
+            trns.push_back(s[channels - 1]);
+    }
+    chunk("PLTE", plte.data(), plte.size());
+    if (!trns.empty())
+        chunk("tRNS", trns.data(), trns.size());
+    palette = Count;
+}
+
+void ImageFileWriter::WriteRow(const float* Values) {
+    if (format == ImagePNGPalette)
+        throw std::runtime_error("Palette image needs index rows.");
+    unsigned char* out = line.data() + ((format == ImagePNM) ? 0 : 1);
+    if (depth == 8)
+        PackSamples8(Values, std::size_t(width) * channels, out);
+    else
+        PackSamples16(Values, std::size_t(width) * channels, out);
+    row();
+}
+
+void ImageFileWriter::WriteRow(const std::uint32_t* Indexes) {
+    if (!palette)
+        throw std::runtime_error("Palette has not been set.");
+    for (std::uint32_t x = 0; x < width; ++x) {
+        if (palette <= Indexes[x])
+            throw std::runtime_error("Palette index out of range.");
+        line[x + 1] = static_cast<unsigned char>(Indexes[x]);
+    }
+    row();
+}
+
+void ImageFileWriter::Finish() {
+    if (rows != height)
+        throw std::runtime_error("Image has fewer rows than height.");
+    if (format != ImagePNM) {
+        if (!pending.empty())
+            block();
+        chunk("IEND", nullptr, 0);
+    }
+    flush();
+}
+
+#if defined(UNITTEST)
+
+static std::vector<unsigned char> read_file(const char* Name) {
+    std::vector<unsigned char> data;
+    FILE* f = fopen(Name, "rb");
+    int c;
+    while ((c = fgetc(f)) != EOF)
+        data.push_back(static_cast<unsigned char>(c));
+    fclose(f);
+    return data;
+}
+
+static std::uint32_t get32(const unsigned char* P) {
+    return (std::uint32_t(P[0]) << 24) | (std::uint32_t(P[1]) << 16) |
+        (std::uint32_t(P[2]) << 8) | std::uint32_t(P[3]);
+}
+
+// Checks chunk checksums and returns inflated IDAT contents.
+static std::vector<unsigned char> png_rows(
+    const std::vector<unsigned char>& File, std::vector<std::string>& Types)
+{
+    std::vector<unsigned char> stream, raw;
+    std::size_t pos = 8;
+    while (pos < File.size()) {
+        const std::uint32_t length = get32(File.data() + pos);
+        const unsigned char* type = File.data() + pos + 4;
+        REQUIRE(get32(type + 4 + length) == CRC32(0, type, 4 + length));
+        Types.push_back(std::string(type, type + 4));
+        if (Types.back() == "IDAT")
+            stream.insert(stream.end(), type + 4, type + 4 + length);
+        pos += 12 + length;
+    }
+    REQUIRE(stream[0] == 0x78);
+    pos = 2;
+    bool last = false;
+    while (!last) {
+        last = stream[pos] & 1;
+        const std::size_t length = stream[pos + 1] | (stream[pos + 2] << 8);
+        REQUIRE((stream[pos + 3] | (stream[pos + 4] << 8)) ==
+            (~length & 0xffff));
+        raw.insert(raw.end(), stream.begin() + pos + 5,
+            stream.begin() + pos + 5 + length);
+        pos += 5 + length;
+    }
+    REQUIRE(get32(stream.data() + pos) == Adler32(1, raw.data(), raw.size()));
+    REQUIRE(pos + 4 == stream.size());
+    return raw;
+}
+
+TEST_CASE("Checksums") {
+    const unsigned char digits[] = "123456789";
+    REQUIRE(CRC32(0, digits, 9) == 0xcbf43926u);
+    REQUIRE(CRC32(CRC32(0, digits, 4), digits + 4, 5) == 0xcbf43926u);
+    const unsigned char word[] = "Wikipedia";
+    REQUIRE(Adler32(1, word, 9) == 0x11e60398u);
+    std::vector<unsigned char> ones(20000, 0xff);
+    std::uint32_t a = 1, b = 0;
+    for (auto c : ones) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    REQUIRE(Adler32(1, ones.data(), ones.size()) == ((b << 16) | a));
+}
+
+TEST_CASE("PackSamples") {
+    std::vector<float> v;
+    for (int k = -3; k < 40; ++k)
+        v.push_back(float(k) / 36.0f);
+    v.push_back(NAN);
+    v.push_back(0.5f / 255.0f);
+    std::vector<unsigned char> out8(v.size()), out16(2 * v.size());
+    PackSamples8(v.data(), v.size(), out8.data());
+    PackSamples16(v.data(), v.size(), out16.data());
+    for (std::size_t k = 0; k < v.size(); ++k) {
+        REQUIRE(out8[k] == scaled(v[k], 255.0f));
+        REQUIRE(out16[2 * k] * 256 + out16[2 * k + 1] ==
+            scaled(v[k], 65535.0f));
+    }
+    REQUIRE(out8[0] == 0);
+    REQUIRE(out8[40] == 255);
+    REQUIRE(out16[2 * 39] == 255);
+    REQUIRE(out16[2 * 39 + 1] == 255);
+}
+
+TEST_CASE("ImageFileWriter") {
+    char name[] = "/tmp/imagefileXXXXXX";
+    int fd = mkstemp(name);
+    REQUIRE(fd != -1);
+    close(fd);
+    const float a[6] = { 0.0f, 0.5f, 1.0f, 1.0f, 0.0f, 0.25f };
+    SUBCASE("PGM") {
+        {
+            ImageFileWriter writer(name, ImagePNM, 3, 2, 1, 16);
+            writer.WriteRow(a);
+            writer.WriteRow(a + 3);
+            writer.Finish();
+        }
+        std::vector<unsigned char> data = read_file(name);
+        const char header[] = "P5\n3 2\n65535\n";
+        const std::size_t start = sizeof(header) - 1;
+        REQUIRE(data.size() == start + 12);
+        REQUIRE(std::memcmp(data.data(), header, start) == 0);
+        REQUIRE(data[start + 2] == 0x80);
+        REQUIRE(data[start + 4] == 0xff);
+        REQUIRE(data[start + 11] == 0x00);
+    }
+    SUBCASE("PPM") {
+        {
+            ImageFileWriter writer(name, ImagePNM, 2, 1, 3);
+            writer.WriteRow(a);
+            writer.Finish();
+        }
+        std::vector<unsigned char> data = read_file(name);
+        REQUIRE(data.size() == 11 + 6);
+        REQUIRE(data[11 + 1] == 128);
+        REQUIRE(data[11 + 5] == 64);
+    }
+    SUBCASE("PNG") {
+        const std::uint32_t w = 300, h = 40;
+        std::vector<float> row(w * 3);
+        std::vector<unsigned char> expected;
+        {
+            ImageFileWriter writer(name, ImagePNG, w, h, 3, 16);
+            for (std::uint32_t y = 0; y < h; ++y) {
+                for (std::size_t k = 0; k < row.size(); ++k)
+                    row[k] = float((k + y) % 7) / 6.0f;
+                writer.WriteRow(row.data());
+                expected.push_back(0);
+                expected.resize(expected.size() + 2 * row.size());
+                PackSamples16(row.data(), row.size(),
+                    expected.data() + expected.size() - 2 * row.size());
+            }
+            writer.Finish();
+        }
+        std::vector<unsigned char> data = read_file(name);
+        REQUIRE(data[1] == 'P');
+        REQUIRE(get32(data.data() + 16) == w);
+        REQUIRE(get32(data.data() + 20) == h);
+        REQUIRE(data[24] == 16);
+        REQUIRE(data[25] == 2);
+        std::vector<std::string> types;
+        REQUIRE(png_rows(data, types) == expected);
+        REQUIRE(types.size() == 4);
+        REQUIRE(types.back() == "IEND");
+    }
+    SUBCASE("Palette") {
+        const float colors[4] = { 0.0f, 1.0f, 1.0f, 0.5f };
+        const std::uint32_t idx[3] = { 1, 0, 1 };
+        {
+            ImageFileWriter writer(name, ImagePNGPalette, 3, 1, 2);
+            REQUIRE_THROWS(writer.WriteRow(idx));
+            writer.SetPalette(colors, 2);
+            REQUIRE_THROWS(writer.WriteRow(a));
+            writer.WriteRow(idx);
+            writer.Finish();
+        }
+        std::vector<unsigned char> data = read_file(name);
+        REQUIRE(data[25] == 3);
+        std::vector<std::string> types;
+        REQUIRE(png_rows(data, types) ==
+            std::vector<unsigned char> { 0, 1, 0, 1 });
+        REQUIRE(types == std::vector<std::string> {
+            "IHDR", "PLTE", "tRNS", "IDAT", "IEND" });
+        REQUIRE(data[33 + 8 + 3] == 255);
+    }
+    SUBCASE("Invalid") {
+        REQUIRE_THROWS(ImageFileWriter(name, ImagePNM, 2, 2, 4));
+        REQUIRE_THROWS(ImageFileWriter(name, ImagePNG, 2, 2, 3, 12));
+        REQUIRE_THROWS(ImageFileWriter(name, ImagePNGPalette, 2, 2, 3, 16));
+        REQUIRE_THROWS(ImageFileWriter(name, ImagePNG, 0, 2, 3));
+        ImageFileWriter writer(name, ImagePNG, 3, 1, 1);
+        REQUIRE_THROWS(writer.Finish());
+        writer.WriteRow(a);
+        REQUIRE_THROWS(writer.WriteRow(a));
+        REQUIRE(ImageFileFormatFromPath("a/b.PGM") == ImagePNM);
+        REQUIRE(ImageFileFormatFromName("png_palette") == ImagePNGPalette);
+        REQUIRE_THROWS(ImageFileFormatFromPath("a.tif"));
+    }
+    unlink(name);
+}
+
+#endif
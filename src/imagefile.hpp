@@ -0,0 +1,85 @@
+//
+//  imagefile.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(IMAGEFILE_HPP)
+#define IMAGEFILE_HPP
+
+// Binary image files written a row at a time. PNM is PGM for one channel and
+// PPM for three. PNG stores rows without compression, so that no library is
+// needed, and can use a palette instead of colors.
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+enum ImageFileFormat {
+    ImagePNM = 0,
+    ImagePNG = 1,
+    ImagePNGPalette = 2
+};
+
+// Throws if the name is not pnm, png, or png_palette.
+ImageFileFormat ImageFileFormatFromName(const std::string& Name);
+// Format by file name extension. Throws for unknown extensions.
+ImageFileFormat ImageFileFormatFromPath(const std::string& Path);
+
+std::uint32_t CRC32(
+    std::uint32_t CRC, const unsigned char* Data, std::size_t Length);
+std::uint32_t Adler32(
+    std::uint32_t Adler, const unsigned char* Data, std::size_t Length);
+
+// Values in [0, 1] to samples, clamped and rounded. 16-bit samples are
+// written most significant byte first.
+void PackSamples8(const float* V, std::size_t Count, unsigned char* Out);
+void PackSamples16(const float* V, std::size_t Count, unsigned char* Out);
+
+class ImageFileWriter {
+private:
+    int fd;
+    ImageFileFormat format;
+    std::uint32_t width, height, rows;
+    std::size_t channels, depth, row_size;
+    std::uint64_t raw_left;
+    std::uint32_t adler;
+    std::size_t palette;
+    bool started;
+    std::vector<unsigned char> buffer, pending, line;
+
+    void write(const unsigned char* Data, std::size_t Length);
+    void flush();
+    void chunk(const char* Type, const unsigned char* Data,
+        std::size_t Length);
+    void block();
+    void row();
+
+public:
+    static const std::size_t MaxPalette = 256;
+
+    // Channels is 1 or 3 for PNM, 1 to 4 for PNG. Depth is 8 or 16 bits per
+    // sample, 8 for the palette. Throws if the file can not be created.
+    ImageFileWriter(const std::string& Path, ImageFileFormat Format,
+        std::uint32_t Width, std::uint32_t Height, std::size_t Channels,
+        std::size_t Depth = 8);
+    ~ImageFileWriter();
+    ImageFileWriter(const ImageFileWriter&) = delete;
+    ImageFileWriter& operator=(const ImageFileWriter&) = delete;
+
+    // Required for ImagePNGPalette before the rows. Count colors of
+    // Channels values each.
+    void SetPalette(const float* Colors, std::size_t Count);
+    // Width times Channels values in [0, 1].
+    void WriteRow(const float* Values);
+    // Width palette indexes.
+    void WriteRow(const std::uint32_t* Indexes);
+    // Throws if not all rows were written.
+    void Finish();
+};
+
+#endif
@@ -0,0 +1,328 @@
+//
+//  inputsource.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "inputsource.hpp"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <string>
+#include <cstdio>
+#include <fcntl.h>
+#endif
+
+
+InputSource::InputSource() : stats { false, 0, 0, 0, 0 } { }
+
+InputSource::~InputSource() { }
+
+// Mapping is private and writable, so the byte after a piece can be set to 0
+// and put back once the piece is no longer valid. The last piece is copied,
+// as a file that ends at a page boundary has no byte after it.
+class MappedInput : public InputSource {
+private:
+    char* map;
+    std::size_t size, offset, chunk;
+    char* terminated;
+    char saved;
+    std::vector<char> last;
+
+public:
+    MappedInput(void* Map, std::size_t Size, std::size_t ChunkSize)
+        : map(static_cast<char*>(Map)), size(Size), offset(0),
+        chunk(ChunkSize), terminated(nullptr), saved(0)
+    {
+        stats.mapped = true;
+        madvise(map, size, MADV_SEQUENTIAL);
+    }
+
+    ~MappedInput() { munmap(map, size); }
+
+    bool Next(const char*& Begin, const char*& End) {
+        if (terminated != nullptr) {
+            *terminated = saved;
+            terminated = nullptr;
+        }
+        if (offset == size)
+            return false;
+        const std::size_t count = std::min(chunk, size - offset);
+        if (offset + count < size) {
+            Begin = map + offset;
+            terminated = map + offset + count;
+            saved = *terminated;
+            *terminated = 0;
+        } else {
+            last.resize(count + 1);
+            std::copy(map + offset, map + size, last.begin());
+            last.back() = 0;
+            Begin = last.data();
+        }
+        End = Begin + count;
+        offset += count;
+        stats.bytes += count;
+        ++stats.pieces;
+        return true;
+    }
+};
+
+class ReadAheadInput : public InputSource {
+private:
+    struct Buffer {
+        std::vector<char> data;
+        std::size_t count;
+    };
+    int fd;
+    int wake[2];
+    std::vector<Buffer> ring;
+    // Buffers [head, head + filled) hold input. The one at head is in use by
+    // the parser from the first call to Next until the following one.
+    std::size_t head, filled;
+    bool in_use, eof, stop;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread reader;
+
+    void read_ahead() {
+        std::size_t tail = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (filled + (in_use ? 1 : 0) == ring.size() && !stop) {
+                    ++stats.reader_stalls;
+                    changed.wait(lock, [this]() {
+                        return stop || filled + (in_use ? 1 : 0) < ring.size();
+                    });
+                }
+                if (stop)
+                    return;
+            }
+            // Only the reader touches the buffer at tail until it is filled.
+            Buffer& b = ring[tail];
+            int count = -1;
+            while (true) {
+                // Destructor must not wait for input that may never come.
+                pollfd fds[2] = { { fd, POLLIN, 0 }, { wake[0], POLLIN, 0 } };
+                errno = 0;
+                if (poll(fds, 2, -1) < 0) {
+                    if (errno == EINTR || errno == EAGAIN)
+                        continue;
+                    break;
+                }
+                if (fds[1].revents)
+                    break;
+                // Error or hang-up without anything to read ends the input.
+                if (!(fds[0].revents & POLLIN) &&
+                    (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)))
+                    break;
+                count = read(fd, &b.data.front(), b.data.size() - 1);
+                if (0 <= count || !(errno == EAGAIN || errno == EINTR))
+                    break;
+            }
+            std::size_t total = (0 < count) ? count : 0;
+            // Fill the buffer with what is available without waiting.
+            while (0 < count && total + 1 < b.data.size()) {
+                pollfd ready = { fd, POLLIN, 0 };
+                if (poll(&ready, 1, 0) != 1 || !(ready.revents & POLLIN))
+                    break;
+                count = read(fd, &b.data.front() + total,
+                    b.data.size() - 1 - total);
+                if (0 < count)
+                    total += count;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (total == 0 || stop) {
+                eof = true;
+                changed.notify_all();
+                return;
+            }
+            b.count = total;
+            b.data[total] = 0;
+            ++filled;
+            tail = (tail + 1) % ring.size();
+            changed.notify_all();
+        }
+    }
+
+public:
+    ReadAheadInput(int FileDescriptor, std::size_t ChunkSize,
+        std::size_t Buffers)
+        : fd(FileDescriptor), ring(std::max<std::size_t>(2, Buffers)),
+        head(0), filled(0), in_use(false), eof(false), stop(false)
+    {
+        // Extra byte for the 0 after the input.
+        for (auto& b : ring)
+            b.data.resize(ChunkSize + 1);
+        if (pipe(wake) != 0)
+            wake[0] = wake[1] = -1;
+        reader = std::thread(&ReadAheadInput::read_ahead, this);
+    }
+
+    ~ReadAheadInput() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        changed.notify_all();
+        if (wake[1] != -1) {
+            ssize_t n = write(wake[1], "", 1);
+            (void)n;
+        }
+        reader.join();
+        if (wake[0] != -1) {
+            close(wake[0]);
+            close(wake[1]);
+        }
+    }
+
+    bool Next(const char*& Begin, const char*& End) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (in_use) {
+            in_use = false;
+            head = (head + 1) % ring.size();
+            changed.notify_all();
+        }
+        if (filled == 0 && !eof) {
+            ++stats.parser_stalls;
+            changed.wait(lock, [this]() { return filled != 0 || eof; });
+        }
+        if (filled == 0)
+            return false;
+        --filled;
+        in_use = true;
+        Begin = &ring[head].data.front();
+        End = Begin + ring[head].count;
+        stats.bytes += ring[head].count;
+        ++stats.pieces;
+        return true;
+    }
+
+    Stats Statistics() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+};
+
+// Input that could not be opened ends at once, as a failed read would.
+class NoInput : public InputSource {
+public:
+    bool Next(const char*&, const char*&) { return false; }
+};
+
+std::unique_ptr<InputSource> InputSource::Open(int FileDescriptor,
+    std::size_t ChunkSize, std::size_t Buffers)
+{
+    if (FileDescriptor < 0)
+        return std::unique_ptr<InputSource>(new NoInput());
+    ChunkSize = std::max<std::size_t>(1, ChunkSize);
+    struct stat st;
+    if (fstat(FileDescriptor, &st) == 0 && S_ISREG(st.st_mode) &&
+        0 < st.st_size)
+    {
+        void* map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE, FileDescriptor, 0);
+        if (map != MAP_FAILED)
+            return std::unique_ptr<InputSource>(
+                new MappedInput(map, st.st_size, ChunkSize));
+    }
+    return std::unique_ptr<InputSource>(
+        new ReadAheadInput(FileDescriptor, ChunkSize, Buffers));
+}
+
+void ReportStats(const InputSource::Stats& S) {
+    if (std::getenv("TERRAIN_STATS") == nullptr)
+        return;
+    std::cerr << "input: " << (S.mapped ? "mapped" : "read-ahead")
+        << ", bytes " << S.bytes << ", pieces " << S.pieces
+        << ", parser stalls " << S.parser_stalls
+        << ", reader stalls " << S.reader_stalls << std::endl;
+}
+
+#if defined(UNITTEST)
+
+static std::string read_all(InputSource& Source) {
+    std::string all;
+    const char* begin;
+    const char* end;
+    while (Source.Next(begin, end)) {
+        REQUIRE(*end == 0);
+        all.append(begin, end);
+    }
+    return all;
+}
+
+TEST_CASE("InputSource") {
+    std::string text;
+    for (int k = 0; k < 10000; ++k)
+        text += "{\"a\":" + std::to_string(k) + "}\n";
+    SUBCASE("Mapped") {
+        char name[] = "/tmp/inputsourceXXXXXX";
+        int fd = mkstemp(name);
+        REQUIRE(fd != -1);
+        unlink(name);
+        REQUIRE(write(fd, text.data(), text.size()) == int(text.size()));
+        auto source = InputSource::Open(fd, 1000);
+        REQUIRE(source->Statistics().mapped);
+        REQUIRE(read_all(*source) == text);
+        REQUIRE(source->Statistics().pieces == (text.size() + 999) / 1000);
+        close(fd);
+    }
+    SUBCASE("Page boundary") {
+        char name[] = "/tmp/inputsourceXXXXXX";
+        int fd = mkstemp(name);
+        REQUIRE(fd != -1);
+        unlink(name);
+        const std::string page(sysconf(_SC_PAGESIZE), 'x');
+        REQUIRE(write(fd, page.data(), page.size()) == int(page.size()));
+        auto source = InputSource::Open(fd, 1000);
+        REQUIRE(source->Statistics().mapped);
+        REQUIRE(read_all(*source) == page);
+        close(fd);
+    }
+    SUBCASE("Pipe") {
+        int fds[2];
+        REQUIRE(pipe(fds) == 0);
+        std::thread writer([&text, &fds]() {
+            for (std::size_t k = 0; k < text.size(); k += 777)
+                if (write(fds[1], text.data() + k,
+                    std::min<std::size_t>(777, text.size() - k)) < 0)
+                        break;
+            close(fds[1]);
+        });
+        auto source = InputSource::Open(fds[0], 500, 3);
+        REQUIRE(!source->Statistics().mapped);
+        REQUIRE(read_all(*source) == text);
+        writer.join();
+        REQUIRE(source->Statistics().bytes == text.size());
+        close(fds[0]);
+    }
+    SUBCASE("Empty") {
+        int fds[2];
+        REQUIRE(pipe(fds) == 0);
+        close(fds[1]);
+        auto source = InputSource::Open(fds[0]);
+        REQUIRE(read_all(*source).empty());
+        close(fds[0]);
+    }
+    SUBCASE("Failed open") {
+        auto source = InputSource::Open(-1);
+        REQUIRE(read_all(*source).empty());
+        REQUIRE(source->Statistics().pieces == 0);
+    }
+}
+
+#endif
@@ -0,0 +1,59 @@
+//
+//  inputsource.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(INPUTSOURCE_HPP)
+#define INPUTSOURCE_HPP
+
+// Hands out the input in pieces. Regular files are mapped to memory and
+// parsed in place, anything else is read by a separate thread into a ring
+// of buffers so that reading overlaps with parsing.
+
+#include <memory>
+#include <cstddef>
+
+
+class InputSource {
+public:
+    struct Stats {
+        bool mapped;
+        std::size_t bytes;
+        std::size_t pieces;
+        // Times the parser had to wait for input to be read.
+        std::size_t parser_stalls;
+        // Times the reader had to wait for the parser to free a buffer.
+        std::size_t reader_stalls;
+    };
+
+protected:
+    Stats stats;
+
+public:
+    InputSource();
+    virtual ~InputSource();
+    InputSource(const InputSource&) = delete;
+    InputSource& operator=(const InputSource&) = delete;
+
+    // Sets Begin and End to the next piece of input. *End is 0, as the
+    // parsers may look at it. The previous piece is no longer valid. Returns
+    // false when the input has ended.
+    virtual bool Next(const char*& Begin, const char*& End) = 0;
+
+    // Copy, as the reader thread may still update the counts.
+    virtual Stats Statistics() { return stats; }
+
+    // Maps FileDescriptor if it is a regular file, otherwise reads it ahead
+    // in Buffers buffers. Pieces are at most ChunkSize bytes. Input ends at
+    // once if FileDescriptor is negative, as when open failed.
+    static std::unique_ptr<InputSource> Open(int FileDescriptor,
+        std::size_t ChunkSize = 1 << 22, std::size_t Buffers = 4);
+};
+
+// Writes the statistics to std::cerr if TERRAIN_STATS is set.
+void ReportStats(const InputSource::Stats& S);
+
+#endif
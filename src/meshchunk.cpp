@@ -0,0 +1,284 @@
+//
+//  meshchunk.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "meshchunk.hpp"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+
+// Every Step:th of Count samples and the last one.
+static void samples(
+    std::vector<std::uint32_t>& Out, std::uint32_t Count, std::uint32_t Step)
+{
+    Out.resize(0);
+    for (std::uint32_t k = 0; k + 1 < Count; k += Step)
+        Out.push_back(k);
+    Out.push_back(Count - 1);
+}
+
+// Largest difference between the samples along an edge and the lines
+// between the samples at Positions.
+static float edge_error(const float* Edge, std::size_t Stride,
+    const std::vector<std::uint32_t>& Positions)
+{
+    float e = 0.0f;
+    for (std::size_t k = 1; k < Positions.size(); ++k) {
+        const std::uint32_t a = Positions[k - 1];
+        const std::uint32_t b = Positions[k];
+        const float ha = Edge[a * Stride];
+        const float hb = Edge[b * Stride];
+        for (std::uint32_t s = a + 1; s < b; ++s)
+            e = std::max(e, std::fabs(
+                ha + ((hb - ha) * (s - a)) / (b - a) - Edge[s * Stride]));
+    }
+    return e;
+}
+
+// Indexes of the edge vertices of an Nx by Ny grid, going around with the
+// inside on the left when y grows upwards.
+static void ring(
+    std::vector<std::uint16_t>& Out, std::uint32_t Nx, std::uint32_t Ny)
+{
+    Out.resize(0);
+    for (std::uint32_t x = 0; x + 1 < Nx; ++x)
+        Out.push_back(x);
+    for (std::uint32_t y = 0; y + 1 < Ny; ++y)
+        Out.push_back(y * Nx + Nx - 1);
+    for (std::uint32_t x = Nx - 1; x > 0; --x)
+        Out.push_back((Ny - 1) * Nx + x);
+    for (std::uint32_t y = Ny - 1; y > 0; --y)
+        Out.push_back(y * Nx);
+}
+
+void BuildMeshChunk(MeshChunk& Chunk, const HeightField& Band,
+    std::uint32_t X, std::uint32_t Y, std::uint32_t Width,
+    std::uint32_t Height, std::uint32_t Levels, float SkirtDepth,
+    const MeshScale& Scale)
+{
+    Chunk.x = X;
+    Chunk.y = Y;
+    Chunk.width = Width;
+    Chunk.height = Height;
+    Chunk.levels.resize(Levels);
+    for (int k = 0; k < 3; ++k) {
+        Chunk.low[k] = std::numeric_limits<float>::infinity();
+        Chunk.high[k] = -std::numeric_limits<float>::infinity();
+    }
+    std::vector<std::uint32_t> xs, ys;
+    const bool skirt = 0.0f <= SkirtDepth || 1 < Levels;
+    if (SkirtDepth < 0.0f) {
+        SkirtDepth = 0.0f;
+        const float* corner = Band.Row(0) + X;
+        const float* opposite = Band.Row(Height - 1) + X + Width - 1;
+        for (std::uint32_t l = 1; l < Levels; ++l) {
+            samples(xs, Width, 1u << l);
+            samples(ys, Height, 1u << l);
+            SkirtDepth = std::max(SkirtDepth, std::max(
+                std::max(edge_error(corner, 1, xs),
+                    edge_error(opposite - Width + 1, 1, xs)),
+                std::max(edge_error(corner, Band.Stride(), ys),
+                    edge_error(corner + Width - 1, Band.Stride(), ys))));
+        }
+        SkirtDepth *= std::fabs(Scale.z);
+    }
+    std::vector<std::uint16_t> edge;
+    for (std::uint32_t l = 0; l < Levels; ++l) {
+        MeshChunkLevel& level(Chunk.levels[l]);
+        samples(xs, Width, 1u << l);
+        samples(ys, Height, 1u << l);
+        const std::uint32_t nx = static_cast<std::uint32_t>(xs.size());
+        const std::uint32_t ny = static_cast<std::uint32_t>(ys.size());
+        level.positions.resize(0);
+        level.heights.resize(0);
+        for (std::uint32_t y : ys) {
+            const float* row = Band.Row(y) + X;
+            const float yc = ((Y + y) * Scale.width) / (Scale.columns - 1);
+            for (std::uint32_t x : xs) {
+                level.positions.push_back(
+                    ((X + x) * Scale.width) / (Scale.columns - 1));
+                level.positions.push_back(yc);
+                level.positions.push_back(Scale.z * row[x]);
+                level.heights.push_back(row[x]);
+            }
+        }
+        level.strips.resize(ny - 1 + (skirt ? 1 : 0));
+        for (std::uint32_t y = 0; y + 1 < ny; ++y) {
+            auto& strip(level.strips[y]);
+            strip.resize(0);
+            for (std::uint32_t x = 0; x < nx; ++x) {
+                strip.push_back(y * nx + x);
+                strip.push_back((y + 1) * nx + x);
+            }
+        }
+        if (skirt) {
+            // Bottom before top keeps the skirt facing outwards like the top.
+            ring(edge, nx, ny);
+            auto& strip(level.strips.back());
+            strip.resize(0);
+            level.positions.reserve(level.positions.size() + 3 * edge.size());
+            const std::uint16_t first = nx * ny;
+            for (std::size_t k = 0; k <= edge.size(); ++k) {
+                const std::size_t e = k % edge.size();
+                if (k < edge.size()) {
+                    for (int c = 0; c < 2; ++c)
+                        level.positions.push_back(
+                            level.positions[3 * edge[e] + c]);
+                    level.positions.push_back(
+                        level.positions[3 * edge[e] + 2] - SkirtDepth);
+                    level.heights.push_back(level.heights[edge[e]]);
+                }
+                strip.push_back(first + e);
+                strip.push_back(edge[e]);
+            }
+        }
+        for (std::size_t k = 0; k < level.positions.size(); k += 3)
+            for (int c = 0; c < 3; ++c) {
+                Chunk.low[c] = std::min(Chunk.low[c], level.positions[k + c]);
+                Chunk.high[c] =
+                    std::max(Chunk.high[c], level.positions[k + c]);
+            }
+    }
+}
+
+void WriteMeshChunk(std::ostream& Out, const MeshChunk& Chunk,
+    const ColorMap* Map, float Min, float Max, const NumberFormat& Format)
+{
+    const float range = (Min < Max) ? Max - Min : 1.0f;
+    std::vector<char> buffer;
+    std::vector<float> colors;
+    Out << "{\"window\":";
+    Format.Write(Out, std::vector<std::uint32_t> {
+        Chunk.x, Chunk.y, Chunk.width, Chunk.height }, buffer);
+    Out << ",\"min\":";
+    Format.WriteGroups(Out, Chunk.low, 1, 3, false, buffer);
+    Out << ",\"max\":";
+    Format.WriteGroups(Out, Chunk.high, 1, 3, false, buffer);
+    Out << ",\"levels\":[";
+    for (std::size_t l = 0; l < Chunk.levels.size(); ++l) {
+        const MeshChunkLevel& level(Chunk.levels[l]);
+        const std::size_t count = level.heights.size();
+        Out << (l ? ",{" : "{") << "\"vertices\":[";
+        Format.WriteGroups(
+            Out, level.positions.data(), count, 3, false, buffer);
+        if (Map) {
+            colors.resize(count * Map->Channels());
+            Map->MapRow(level.heights.data(), count, Min, range, colors.data());
+            Out << "],\"colors\":[";
+            Format.WriteGroups(
+                Out, colors.data(), count, Map->Channels(), false, buffer);
+        }
+        Out << "],\"tristrips\":";
+        Format.Write(Out, level.strips, buffer);
+        Out << '}';
+    }
+    Out << "]}";
+}
+
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <sstream>
+
+// Sign of the z of the normal of the triangles in Strip, taking the turn
+// of every other triangle into account, or of its dot product with the
+// direction away from the center of the chunk.
+static void check_strip(const MeshChunkLevel& Level,
+    const std::vector<std::uint16_t>& Strip, bool Skirt)
+{
+    const float* p = Level.positions.data();
+    for (std::size_t k = 2; k < Strip.size(); ++k) {
+        const float* a = p + 3 * Strip[k - 2];
+        const float* b = p + 3 * Strip[k - 1];
+        const float* c = p + 3 * Strip[k];
+        if (k & 1)
+            std::swap(b, c);
+        float u[3], v[3];
+        for (int n = 0; n < 3; ++n) {
+            u[n] = b[n] - a[n];
+            v[n] = c[n] - a[n];
+        }
+        const float nx = u[1] * v[2] - u[2] * v[1];
+        const float ny = u[2] * v[0] - u[0] * v[2];
+        const float nz = u[0] * v[1] - u[1] * v[0];
+        if (!Skirt) {
+            REQUIRE(nz < 0.0f);
+            continue;
+        }
+        if (nx == 0.0f && ny == 0.0f && nz == 0.0f)
+            continue;
+        REQUIRE(nx * (a[0] - 1.0f) + ny * (a[1] - 1.0f) < 0.0f);
+    }
+}
+
+TEST_CASE("BuildMeshChunk") {
+    HeightField band(5, 3);
+    for (std::size_t y = 0; y < 3; ++y)
+        for (std::size_t x = 0; x < 5; ++x)
+            band[y][x] = 0.0f;
+    MeshChunk chunk;
+    const MeshScale scale { 4.0f, 5, 2.0f };
+    SUBCASE("One level") {
+        BuildMeshChunk(chunk, band, 2, 4, 3, 3, 1, -1.0f, scale);
+        REQUIRE(chunk.levels.size() == 1);
+        REQUIRE(chunk.levels[0].heights.size() == 9);
+        REQUIRE(chunk.levels[0].strips.size() == 2);
+        REQUIRE(chunk.low[0] == 2.0f);
+        REQUIRE(chunk.low[1] == 4.0f);
+        REQUIRE(chunk.high[0] == 4.0f);
+        REQUIRE(chunk.high[1] == 6.0f);
+        for (auto& strip : chunk.levels[0].strips)
+            check_strip(chunk.levels[0], strip, false);
+    }
+    SUBCASE("Two levels") {
+        band[0][1] = 1.0f;
+        BuildMeshChunk(chunk, band, 0, 0, 3, 3, 2, -1.0f, scale);
+        REQUIRE(chunk.levels.size() == 2);
+        const MeshChunkLevel& fine(chunk.levels[0]);
+        const MeshChunkLevel& coarse(chunk.levels[1]);
+        REQUIRE(fine.heights.size() == 9 + 8);
+        REQUIRE(coarse.heights.size() == 4 + 4);
+        REQUIRE(fine.strips.size() == 3);
+        REQUIRE(coarse.strips.size() == 2);
+        REQUIRE(fine.strips.back().size() == 2 * 9);
+        // Height 1 at the edge is missing from the coarse level.
+        REQUIRE(chunk.low[2] == -2.0f);
+        REQUIRE(chunk.high[2] == 2.0f);
+        for (auto level : { &fine, &coarse }) {
+            for (std::size_t k = 0; k + 1 < level->strips.size(); ++k)
+                check_strip(*level, level->strips[k], false);
+            check_strip(*level, level->strips.back(), true);
+        }
+    }
+    SUBCASE("Given skirt") {
+        BuildMeshChunk(chunk, band, 0, 0, 2, 2, 1, 0.5f, scale);
+        REQUIRE(chunk.levels[0].heights.size() == 4 + 4);
+        REQUIRE(chunk.low[2] == -0.5f);
+    }
+}
+
+TEST_CASE("WriteMeshChunk") {
+    HeightField band(2, 2);
+    band[0][0] = 0.0f;
+    band[0][1] = 1.0f;
+    band[1][0] = 2.0f;
+    band[1][1] = 3.0f;
+    MeshChunk chunk;
+    BuildMeshChunk(chunk, band, 0, 0, 2, 2, 1, -1.0f, { 2.0f, 2, 1.0f });
+    std::vector<std::vector<float>> map {
+        { 0.0f, 0.0f }, { 1.0f, 1.0f } };
+    ColorMap colors(map);
+    std::ostringstream out;
+    WriteMeshChunk(out, chunk, &colors, 0.0f, 3.0f, NumberFormat(2));
+    REQUIRE(out.str() == "{\"window\":[0,0,2,2],"
+        "\"min\":[0,0,0],\"max\":[2,2,3],\"levels\":[{"
+        "\"vertices\":[[0,0,0],[2,0,1],[0,2,2],[2,2,3]],"
+        "\"colors\":[[0],[0.33],[0.67],[1]],"
+        "\"tristrips\":[[0,2,1,3]]}]}");
+}
+
+#endif
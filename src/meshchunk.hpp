@@ -0,0 +1,65 @@
+//
+//  meshchunk.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(MESHCHUNK_HPP)
+#define MESHCHUNK_HPP
+
+// Square part of a height field mesh with vertices and indexes of its own,
+// at several levels of detail. Level l uses every 2^l:th sample. A skirt
+// hangs down from the edges to hide cracks against neighbours at other
+// levels.
+
+#include "heightfield.hpp"
+#include "colormap.hpp"
+#include "numberformat.hpp"
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+
+struct MeshChunkLevel {
+    // x, y, and z of each vertex. Skirt vertices are last.
+    std::vector<float> positions;
+    // Height field value of each vertex.
+    std::vector<float> heights;
+    // One strip per row of quads, skirt strip last.
+    std::vector<std::vector<std::uint16_t>> strips;
+};
+
+struct MeshChunk {
+    // Area of the height field in samples. Neighbours share edge samples.
+    std::uint32_t x, y, width, height;
+    float low[3], high[3];
+    std::vector<MeshChunkLevel> levels;
+};
+
+// Placement of the whole mesh, the same as in the full mesh output.
+struct MeshScale {
+    float width;
+    std::size_t columns;
+    float z;
+};
+
+// Largest chunk side in quads that keeps indexes in uint16 with a skirt.
+const std::uint32_t MaxMeshChunkSize = 253;
+
+// Builds the chunk at columns [X, X + Width) of Band, whose first row is
+// field row Y, using Height rows. Negative SkirtDepth sets the skirt depth
+// to the largest difference between the edges of the full and the coarser
+// levels, and leaves out the skirt when there is only one level.
+void BuildMeshChunk(MeshChunk& Chunk, const HeightField& Band,
+    std::uint32_t X, std::uint32_t Y, std::uint32_t Width,
+    std::uint32_t Height, std::uint32_t Levels, float SkirtDepth,
+    const MeshScale& Scale);
+
+// Writes Chunk as a JSON object. Colors are written when Map is given.
+void WriteMeshChunk(std::ostream& Out, const MeshChunk& Chunk,
+    const ColorMap* Map, float Min, float Max, const NumberFormat& Format);
+
+#endif
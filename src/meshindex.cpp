@@ -0,0 +1,260 @@
+//
+//  meshindex.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "meshindex.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+
+static const char* layout_names[IndexLayoutCount] = {
+    "rows", "strip", "restart", "blocks" };
+
+IndexLayout IndexLayoutFromName(const std::string& Name) {
+    for (int k = 0; k < IndexLayoutCount; ++k)
+        if (Name == layout_names[k])
+            return static_cast<IndexLayout>(k);
+    throw std::runtime_error("Unknown index layout: " + Name);
+}
+
+const char* IndexLayoutName(IndexLayout Layout) {
+    return layout_names[Layout];
+}
+
+std::uint32_t IndexBlockWidth(std::uint32_t CacheSize) {
+    // Drawing a row of a block loads the row below it. Both rows are in the
+    // cache in turn, so the row below stays until the next row of the block
+    // when the rows fill at most the cache.
+    return (CacheSize > 3) ? CacheSize / 2 - 1 : 1;
+}
+
+static void strip_row(
+    std::vector<std::uint32_t>& Part, std::uint32_t Y, std::uint32_t Width)
+{
+    for (std::uint32_t x = 0; x < Width; ++x) {
+        Part.push_back(Y * Width + x);
+        Part.push_back((Y + 1) * Width + x);
+    }
+}
+
+void LayoutIndexes(IndexLayout Layout, std::uint32_t Width,
+    std::uint32_t Height, std::uint32_t CacheSize, const IndexPart& Part)
+{
+    std::vector<std::uint32_t> part;
+    if (Layout != LayoutBlocks) {
+        for (std::uint32_t y = 0; y + 1 < Height; ++y) {
+            part.resize(0);
+            if (y && Layout == LayoutStrip) {
+                part.push_back(y * Width + Width - 1);
+                part.push_back(y * Width);
+            } else if (y && Layout == LayoutRestart)
+                part.push_back(RestartIndex);
+            strip_row(part, y, Width);
+            Part(part);
+        }
+        return;
+    }
+    const std::uint32_t block = IndexBlockWidth(CacheSize);
+    for (std::uint32_t x0 = 0; x0 + 1 < Width; x0 += block) {
+        const std::uint32_t x1 = std::min(x0 + block, Width - 1);
+        for (std::uint32_t y = 0; y + 1 < Height; ++y) {
+            part.resize(0);
+            for (std::uint32_t x = x0; x < x1; ++x) {
+                const std::uint32_t a = y * Width + x;
+                const std::uint32_t b = a + Width;
+                part.push_back(a);
+                part.push_back(b);
+                part.push_back(a + 1);
+                part.push_back(b);
+                part.push_back(b + 1);
+                part.push_back(a + 1);
+            }
+            Part(part);
+        }
+    }
+}
+
+void LayoutVertexOrder(std::vector<std::uint32_t>& Order, IndexLayout Layout,
+    std::uint32_t Width, std::uint32_t Height, std::uint32_t CacheSize)
+{
+    std::vector<bool> used(std::size_t(Width) * Height, false);
+    Order.resize(0);
+    Order.reserve(used.size());
+    LayoutIndexes(Layout, Width, Height, CacheSize,
+        [&](const std::vector<std::uint32_t>& Part) {
+            for (std::uint32_t idx : Part)
+                if (idx != RestartIndex && !used[idx]) {
+                    used[idx] = true;
+                    Order.push_back(idx);
+                }
+        });
+}
+
+std::uint32_t BlockVertexIndex(std::uint32_t X, std::uint32_t Y,
+    std::uint32_t Width, std::uint32_t Height, std::uint32_t CacheSize)
+{
+    const std::uint32_t block = IndexBlockWidth(CacheSize);
+    // Left column of a block is in the block before it, if any.
+    const std::uint32_t b = X ? (X - 1) / block : 0;
+    const std::uint32_t first = b ? b * block + 1 : 0;
+    const std::uint32_t columns =
+        std::min((b + 1) * block, Width - 1) - first + 1;
+    const std::uint32_t x = X - first;
+    return Height * first + ((Y < 2) ? 2 * x + Y : columns * Y + x);
+}
+
+double ACMR(IndexLayout Layout, std::uint32_t Width, std::uint32_t Height,
+    std::uint32_t CacheSize)
+{
+    // Load number of the latest vertex of each column in CacheSize + 1 rows,
+    // at y * Width + x modulo their size. A vertex is in the FIFO cache for
+    // CacheSize loads after its own. Layouts use a vertex in two consecutive
+    // rows of a strip or a block, or of the block next to it for the shared
+    // column. Each row loads at least one new vertex, so a vertex is out of
+    // the cache before another takes its entry. Load numbers are kept modulo
+    // 2^32, which is far more than loads between uses of a vertex.
+    struct Loaded {
+        std::uint32_t index;
+        std::uint32_t load;
+    };
+    const std::uint64_t entries = std::uint64_t(Width) *
+        std::min<std::uint64_t>(Height, std::uint64_t(CacheSize) + 1);
+    std::vector<Loaded> loaded(entries, Loaded { RestartIndex, 0 });
+    std::uint64_t loads = 0;
+    LayoutIndexes(Layout, Width, Height, CacheSize,
+        [&](const std::vector<std::uint32_t>& Part) {
+            for (std::uint32_t idx : Part) {
+                if (idx == RestartIndex)
+                    continue;
+                Loaded& entry(loaded[idx % entries]);
+                if (entry.index == idx &&
+                    std::uint32_t(loads) - entry.load <= CacheSize)
+                    continue;
+                entry.index = idx;
+                entry.load = std::uint32_t(loads++);
+            }
+        });
+    return double(loads) / (2.0 * (Width - 1) * (Height - 1));
+}
+
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+
+static std::vector<std::uint32_t> indexes(
+    IndexLayout Layout, std::uint32_t Width, std::uint32_t Height)
+{
+    std::vector<std::uint32_t> all;
+    LayoutIndexes(Layout, Width, Height, 8,
+        [&](const std::vector<std::uint32_t>& Part) {
+            all.insert(all.end(), Part.begin(), Part.end());
+        });
+    return all;
+}
+
+TEST_CASE("LayoutIndexes") {
+    SUBCASE("rows") {
+        REQUIRE(indexes(LayoutRows, 2, 3) ==
+            std::vector<std::uint32_t> { 0, 2, 1, 3, 2, 4, 3, 5 });
+    }
+    SUBCASE("strip") {
+        REQUIRE(indexes(LayoutStrip, 2, 3) ==
+            std::vector<std::uint32_t> { 0, 2, 1, 3, 3, 2, 2, 4, 3, 5 });
+    }
+    SUBCASE("restart") {
+        REQUIRE(indexes(LayoutRestart, 2, 3) == std::vector<std::uint32_t> {
+            0, 2, 1, 3, RestartIndex, 2, 4, 3, 5 });
+    }
+    SUBCASE("blocks") {
+        std::vector<std::uint32_t> all(indexes(LayoutBlocks, 9, 3));
+        REQUIRE(all.size() == 3 * 2 * 8 * 2);
+        // Blocks of 3 quads. Second block starts after the first goes down
+        // all rows.
+        REQUIRE(all[3 * 6] == 9);
+        REQUIRE(all[2 * 3 * 6] == 3);
+        for (std::size_t k = 0; k < all.size(); k += 3) {
+            std::int64_t x[3], y[3];
+            for (int n = 0; n < 3; ++n) {
+                x[n] = all[k + n] % 9;
+                y[n] = all[k + n] / 9;
+            }
+            REQUIRE((x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) *
+                (x[2] - x[0]) < 0);
+        }
+    }
+}
+
+TEST_CASE("LayoutVertexOrder") {
+    std::vector<std::uint32_t> order;
+    LayoutVertexOrder(order, LayoutRestart, 3, 2, 8);
+    REQUIRE(order == std::vector<std::uint32_t> { 0, 3, 1, 4, 2, 5 });
+    LayoutVertexOrder(order, LayoutBlocks, 40, 30, 16);
+    REQUIRE(order.size() == 40 * 30);
+    std::sort(order.begin(), order.end());
+    for (std::uint32_t k = 0; k < order.size(); ++k)
+        REQUIRE(order[k] == k);
+}
+
+TEST_CASE("BlockVertexIndex") {
+    std::vector<std::uint32_t> order;
+    for (std::uint32_t w : { 2, 7, 8, 9, 40 })
+        for (std::uint32_t h : { 2, 3, 11 }) {
+            LayoutVertexOrder(order, LayoutBlocks, w, h, 8);
+            for (std::uint32_t k = 0; k < order.size(); ++k)
+                REQUIRE(BlockVertexIndex(
+                    order[k] % w, order[k] / w, w, h, 8) == k);
+        }
+}
+
+TEST_CASE("ACMR") {
+    REQUIRE(IndexLayoutFromName("blocks") == LayoutBlocks);
+    REQUIRE(std::string(IndexLayoutName(LayoutStrip)) == "strip");
+    REQUIRE_THROWS_AS(IndexLayoutFromName("fan"), std::runtime_error);
+    REQUIRE(ACMR(LayoutRows, 2, 2, 32) == 2.0);
+    // Wide rows load every vertex twice, blocks nearly once.
+    const double rows = ACMR(LayoutRows, 1025, 257, 32);
+    const double blocks = ACMR(LayoutBlocks, 1025, 257, 32);
+    REQUIRE(0.99 < rows);
+    REQUIRE(blocks < 0.55);
+    REQUIRE(ACMR(LayoutRestart, 1025, 257, 32) == rows);
+}
+
+// Loads of a FIFO cache kept as a list of the cached indexes.
+static std::uint64_t fifo_loads(
+    const std::vector<std::uint32_t>& Indexes, std::uint32_t CacheSize)
+{
+    std::vector<std::uint32_t> fifo;
+    std::uint64_t loads = 0;
+    for (std::uint32_t idx : Indexes) {
+        if (idx == RestartIndex ||
+            std::find(fifo.begin(), fifo.end(), idx) != fifo.end())
+            continue;
+        fifo.push_back(idx);
+        if (fifo.size() > CacheSize)
+            fifo.erase(fifo.begin());
+        ++loads;
+    }
+    return loads;
+}
+
+TEST_CASE("ACMR same as FIFO") {
+    for (int l = 0; l < IndexLayoutCount; ++l)
+        for (std::uint32_t cache : { 1, 2, 3, 5, 8, 9, 32 })
+            for (std::uint32_t w : { 2, 3, 7, 17, 40 })
+                for (std::uint32_t h : { 2, 3, 5, 9, 13 }) {
+                    const IndexLayout layout = static_cast<IndexLayout>(l);
+                    std::vector<std::uint32_t> all;
+                    LayoutIndexes(layout, w, h, cache,
+                        [&](const std::vector<std::uint32_t>& Part) {
+                            all.insert(all.end(), Part.begin(), Part.end());
+                        });
+                    REQUIRE(ACMR(layout, w, h, cache) ==
+                        double(fifo_loads(all, cache)) /
+                            (2.0 * (w - 1) * (h - 1)));
+                }
+}
+
+#endif
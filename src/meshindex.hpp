@@ -0,0 +1,61 @@
+//
+//  meshindex.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(MESHINDEX_HPP)
+#define MESHINDEX_HPP
+
+// Orders of the indexes of a height field grid mesh. All wind the triangles
+// the same way as the triangle strip of each row.
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+
+enum IndexLayout {
+    LayoutRows,     // Triangle strip per row.
+    LayoutStrip,    // One strip, rows joined by repeating two indexes.
+    LayoutRestart,  // One strip, rows separated by RestartIndex.
+    LayoutBlocks    // Triangle list in columns that fit in vertex cache.
+};
+
+const int IndexLayoutCount = 4;
+const std::uint32_t RestartIndex = 0xffffffffu;
+
+// Throws if Name is not rows, strip, restart, or blocks.
+IndexLayout IndexLayoutFromName(const std::string& Name);
+const char* IndexLayoutName(IndexLayout Layout);
+
+// Width in quads of the column blocks for a FIFO vertex cache of CacheSize.
+std::uint32_t IndexBlockWidth(std::uint32_t CacheSize);
+
+typedef std::function<void(const std::vector<std::uint32_t>& Part)>
+    IndexPart;
+
+// Calls Part with consecutive parts of the grid indexes y * Width + x of
+// Layout. A part is a row for strips and a row of a block for the list.
+void LayoutIndexes(IndexLayout Layout, std::uint32_t Width,
+    std::uint32_t Height, std::uint32_t CacheSize, const IndexPart& Part);
+
+// Grid indexes in the order of first use by Layout.
+void LayoutVertexOrder(std::vector<std::uint32_t>& Order, IndexLayout Layout,
+    std::uint32_t Width, std::uint32_t Height, std::uint32_t CacheSize);
+
+// Position of grid vertex X, Y in the LayoutVertexOrder of LayoutBlocks,
+// found without the order. Block of column X starts after the columns of the
+// earlier blocks and uses the first two rows in turn, then a row at a time.
+std::uint32_t BlockVertexIndex(std::uint32_t X, std::uint32_t Y,
+    std::uint32_t Width, std::uint32_t Height, std::uint32_t CacheSize);
+
+// Average cache miss ratio: vertices loaded to a FIFO cache of CacheSize
+// per triangle, when drawing in Layout.
+double ACMR(IndexLayout Layout, std::uint32_t Width, std::uint32_t Height,
+    std::uint32_t CacheSize);
+
+#endif
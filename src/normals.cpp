@@ -0,0 +1,295 @@
+//
+//  normals.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "normals.hpp"
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+NormalEncoding NormalEncodingFromName(const std::string& Name) {
+    if (Name == "xyz")
+        return NormalXYZ;
+    if (Name == "octahedral")
+        return NormalOctahedral;
+    throw std::runtime_error("Unknown normal encoding: " + Name);
+}
+
+static void normal(float* Out, float Gx, float Gy) {
+    const float inv = 1.0f / std::sqrt(Gx * Gx + Gy * Gy + 1.0f);
+    Out[0] = 0.0f - Gx * inv;
+    Out[1] = 0.0f - Gy * inv;
+    Out[2] = inv;
+}
+
+void NormalRow(float* Out, const float* Up, const float* Row,
+    const float* Down, std::size_t Count, float XScale, float YScale,
+    bool Wrap)
+{
+    const std::size_t last = Count - 1;
+    // One step instead of two at the edges without wrap.
+    const float edge = Wrap ? XScale : 2.0f * XScale;
+    normal(Out, (Row[1] - Row[Wrap ? last : 0]) * edge,
+        (Down[0] - Up[0]) * YScale);
+    std::size_t x = 1;
+#if defined(__SSE2__)
+    const __m128 xs = _mm_set1_ps(XScale);
+    const __m128 ys = _mm_set1_ps(YScale);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    alignas(16) float nx[4], ny[4], nz[4];
+    for (; x + 4 <= last; x += 4) {
+        const __m128 gx = _mm_mul_ps(xs, _mm_sub_ps(
+            _mm_loadu_ps(Row + x + 1), _mm_loadu_ps(Row + x - 1)));
+        const __m128 gy = _mm_mul_ps(ys,
+            _mm_sub_ps(_mm_loadu_ps(Down + x), _mm_loadu_ps(Up + x)));
+        const __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy)), one)));
+        _mm_store_ps(nx, _mm_sub_ps(zero, _mm_mul_ps(gx, inv)));
+        _mm_store_ps(ny, _mm_sub_ps(zero, _mm_mul_ps(gy, inv)));
+        _mm_store_ps(nz, inv);
+        for (int k = 0; k < 4; ++k) {
+            Out[3 * (x + k)] = nx[k];
+            Out[3 * (x + k) + 1] = ny[k];
+            Out[3 * (x + k) + 2] = nz[k];
+        }
+    }
+#endif
+    for (; x < last; ++x)
+        normal(Out + 3 * x, (Row[x + 1] - Row[x - 1]) * XScale,
+            (Down[x] - Up[x]) * YScale);
+    normal(Out + 3 * last, (Row[Wrap ? 0 : last] - Row[last - 1]) * edge,
+        (Down[last] - Up[last]) * YScale);
+}
+
+void OctahedralRow(std::int16_t* Out, const float* Normals, std::size_t Count)
+{
+    for (std::size_t k = 0; k < Count; ++k) {
+        const float* n = Normals + 3 * k;
+        const float sum =
+            std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+        float x = n[0] / sum, y = n[1] / sum;
+        if (n[2] < 0.0f) {
+            // Lower half folds over the diagonals.
+            const float fx =
+                (1.0f - std::fabs(y)) * (x < 0.0f ? -1.0f : 1.0f);
+            y = (1.0f - std::fabs(x)) * (y < 0.0f ? -1.0f : 1.0f);
+            x = fx;
+        }
+        Out[2 * k] = static_cast<std::int16_t>(
+            std::lround(std::min(1.0f, std::max(-1.0f, x)) * 32767.0f));
+        Out[2 * k + 1] = static_cast<std::int16_t>(
+            std::lround(std::min(1.0f, std::max(-1.0f, y)) * 32767.0f));
+    }
+}
+
+void WriteNormals(std::ostream& Out, HeightFieldRowReader& Rows,
+    float Spacing, float ZScale, bool Wrap, NormalEncoding Encoding,
+    const NumberFormat& Format, ThreadPool& Pool)
+{
+    const std::uint32_t width = Rows.Width(), height = Rows.Height();
+    const std::size_t row_size = sizeof(float) * width;
+    const std::uint32_t block = 64;
+    // Band row 0 is above the block and row n + 1 below a block of n rows.
+    HeightField band(width, block + 2);
+    std::vector<float> above(width), below(width);
+    Rows.Rewind();
+    if (Wrap) {
+        // Last row is above the first.
+        const float* row = nullptr;
+        for (std::uint32_t y = 0; y < height; ++y)
+            row = Rows.Next();
+        if (row != nullptr)
+            std::memcpy(above.data(), row, row_size);
+        Rows.Rewind();
+    }
+    std::vector<std::string> texts(block);
+    const float xscale = ZScale / (2.0f * Spacing);
+    std::memcpy(band.Row(1), Rows.Next(), row_size);
+    // First row is below the last.
+    if (Wrap)
+        std::memcpy(below.data(), band.Row(1), row_size);
+    Out << '[';
+    for (std::uint32_t y0 = 0; y0 < height; y0 += block) {
+        const std::uint32_t n = std::min(block, height - y0);
+        for (std::uint32_t k = 2; k <= n; ++k)
+            std::memcpy(band.Row(k), Rows.Next(), row_size);
+        if (y0 + n < height)
+            std::memcpy(band.Row(n + 1), Rows.Next(), row_size);
+        else if (Wrap)
+            std::memcpy(band.Row(n + 1), below.data(), row_size);
+        if (y0 == 0 && Wrap)
+            std::memcpy(band.Row(0), above.data(), row_size);
+        Pool.ParallelFor(n, [&](std::size_t Begin, std::size_t End) {
+            std::vector<float> normals(3 * std::size_t(width));
+            std::vector<std::int16_t> encoded;
+            std::vector<char> buffer;
+            for (std::size_t k = Begin; k < End; ++k) {
+                const std::size_t y = y0 + k;
+                const float* row = band.Row(k + 1);
+                const bool top = y == 0 && !Wrap;
+                const bool bottom = y + 1 == height && !Wrap;
+                NormalRow(normals.data(), top ? row : band.Row(k), row,
+                    bottom ? row : band.Row(k + 2), width, xscale,
+                    (top || bottom) ? 2.0f * xscale : xscale, Wrap);
+                std::ostringstream text;
+                if (Encoding == NormalOctahedral) {
+                    encoded.resize(2 * std::size_t(width));
+                    OctahedralRow(encoded.data(), normals.data(), width);
+                    Format.WriteGroups(
+                        text, encoded.data(), width, 2, y != 0, buffer);
+                } else
+                    Format.WriteGroups(
+                        text, normals.data(), width, 3, y != 0, buffer);
+                texts[k] = text.str();
+            }
+        });
+        for (std::uint32_t k = 0; k < n; ++k)
+            Out << texts[k];
+        if (y0 + n < height) {
+            std::memcpy(band.Row(0), band.Row(n), row_size);
+            std::memcpy(band.Row(1), band.Row(n + 1), row_size);
+        }
+    }
+    Out << ']';
+}
+
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+
+TEST_CASE("NormalRow") {
+    std::vector<float> up(11), row(11), down(11), out(33);
+    for (std::size_t x = 0; x < 11; ++x) {
+        up[x] = 0.0f;
+        row[x] = float(x);
+        down[x] = 2.0f;
+    }
+    SUBCASE("Slopes") {
+        NormalRow(out.data(), up.data(), row.data(), down.data(), 11,
+            0.5f, 0.25f, false);
+        // Slope 1 along x and 0.5 along y everywhere.
+        const float inv = 1.0f / std::sqrt(1.0f + 0.25f + 1.0f);
+        for (std::size_t x = 0; x < 11; ++x) {
+            REQUIRE(out[3 * x] == doctest::Approx(-inv));
+            REQUIRE(out[3 * x + 1] == doctest::Approx(-0.5f * inv));
+            REQUIRE(out[3 * x + 2] == doctest::Approx(inv));
+        }
+    }
+    SUBCASE("Wrap") {
+        NormalRow(out.data(), up.data(), row.data(), down.data(), 11,
+            0.5f, 0.0f, true);
+        // Neighbours of the edges are at 10 and 1, and at 9 and 0.
+        REQUIRE(out[0] == doctest::Approx(
+            -((1.0f - 10.0f) * 0.5f) / std::sqrt(20.25f + 1.0f)));
+        REQUIRE(out[30] == out[0]);
+        REQUIRE(out[3] == doctest::Approx(-1.0f / std::sqrt(2.0f)));
+    }
+}
+
+TEST_CASE("OctahedralRow") {
+    const float n[9] = { 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, -0.6f, -0.8f };
+    std::int16_t out[6];
+    OctahedralRow(out, n, 3);
+    REQUIRE(out[0] == 0);
+    REQUIRE(out[1] == 0);
+    REQUIRE(out[2] == 32767);
+    REQUIRE(out[3] == 0);
+    REQUIRE(out[4] == 32767 * 4 / 7);
+    REQUIRE(out[5] == -32767);
+}
+
+TEST_CASE("WriteNormals") {
+    HeightField hf;
+    for (int y = 0; y < 3; ++y)
+        hf.push_back(std::vector<float> { 0.0f, float(y), 0.0f });
+    HeightFieldRowReader rows(hf, {});
+    ThreadPool pool(2);
+    std::ostringstream out;
+    SUBCASE("Edges") {
+        WriteNormals(out, rows, 1.0f, 1.0f, false, NormalXYZ,
+            NumberFormat(3), pool);
+        REQUIRE(out.str() == "[[0,0,1],[0,-0.707,0.707],[0,0,1],"
+            "[-0.707,0,0.707],[0,-0.707,0.707],[0.707,0,0.707],"
+            "[-0.894,0,0.447],[0,-0.707,0.707],[0.894,0,0.447]]");
+    }
+    SUBCASE("Wrap") {
+        WriteNormals(out, rows, 1.0f, 1.0f, true, NormalOctahedral,
+            NumberFormat(), pool);
+        REQUIRE(out.str() == "[[0,0],[0,10922],[0,0],"
+            "[-10922,0],[0,-16384],[10922,0],[-16384,0],[0,10922],[16384,0]]");
+    }
+}
+
+// Normals written by WriteNormals for Field as numbers.
+static std::vector<float> written_normals(const HeightField& Field, bool Wrap)
+{
+    HeightFieldRowReader rows(Field, {});
+    ThreadPool pool(2);
+    std::ostringstream out;
+    WriteNormals(out, rows, 1.0f, 1.0f, Wrap, NormalXYZ, NumberFormat(),
+        pool);
+    std::string text(out.str());
+    std::replace_if(text.begin(), text.end(),
+        [](char C) { return C == '[' || C == ']' || C == ','; }, ' ');
+    std::istringstream in(text);
+    std::vector<float> values;
+    float v;
+    while (in >> v)
+        values.push_back(v);
+    return values;
+}
+
+TEST_CASE("WriteNormals wrap") {
+    SUBCASE("Seams like interior") {
+        // Periodic field without the repeated high edges, like renderchanges
+        // output, and the same field rolled so that the seams are inside.
+        const std::uint32_t width = 16, height = 12, dx = 7, dy = 5;
+        const double turn = 2.0 * 3.14159265358979323846;
+        HeightField field(width, height), rolled(width, height);
+        for (std::uint32_t y = 0; y < height; ++y)
+            for (std::uint32_t x = 0; x < width; ++x) {
+                const float value = float(
+                    std::sin(turn * x / width) +
+                    std::cos(2.0 * turn * y / height) +
+                    0.5 * std::sin(turn * (x + 2.0 * y) / width));
+                field.Row(y)[x] = value;
+                rolled.Row((y + dy) % height)[(x + dx) % width] = value;
+            }
+        const std::vector<float> a = written_normals(field, true);
+        const std::vector<float> b = written_normals(rolled, true);
+        REQUIRE(a.size() == 3 * width * height);
+        REQUIRE(b.size() == a.size());
+        for (std::uint32_t y = 0; y < height; ++y)
+            for (std::uint32_t x = 0; x < width; ++x)
+                for (std::uint32_t c = 0; c < 3; ++c)
+                    REQUIRE(a[3 * (y * width + x) + c] == b[3 * (
+                        ((y + dy) % height) * width + (x + dx) % width) + c]);
+    }
+    SUBCASE("Two rows") {
+        // Both neighbours of each row are the other row.
+        HeightField field;
+        field.push_back(std::vector<float> { 2.0f, 2.0f, 2.0f });
+        field.push_back(std::vector<float> { 1.0f, 1.0f, 1.0f });
+        const std::vector<float> n = written_normals(field, true);
+        REQUIRE(n.size() == 18);
+        for (std::size_t k = 0; k < n.size(); k += 3) {
+            REQUIRE(n[k] == 0.0f);
+            REQUIRE(n[k + 1] == 0.0f);
+            REQUIRE(n[k + 2] == 1.0f);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,50 @@
+//
+//  normals.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(NORMALS_HPP)
+#define NORMALS_HPP
+
+// Vertex normals of a height field mesh from central differences of the
+// neighbouring heights. At the edges the difference is one-sided, or taken
+// over the edge of a wrap-around map where the first row and column follow
+// the last ones, as in the maps of renderchanges.
+
+#include "heightfieldfile.hpp"
+#include "numberformat.hpp"
+#include "threadpool.hpp"
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+
+enum NormalEncoding {
+    NormalXYZ,
+    NormalOctahedral // Two int16 values per normal.
+};
+
+// Throws if Name is not xyz or octahedral.
+NormalEncoding NormalEncodingFromName(const std::string& Name);
+
+// Writes x, y, and z of the unit normal of each of Count vertices of Row to
+// Out. Up and Down are the rows before and after Row. XScale and YScale
+// multiply the height differences of the neighbours to get the slopes.
+void NormalRow(float* Out, const float* Up, const float* Row,
+    const float* Down, std::size_t Count, float XScale, float YScale,
+    bool Wrap);
+
+// Writes X and Y of the octahedral mapping of Count unit normals to Out.
+void OctahedralRow(std::int16_t* Out, const float* Normals, std::size_t Count);
+
+// Array of normals, one per vertex. Rows are read in blocks and the normals
+// of a block are found and formatted in parallel.
+void WriteNormals(std::ostream& Out, HeightFieldRowReader& Rows,
+    float Spacing, float ZScale, bool Wrap, NormalEncoding Encoding,
+    const NumberFormat& Format, ThreadPool& Pool);
+
+#endif
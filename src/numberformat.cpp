@@ -0,0 +1,422 @@
+//
+//  numberformat.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "numberformat.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <random>
+#include <sstream>
+#endif
+
+
+char* FormatShortest(float V, char* Out) {
+#if defined(__cpp_lib_to_chars)
+    return std::to_chars(Out, Out + MaxNumberLength, V).ptr;
+#else
+    // Fewest digits that read back as the same value.
+    for (int digits = 1; ; ++digits) {
+        int count = std::snprintf(Out, MaxNumberLength, "%.*g", digits, V);
+        if (digits == 9 || std::strtof(Out, nullptr) == V)
+            return Out + count;
+    }
+#endif
+}
+
+char* FormatShortest(double V, char* Out) {
+#if defined(__cpp_lib_to_chars)
+    return std::to_chars(Out, Out + MaxNumberLength, V).ptr;
+#else
+    for (int digits = 1; ; ++digits) {
+        int count = std::snprintf(Out, MaxNumberLength, "%.*g", digits, V);
+        if (digits == 17 || std::strtod(Out, nullptr) == V)
+            return Out + count;
+    }
+#endif
+}
+
+// Powers of ten as double, correctly rounded.
+static const int pow10_min = -80;
+static const int pow10_max = 80;
+
+static const double* powers10_table() {
+    static double table[pow10_max - pow10_min + 1];
+    static bool filled = false;
+    if (!filled) {
+        for (int k = pow10_min; k <= pow10_max; ++k)
+            table[k - pow10_min] =
+                std::strtod(("1e" + std::to_string(k)).c_str(), nullptr);
+        filled = true;
+    }
+    return table;
+}
+
+static const double* const powers10 = powers10_table() - pow10_min;
+
+static const std::uint32_t pow10_int[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// Decimal exponent of positive finite V, from an estimate that may be one
+// too small.
+static int exponent10(double V, int Estimate) {
+    if (powers10[Estimate + 1] <= V)
+        return Estimate + 1;
+    if (V < powers10[Estimate])
+        return Estimate - 1;
+    return Estimate;
+}
+
+// V scaled so that its integer part has Digits digits.
+static double scaled(double V, int Digits, int Exponent) {
+    const int k = Digits - 1 - Exponent;
+    // Division by an exact power keeps ties such as 12345 / 10 exact.
+    return (0 <= k) ? V * powers10[k] : V / powers10[-k];
+}
+
+// Writes Mantissa of at most Digits digits, with decimal exponent Exponent
+// for the first digit, without trailing zeros after the decimal point. Unlike
+// %g, the choice of notation depends on the digits left: exponent notation is
+// used when Exponent is below -4 or when plain notation would end in more
+// than five zeros. Exponent has no plus sign and no leading zeros.
+static char* place(char* Out, bool Negative, std::uint32_t Mantissa,
+    int Digits, int Exponent)
+{
+    if (Mantissa >= pow10_int[Digits]) { // Rounding carried to a new digit.
+        Mantissa /= 10;
+        ++Exponent;
+    }
+    while (Digits > 1 && Mantissa % 10 == 0) {
+        Mantissa /= 10;
+        --Digits;
+    }
+    char digits[10];
+    for (int k = Digits - 1; 0 <= k; --k) {
+        digits[k] = '0' + Mantissa % 10;
+        Mantissa /= 10;
+    }
+    if (Negative)
+        *Out++ = '-';
+    if (Exponent < -4 || Digits + 4 < Exponent) {
+        *Out++ = digits[0];
+        if (Digits > 1) {
+            *Out++ = '.';
+            std::memcpy(Out, digits + 1, Digits - 1);
+            Out += Digits - 1;
+        }
+        *Out++ = 'e';
+        if (Exponent < 0) {
+            *Out++ = '-';
+            Exponent = -Exponent;
+        }
+        return std::to_chars(Out, Out + 4, Exponent).ptr;
+    }
+    if (Exponent < 0) {
+        *Out++ = '0';
+        *Out++ = '.';
+        for (int k = Exponent + 1; k < 0; ++k)
+            *Out++ = '0';
+        std::memcpy(Out, digits, Digits);
+        return Out + Digits;
+    }
+    for (int k = 0; k <= Exponent; ++k)
+        *Out++ = (k < Digits) ? digits[k] : '0';
+    if (Exponent + 1 < Digits) {
+        *Out++ = '.';
+        std::memcpy(Out, digits + Exponent + 1, Digits - Exponent - 1);
+        Out += Digits - Exponent - 1;
+    }
+    return Out;
+}
+
+static bool plain(double V) {
+    // Zero, infinities, NaN and values out of table range are rare.
+    return V != 0.0 && std::isfinite(V) &&
+        1e-70 < std::fabs(V) && std::fabs(V) < 1e70;
+}
+
+char* FormatFixed(double V, int Digits, char* Out) {
+    if (!plain(V))
+        return FormatShortest(V, Out);
+    Digits = (Digits < 1) ? 1 : ((Digits > 9) ? 9 : Digits);
+    const bool negative = V < 0.0;
+    V = std::fabs(V);
+    int e2;
+    std::frexp(V, &e2);
+    // log10(2) is about 1233 / 4096.
+    const int e = exponent10(V, ((e2 - 1) * 1233) >> 12);
+    const double m = std::nearbyint(scaled(V, Digits, e));
+    return place(Out, negative, static_cast<std::uint32_t>(m), Digits, e);
+}
+
+void FormatFixed(
+    const float* V, std::size_t Count, int Digits, std::vector<char>& Out)
+{
+    Digits = (Digits < 1) ? 1 : ((Digits > 9) ? 9 : Digits);
+    const std::size_t start = Out.size();
+    Out.resize(start + Count * MaxNumberLength);
+    char* pos = Out.data() + start;
+    std::size_t k = 0;
+#if defined(__SSE2__)
+    // Exponents of four values at a time from the float bits, then scaling
+    // and rounding two at a time.
+    const __m128i exponent_mask = _mm_set1_epi32(0xff);
+    const __m128i bias = _mm_set1_epi32(127);
+    for (; k + 4 <= Count; k += 4) {
+        bool usual = true;
+        for (std::size_t n = 0; n < 4; ++n)
+            usual = usual && plain(V[k + n]) &&
+                std::fpclassify(V[k + n]) == FP_NORMAL;
+        if (!usual) {
+            for (std::size_t n = 0; n < 4; ++n) {
+                if (k + n)
+                    *pos++ = ',';
+                pos = FormatFixed(static_cast<double>(V[k + n]), Digits, pos);
+            }
+            continue;
+        }
+        __m128i bits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(V + k));
+        __m128i e2 = _mm_sub_epi32(
+            _mm_and_si128(_mm_srli_epi32(bits, 23), exponent_mask), bias);
+        // e2 * 1233 >> 12 estimates floor(e2 * log10(2)). SSE2 has no 32-bit
+        // multiply so 1233 = 1024 + 128 + 64 + 16 + 1 is used.
+        __m128i est = _mm_add_epi32(
+            _mm_add_epi32(_mm_slli_epi32(e2, 10), _mm_slli_epi32(e2, 7)),
+            _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(e2, 6),
+                _mm_slli_epi32(e2, 4)), e2));
+        est = _mm_srai_epi32(est, 12);
+        alignas(16) std::int32_t estimate[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(estimate), est);
+        int e[4];
+        alignas(16) double mul[4], div[4], mag[4];
+        for (std::size_t n = 0; n < 4; ++n) {
+            mag[n] = std::fabs(static_cast<double>(V[k + n]));
+            e[n] = exponent10(mag[n], estimate[n]);
+            const int s = Digits - 1 - e[n];
+            mul[n] = (0 <= s) ? powers10[s] : 1.0;
+            div[n] = (0 <= s) ? 1.0 : powers10[-s];
+        }
+        alignas(16) std::int32_t m[4];
+        for (std::size_t n = 0; n < 4; n += 2) {
+            __m128d p = _mm_div_pd(
+                _mm_mul_pd(_mm_load_pd(mag + n), _mm_load_pd(mul + n)),
+                _mm_load_pd(div + n));
+            // Rounds to nearest even like nearbyint.
+            __m128i r = _mm_cvtpd_epi32(p);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(m + n), r);
+        }
+        for (std::size_t n = 0; n < 4; ++n) {
+            if (k + n)
+                *pos++ = ',';
+            pos = place(pos, V[k + n] < 0.0f, m[n], Digits, e[n]);
+        }
+    }
+#endif
+    for (; k < Count; ++k) {
+        if (k)
+            *pos++ = ',';
+        pos = FormatFixed(static_cast<double>(V[k]), Digits, pos);
+    }
+    Out.resize(pos - Out.data());
+}
+
+const int NumberFormat::MaxPrecision;
+
+NumberFormat::NumberFormat(unsigned int Precision)
+    : precision((Precision > unsigned(MaxPrecision)) ? MaxPrecision : Precision)
+{ }
+
+void NumberFormat::append(std::vector<char>& Out, float V) const {
+    const std::size_t start = Out.size();
+    Out.resize(start + MaxNumberLength);
+    char* end = precision ? FormatFixed(static_cast<double>(V), precision,
+        Out.data() + start) : FormatShortest(V, Out.data() + start);
+    Out.resize(end - Out.data());
+}
+
+void NumberFormat::append(std::vector<char>& Out, double V) const {
+    const std::size_t start = Out.size();
+    Out.resize(start + MaxNumberLength);
+    char* end = precision ? FormatFixed(V, precision, Out.data() + start) :
+        FormatShortest(V, Out.data() + start);
+    Out.resize(end - Out.data());
+}
+
+void NumberFormat::append(std::vector<char>& Out, std::uint32_t V) const {
+    const std::size_t start = Out.size();
+    Out.resize(start + MaxNumberLength);
+    char* end = std::to_chars(
+        Out.data() + start, Out.data() + Out.size(), V).ptr;
+    Out.resize(end - Out.data());
+}
+
+void NumberFormat::append(std::vector<char>& Out, std::int16_t V) const {
+    const std::size_t start = Out.size();
+    Out.resize(start + MaxNumberLength);
+    char* end = std::to_chars(
+        Out.data() + start, Out.data() + Out.size(), V).ptr;
+    Out.resize(end - Out.data());
+}
+
+void NumberFormat::append(
+    std::vector<char>& Out, const float* V, std::size_t Count) const
+{
+    Out.push_back('[');
+    if (precision)
+        FormatFixed(V, Count, precision, Out);
+    else
+        for (std::size_t k = 0; k < Count; ++k) {
+            if (k)
+                Out.push_back(',');
+            append(Out, V[k]);
+        }
+    Out.push_back(']');
+}
+
+void NumberFormat::append(
+    std::vector<char>& Out, const std::vector<float>& V) const
+{
+    append(Out, V.data(), V.size());
+}
+
+void NumberFormat::WriteGroups(std::ostream& Out, const float* V,
+    std::size_t Groups, std::size_t Group, bool Comma,
+    std::vector<char>& Buffer) const
+{
+    Buffer.resize(0);
+    for (std::size_t k = 0; k < Groups; ++k) {
+        if (k || Comma)
+            Buffer.push_back(',');
+        append(Buffer, V + k * Group, Group);
+        if (Buffer.size() > 65536) {
+            Out.write(Buffer.data(), Buffer.size());
+            Buffer.resize(0);
+        }
+    }
+    Out.write(Buffer.data(), Buffer.size());
+}
+
+#if defined(UNITTEST)
+
+static std::string shortest(float V) {
+    char buf[MaxNumberLength];
+    return std::string(buf, FormatShortest(V, buf));
+}
+
+static std::string fixed(double V, int Digits) {
+    char buf[MaxNumberLength];
+    return std::string(buf, FormatFixed(V, Digits, buf));
+}
+
+TEST_CASE("FormatShortest") {
+    REQUIRE(shortest(0.1f) == "0.1");
+    REQUIRE(shortest(1.0f) == "1");
+    REQUIRE(shortest(-2.5f) == "-2.5");
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<float> dist(-1000.0f, 1000.0f);
+    for (int k = 0; k < 10000; ++k) {
+        float v = dist(gen);
+        REQUIRE(std::strtof(shortest(v).c_str(), nullptr) == v);
+    }
+    char buf[MaxNumberLength];
+    const double d = 0.1 + 0.2;
+    *FormatShortest(d, buf) = 0;
+    REQUIRE(std::strtod(buf, nullptr) == d);
+}
+
+TEST_CASE("FormatFixed") {
+    REQUIRE(fixed(1.0, 4) == "1");
+    REQUIRE(fixed(-0.5, 4) == "-0.5");
+    REQUIRE(fixed(123.456, 4) == "123.5");
+    REQUIRE(fixed(99.99, 2) == "100");
+    REQUIRE(fixed(0.00012345, 3) == "0.000123");
+    REQUIRE(fixed(1.2345e-7, 3) == "1.23e-7");
+    REQUIRE(fixed(12345678.0, 3) == "12300000");
+    REQUIRE(fixed(1.5e12, 3) == "1.5e12");
+    REQUIRE(fixed(0.0, 3) == "0");
+    SUBCASE("Notation thresholds") {
+        REQUIRE(fixed(0.0001, 3) == "0.0001");
+        REQUIRE(fixed(-0.00001, 3) == "-1e-5");
+        REQUIRE(fixed(0.000012345, 3) == "1.23e-5");
+        REQUIRE(fixed(100000.0, 3) == "100000");
+        REQUIRE(fixed(1000000.0, 3) == "1e6");
+        REQUIRE(fixed(123000000.0, 3) == "1.23e8");
+        REQUIRE(fixed(12300000.0, 9) == "12300000");
+        REQUIRE(fixed(999999.9, 3) == "1e6");
+        REQUIRE(fixed(123456789.0, 9) == "123456789");
+    }
+    SUBCASE("Matches printf") {
+        std::mt19937 gen(7);
+        std::uniform_real_distribution<float> dist(-3.0f, 6.0f);
+        char buf[MaxNumberLength];
+        for (int k = 0; k < 20000; ++k) {
+            float v = std::pow(10.0f, dist(gen)) * ((k & 1) ? -1.0f : 1.0f);
+            for (int digits = 1; digits <= 9; digits += 2) {
+                std::snprintf(buf, sizeof(buf), "%.*g", digits, v);
+                REQUIRE(std::strtod(fixed(v, digits).c_str(), nullptr) ==
+                    std::strtod(buf, nullptr));
+            }
+        }
+    }
+    SUBCASE("Batch") {
+        std::vector<float> values { 1.0f, -2.5f, 1234.5678f, 0.0f, 3e-9f,
+            7.0f, 1e20f, 0.015625f, 42.0f };
+        std::vector<char> out;
+        FormatFixed(values.data(), values.size(), 4, out);
+        std::string expected;
+        for (std::size_t k = 0; k < values.size(); ++k)
+            expected += (k ? "," : "") + fixed(values[k], 4);
+        REQUIRE(std::string(out.begin(), out.end()) == expected);
+    }
+}
+
+TEST_CASE("NumberFormat") {
+    std::vector<std::vector<float>> v { { 1.0f, 0.25f }, { } };
+    std::vector<char> buffer;
+    std::ostringstream out;
+    NumberFormat(0).Write(out, v, buffer);
+    REQUIRE(out.str() == "[[1,0.25],[]]");
+    std::vector<double> d { 0.123456789, 2.0 };
+    out.str("");
+    NumberFormat(3).Write(out, d, buffer);
+    REQUIRE(out.str() == "[0.123,2]");
+    std::vector<std::vector<std::uint32_t>> i { { 1, 20 } };
+    out.str("");
+    NumberFormat(30).Write(out, i, buffer);
+    REQUIRE(out.str() == "[[1,20]]");
+    REQUIRE(NumberFormat(30).Precision() == NumberFormat::MaxPrecision);
+    out.str("");
+    NumberFormat(0).WriteItems(out, v, false, buffer);
+    NumberFormat(0).WriteItems(out, d, true, buffer);
+    NumberFormat(0).WriteItems(out, std::vector<float>(), true, buffer);
+    REQUIRE(out.str() == "[1,0.25],[],0.123456789,2");
+    out.str("");
+    const float g[4] = { 1.0f, 2.0f, 0.5f, 4.0f };
+    NumberFormat(0).WriteGroups(out, g, 2, 2, true, buffer);
+    NumberFormat(0).WriteGroups(out, g, 1, 0, true, buffer);
+    REQUIRE(out.str() == ",[1,2],[0.5,4],[]");
+    out.str("");
+    const std::uint16_t q[4] = { 0, 65535, 7, 1 };
+    NumberFormat(3).WriteGroups(out, q, 2, 2, false, buffer);
+    NumberFormat(3).WriteGroups(out, q, 1, 1, true, buffer);
+    REQUIRE(out.str() == "[0,65535],[7,1],[0]");
+    out.str("");
+    const std::int16_t s[2] = { -32767, 5 };
+    NumberFormat().WriteGroups(out, s, 1, 2, true, buffer);
+    REQUIRE(out.str() == ",[-32767,5]");
+}
+
+#endif
@@ -0,0 +1,138 @@
+//
+//  numberformat.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(NUMBERFORMAT_HPP)
+#define NUMBERFORMAT_HPP
+
+// Number to text conversion for JSON output. Either the shortest text that
+// reads back as the same value, or a given number of significant digits.
+
+#include <vector>
+#include <ostream>
+#include <cstddef>
+#include <cstdint>
+
+
+// Longest text any of the functions below produce.
+const std::size_t MaxNumberLength = 32;
+
+// Writes the shortest text that parses back to V. Returns end of text.
+char* FormatShortest(float V, char* Out);
+char* FormatShortest(double V, char* Out);
+
+// Writes V rounded to Digits significant digits, 1 to 9, with trailing
+// zeros removed. Returns end of text.
+char* FormatFixed(double V, int Digits, char* Out);
+
+// Appends comma-separated values rounded to Digits significant digits.
+void FormatFixed(
+    const float* V, std::size_t Count, int Digits, std::vector<char>& Out);
+
+class NumberFormat {
+private:
+    int precision;
+
+    void append(std::vector<char>& Out, float V) const;
+    void append(std::vector<char>& Out, double V) const;
+    void append(std::vector<char>& Out, std::uint32_t V) const;
+    void append(std::vector<char>& Out, std::uint16_t V) const {
+        append(Out, std::uint32_t(V));
+    }
+    void append(std::vector<char>& Out, std::int16_t V) const;
+    void append(std::vector<char>& Out, const float* V,
+        std::size_t Count) const;
+    void append(std::vector<char>& Out, const std::vector<float>& V) const;
+
+    template<typename T>
+    void append(std::vector<char>& Out, const std::vector<T>& V) const {
+        Out.push_back('[');
+        for (std::size_t k = 0; k < V.size(); ++k) {
+            if (k)
+                Out.push_back(',');
+            append(Out, V[k]);
+        }
+        Out.push_back(']');
+    }
+
+public:
+    static const int MaxPrecision = 9;
+
+    // Zero gives the shortest text. Larger values are limited to
+    // MaxPrecision.
+    NumberFormat(unsigned int Precision = 0);
+    int Precision() const { return precision; }
+
+    // Writes V as JSON array using Buffer, writing to Out whenever Buffer
+    // has grown large.
+    template<typename T>
+    void Write(std::ostream& Out, const std::vector<T>& V,
+        std::vector<char>& Buffer) const
+    {
+        Buffer.resize(0);
+        Buffer.push_back('[');
+        for (std::size_t k = 0; k < V.size(); ++k) {
+            if (k)
+                Buffer.push_back(',');
+            append(Buffer, V[k]);
+            if (Buffer.size() > 65536) {
+                Out.write(Buffer.data(), Buffer.size());
+                Buffer.resize(0);
+            }
+        }
+        Buffer.push_back(']');
+        Out.write(Buffer.data(), Buffer.size());
+    }
+
+    // Writes the items of V without the brackets, preceded by a comma if
+    // Comma is true and V is not empty. For arrays written a part at a time.
+    template<typename T>
+    void WriteItems(std::ostream& Out, const std::vector<T>& V, bool Comma,
+        std::vector<char>& Buffer) const
+    {
+        Buffer.resize(0);
+        for (std::size_t k = 0; k < V.size(); ++k) {
+            if (k || Comma)
+                Buffer.push_back(',');
+            append(Buffer, V[k]);
+            if (Buffer.size() > 65536) {
+                Out.write(Buffer.data(), Buffer.size());
+                Buffer.resize(0);
+            }
+        }
+        Out.write(Buffer.data(), Buffer.size());
+    }
+
+    // Writes Groups arrays of Group values each from V like WriteItems.
+    void WriteGroups(std::ostream& Out, const float* V, std::size_t Groups,
+        std::size_t Group, bool Comma, std::vector<char>& Buffer) const;
+    // Integer version of the above.
+    template<typename T>
+    void WriteGroups(std::ostream& Out, const T* V, std::size_t Groups,
+        std::size_t Group, bool Comma, std::vector<char>& Buffer) const
+    {
+        Buffer.resize(0);
+        for (std::size_t k = 0; k < Groups; ++k) {
+            if (k || Comma)
+                Buffer.push_back(',');
+            Buffer.push_back('[');
+            for (std::size_t n = 0; n < Group; ++n) {
+                if (n)
+                    Buffer.push_back(',');
+                append(Buffer, V[k * Group + n]);
+            }
+            Buffer.push_back(']');
+            if (Buffer.size() > 65536) {
+                Out.write(Buffer.data(), Buffer.size());
+                Buffer.resize(0);
+            }
+        }
+        Out.write(Buffer.data(), Buffer.size());
+    }
+};
+
+#endif
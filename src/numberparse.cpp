@@ -0,0 +1,481 @@
+//
+//  numberparse.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "numberparse.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cfloat>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <cstdio>
+#include <random>
+#include <algorithm>
+#endif
+
+
+static bool number_char(char C) {
+    return ('0' <= C && C <= '9') || C == '-' || C == '.' || C == 'e' ||
+        C == 'E' || C == '+';
+}
+
+const char* FindNumberEnd(const char* Begin, const char* End) {
+#if defined(__SSE2__)
+    // A character is in the number if it is a digit or one of "+-.eE".
+    const __m128i zero = _mm_set1_epi8('0' - 1);
+    const __m128i nine = _mm_set1_epi8('9' + 1);
+    const __m128i minus = _mm_set1_epi8('-');
+    const __m128i plus = _mm_set1_epi8('+');
+    const __m128i dot = _mm_set1_epi8('.');
+    const __m128i lower_e = _mm_set1_epi8('e');
+    const __m128i upper_e = _mm_set1_epi8('E');
+    while (Begin + 16 <= End) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Begin));
+        __m128i in = _mm_and_si128(
+            _mm_cmpgt_epi8(c, zero), _mm_cmplt_epi8(c, nine));
+        in = _mm_or_si128(in, _mm_cmpeq_epi8(c, minus));
+        in = _mm_or_si128(in, _mm_cmpeq_epi8(c, plus));
+        in = _mm_or_si128(in, _mm_cmpeq_epi8(c, dot));
+        in = _mm_or_si128(in, _mm_cmpeq_epi8(c, lower_e));
+        in = _mm_or_si128(in, _mm_cmpeq_epi8(c, upper_e));
+        unsigned int outside = ~_mm_movemask_epi8(in) & 0xffffu;
+        if (outside)
+            return Begin + __builtin_ctz(outside);
+        Begin += 16;
+    }
+#endif
+    while (Begin != End && number_char(*Begin))
+        ++Begin;
+    return Begin;
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static bool eight_digits(const char* Pos) {
+    std::uint64_t v;
+    std::memcpy(&v, Pos, 8);
+    return (((v & 0xF0F0F0F0F0F0F0F0ULL) |
+        (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+        0x3333333333333333ULL);
+}
+
+static std::uint32_t parse_eight_digits(const char* Pos) {
+    std::uint64_t v;
+    std::memcpy(&v, Pos, 8);
+    v = (v & 0x0F0F0F0F0F0F0F0FULL) * 2561 >> 8;
+    v = (v & 0x00FF00FF00FF00FFULL) * 6553601 >> 16;
+    return static_cast<std::uint32_t>(
+        (v & 0x0000FFFF0000FFFFULL) * 42949672960001ULL >> 32);
+}
+#endif
+
+struct Decimal {
+    std::uint64_t mantissa;
+    int exponent; // Power of ten.
+    bool negative;
+    bool exact; // Fits in mantissa without dropping digits.
+};
+
+// Checks JSON number syntax and collects up to 19 significant digits.
+static bool decimal(const char* Begin, const char* End, Decimal& D) {
+    D.mantissa = 0;
+    D.exponent = 0;
+    D.exact = true;
+    D.negative = (Begin != End && *Begin == '-');
+    if (D.negative)
+        ++Begin;
+    const char* start = Begin;
+    int digits = 0;
+    int dropped = 0;
+    while (Begin != End && '0' <= *Begin && *Begin <= '9') {
+        if (digits < 19) {
+            D.mantissa = 10 * D.mantissa + (*Begin - '0');
+            if (D.mantissa)
+                ++digits;
+        } else {
+            ++dropped;
+            D.exact = false;
+        }
+        ++Begin;
+    }
+    if (Begin == start)
+        return false;
+    D.exponent = dropped;
+    if (Begin != End && *Begin == '.') {
+        const char* fraction = ++Begin;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        while (digits + 8 <= 19 && Begin + 8 <= End && eight_digits(Begin)) {
+            D.mantissa = 100000000ULL * D.mantissa + parse_eight_digits(Begin);
+            if (D.mantissa)
+                digits += 8;
+            D.exponent -= 8;
+            Begin += 8;
+        }
+#endif
+        while (Begin != End && '0' <= *Begin && *Begin <= '9') {
+            if (digits < 19) {
+                D.mantissa = 10 * D.mantissa + (*Begin - '0');
+                if (D.mantissa)
+                    ++digits;
+                --D.exponent;
+            } else
+                D.exact = false;
+            ++Begin;
+        }
+        if (Begin == fraction)
+            return false;
+    }
+    if (Begin != End && (*Begin == 'e' || *Begin == 'E')) {
+        ++Begin;
+        bool negative = false;
+        if (Begin != End && (*Begin == '-' || *Begin == '+'))
+            negative = (*Begin++ == '-');
+        const char* start_exp = Begin;
+        int exp = 0;
+        while (Begin != End && '0' <= *Begin && *Begin <= '9') {
+            if (exp < 100000)
+                exp = 10 * exp + (*Begin - '0');
+            ++Begin;
+        }
+        if (Begin == start_exp)
+            return false;
+        D.exponent += negative ? -exp : exp;
+    }
+    return Begin == End;
+}
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Clinger's fast path: exact mantissa and power of ten give one rounding.
+static bool fast_double(const Decimal& D, double& Out) {
+    if (!D.exact || (1ULL << 53) < D.mantissa ||
+        D.exponent < -22 || 22 < D.exponent)
+        return false;
+    double v = static_cast<double>(D.mantissa);
+    if (D.exponent < 0)
+        v /= powers_of_ten[-D.exponent];
+    else
+        v *= powers_of_ten[D.exponent];
+    Out = D.negative ? -v : v;
+    return true;
+}
+
+static bool fallback(const char* Begin, const char* End, float& Out) {
+    std::string s(Begin, End);
+    Out = std::strtof(s.c_str(), nullptr);
+    return true;
+}
+
+static bool fallback(const char* Begin, const char* End, double& Out) {
+    std::string s(Begin, End);
+    Out = std::strtod(s.c_str(), nullptr);
+    return true;
+}
+
+bool ParseNumber(const char* Begin, const char* End, double& Out) {
+    Decimal d;
+    if (!decimal(Begin, End, d))
+        return false;
+    if (fast_double(d, Out))
+        return true;
+    return fallback(Begin, End, Out);
+}
+
+bool ParseNumber(const char* Begin, const char* End, float& Out) {
+    Decimal d;
+    if (!decimal(Begin, End, d))
+        return false;
+    double v;
+    if (fast_double(d, v)) {
+        // Rounding the correctly rounded double to float again gives the
+        // correctly rounded float unless the double is exactly half-way
+        // between two floats. Sub-normal and huge values take the slow path.
+        const double a = (v < 0.0) ? -v : v;
+        if (a == 0.0) {
+            Out = static_cast<float>(v);
+            return true;
+        }
+        if (FLT_MIN <= a && a <= FLT_MAX) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            const std::uint64_t dropped = (1ULL << 29) - 1;
+            if ((bits & dropped) != (1ULL << 28)) {
+                Out = static_cast<float>(v);
+                return true;
+            }
+        }
+    }
+    return fallback(Begin, End, Out);
+}
+
+template<typename Value>
+static const char* parse_row(
+    const char* Begin, const char* End, std::vector<Value>& Row)
+{
+    Row.resize(0);
+    while (Begin != End && (*Begin == ' ' || *Begin == '\n' ||
+        *Begin == '\r' || *Begin == '\t'))
+            ++Begin;
+    if (Begin == End || *Begin != '[')
+        throw std::runtime_error("Expected number array.");
+    bool need_value = false;
+    for (++Begin; Begin != End; ++Begin) {
+        const char c = *Begin;
+        if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+            continue;
+        if (c == ']') {
+            if (need_value)
+                break;
+            return Begin + 1;
+        }
+        if (c == ',') {
+            if (need_value || Row.empty())
+                break;
+            need_value = true;
+            continue;
+        }
+        if (!need_value && !Row.empty())
+            break;
+        const char* stop = FindNumberEnd(Begin, End);
+        Row.push_back(Value());
+        if (stop == Begin || !ParseNumber(Begin, stop, Row.back()))
+            throw std::runtime_error("Invalid number in number array.");
+        need_value = false;
+        Begin = stop - 1;
+    }
+    throw std::runtime_error("Invalid number array.");
+}
+
+const char* ParseNumberRow(
+    const char* Begin, const char* End, std::vector<float>& Row)
+{
+    return parse_row(Begin, End, Row);
+}
+
+const char* ParseNumberRow(
+    const char* Begin, const char* End, std::vector<double>& Row)
+{
+    return parse_row(Begin, End, Row);
+}
+
+static const char* bracket(const char* Base, const char* Pos, int& Depth,
+    std::vector<std::size_t>& Starts)
+{
+    if (*Pos == '[') {
+        if (Depth++ == 1)
+            Starts.push_back(Pos - Base);
+    } else if (*Pos == ']') {
+        if (--Depth == 0)
+            return Pos;
+    }
+    return nullptr;
+}
+
+const char* IndexRows(const char* Base, const char* Begin, const char* End,
+    int& Depth, std::vector<std::size_t>& Starts)
+{
+#if defined(__SSE2__)
+    const __m128i open = _mm_set1_epi8('[');
+    const __m128i close = _mm_set1_epi8(']');
+    while (Begin + 16 <= End) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Begin));
+        unsigned int mask = _mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(c, open), _mm_cmpeq_epi8(c, close)));
+        while (mask) {
+            const char* pos = Begin + __builtin_ctz(mask);
+            if (bracket(Base, pos, Depth, Starts) != nullptr)
+                return pos;
+            mask &= mask - 1;
+        }
+        Begin += 16;
+    }
+#endif
+    for (; Begin != End; ++Begin)
+        if (bracket(Base, Begin, Depth, Starts) != nullptr)
+            return Begin;
+    return End;
+}
+
+#if defined(UNITTEST)
+
+static bool parse_float(const char* S, float& Out) {
+    return ParseNumber(S, S + std::strlen(S), Out);
+}
+
+static bool parse_double(const char* S, double& Out) {
+    return ParseNumber(S, S + std::strlen(S), Out);
+}
+
+TEST_CASE("FindNumberEnd") {
+    const char* s = "-1.25e+3,4";
+    REQUIRE(FindNumberEnd(s, s + std::strlen(s)) == s + 8);
+    const char* l = "12345678901234567890.5]";
+    REQUIRE(FindNumberEnd(l, l + std::strlen(l)) == l + 22);
+    const char* e = "123";
+    REQUIRE(FindNumberEnd(e, e + 3) == e + 3);
+}
+
+TEST_CASE("ParseNumber syntax") {
+    float f;
+    REQUIRE(parse_float("0", f));
+    REQUIRE(f == 0.0f);
+    REQUIRE(parse_float("-0.5", f));
+    REQUIRE(f == -0.5f);
+    REQUIRE(parse_float("1e3", f));
+    REQUIRE(f == 1000.0f);
+    REQUIRE(!parse_float("", f));
+    REQUIRE(!parse_float("-", f));
+    REQUIRE(!parse_float("1.", f));
+    REQUIRE(!parse_float(".5", f));
+    REQUIRE(!parse_float("1e", f));
+    REQUIRE(!parse_float("1-2", f));
+}
+
+TEST_CASE("ParseNumber matches strtof and strtod") {
+    std::mt19937_64 rnd(7);
+    char buffer[64];
+    for (int k = 0; k < 200000; ++k) {
+        const std::uint64_t r = rnd();
+        double v;
+        std::memcpy(&v, &r, sizeof(v));
+        if (v != v || v - v != 0.0)
+            continue;
+        std::snprintf(buffer, sizeof(buffer), "%.*g", int(1 + k % 19), v);
+        float f;
+        REQUIRE(parse_float(buffer, f));
+        float ref = std::strtof(buffer, nullptr);
+        REQUIRE(std::memcmp(&f, &ref, sizeof(f)) == 0);
+        double d;
+        REQUIRE(parse_double(buffer, d));
+        double refd = std::strtod(buffer, nullptr);
+        REQUIRE(std::memcmp(&d, &refd, sizeof(d)) == 0);
+        // Typical output of a float writer.
+        std::snprintf(buffer, sizeof(buffer), "%.9g",
+            static_cast<double>(static_cast<float>(rnd() % 2000000) * 1e-3f - 1000.0f));
+        REQUIRE(parse_float(buffer, f));
+        ref = std::strtof(buffer, nullptr);
+        REQUIRE(std::memcmp(&f, &ref, sizeof(f)) == 0);
+    }
+}
+
+TEST_CASE("ParseNumber half-way float") {
+    // 1 + 2^-24 is half-way between 1 and the next float.
+    float f;
+    REQUIRE(parse_float("1.000000059604644775390625", f));
+    REQUIRE(f == 1.0f);
+    REQUIRE(parse_float("1.000000059604644775390626", f));
+    REQUIRE(f == std::strtof("1.000000059604644775390626", nullptr));
+}
+
+TEST_CASE("NumberArrayParser") {
+    NumberArrayParser<double> p;
+    std::vector<std::vector<double>> out;
+    SUBCASE("Whole") {
+        const char* s = "[[1, 2.5],[ -3e2 ] , []] ,";
+        const char* end = p.Parse(s, s + std::strlen(s), out);
+        REQUIRE(p.Finished());
+        REQUIRE(*end == ' ');
+        REQUIRE(out.size() == 3);
+        REQUIRE(out[0] == std::vector<double> { 1.0, 2.5 });
+        REQUIRE(out[1] == std::vector<double> { -300.0 });
+        REQUIRE(out[2].empty());
+    }
+    SUBCASE("Split at every position") {
+        const std::string s = "[[1.25,-2],[3e1,4]]";
+        for (std::size_t k = 0; k <= s.size(); ++k) {
+            p.Reset();
+            out.resize(0);
+            const char* b = s.data();
+            REQUIRE(p.Parse(b, b + k, out) == b + k);
+            if (k < s.size())
+                REQUIRE(p.Parse(b + k, b + s.size(), out) == b + s.size());
+            REQUIRE(p.Finished());
+            REQUIRE(out.size() == 2);
+            REQUIRE(out[0] == std::vector<double> { 1.25, -2.0 });
+            REQUIRE(out[1] == std::vector<double> { 30.0, 4.0 });
+        }
+    }
+    SUBCASE("Empty") {
+        const char* s = "[]";
+        p.Parse(s, s + 2, out);
+        REQUIRE(p.Finished());
+        REQUIRE(out.empty());
+    }
+    SUBCASE("Errors") {
+        const char* bad[] = { "[[1,,2]]", "[[1 2]]", "[1]", "[[[1]]]",
+            "[[1],,[2]]", "[[1][2]]", "[[\"a\"]]", "[[1,]]", "[,[1]]" };
+        for (const char* s : bad) {
+            p.Reset();
+            out.resize(0);
+            REQUIRE_THROWS(p.Parse(s, s + std::strlen(s), out));
+        }
+    }
+}
+
+TEST_CASE("ParseNumberRow") {
+    std::vector<double> row;
+    const char* s = " [1, -2.5e1 ,3] ,";
+    const char* end = ParseNumberRow(s, s + std::strlen(s), row);
+    REQUIRE(*end == ' ');
+    REQUIRE(row == std::vector<double> { 1.0, -25.0, 3.0 });
+    const char* e = "[]";
+    REQUIRE(ParseNumberRow(e, e + 2, row) == e + 2);
+    REQUIRE(row.empty());
+    const char* bad[] = { "[1,]", "[,1]", "[1 2]", "[1", "1]", "[[1]]", "[a]" };
+    for (const char* b : bad)
+        REQUIRE_THROWS(ParseNumberRow(b, b + std::strlen(b), row));
+}
+
+TEST_CASE("IndexRows") {
+    const std::string s = "[[1,2], [3,4],\n[5]] ,";
+    std::vector<std::size_t> starts;
+    int depth = 0;
+    SUBCASE("Whole") {
+        const char* end = IndexRows(s.data(), s.data(), s.data() + s.size(),
+            depth, starts);
+        REQUIRE(end == s.data() + 18);
+        REQUIRE(depth == 0);
+        REQUIRE(starts == std::vector<std::size_t> { 1, 8, 15 });
+    }
+    SUBCASE("Pieces") {
+        const char* end = nullptr;
+        for (std::size_t k = 0; k < s.size(); k += 3) {
+            const char* stop = s.data() + std::min(k + 3, s.size());
+            end = IndexRows(s.data(), s.data() + k, stop, depth, starts);
+            if (end != stop)
+                break;
+        }
+        REQUIRE(end == s.data() + 18);
+        REQUIRE(starts == std::vector<std::size_t> { 1, 8, 15 });
+    }
+    SUBCASE("Long") {
+        std::string l = "[";
+        for (int k = 0; k < 100; ++k)
+            l += (k ? ",[" : "[") + std::to_string(k) + ".125,1e-3 ]";
+        l += "]";
+        const char* end = IndexRows(l.data(), l.data(), l.data() + l.size(),
+            depth, starts);
+        REQUIRE(end == l.data() + l.size() - 1);
+        REQUIRE(starts.size() == 100);
+        ThreadPool pool(3);
+        std::vector<std::vector<double>> out(100);
+        ParseRows<double>(l.data(), l.size() - 1, starts, out, 0, pool);
+        for (int k = 0; k < 100; ++k)
+            REQUIRE(out[k] == std::vector<double> { k + 0.125, 1e-3 });
+        l[starts[50] - 1] = ' ';
+        REQUIRE_THROWS(
+            ParseRows<double>(l.data(), l.size() - 1, starts, out, 0, pool));
+    }
+}
+
+#endif
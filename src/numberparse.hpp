@@ -0,0 +1,182 @@
+//
+//  numberparse.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(NUMBERPARSE_HPP)
+#define NUMBERPARSE_HPP
+
+// Fast path for JSON arrays of arrays of numbers. Numbers are converted with
+// correct rounding; the rare ones the fast conversion can not handle go
+// through strtof or strtod.
+
+#include "threadpool.hpp"
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <stdexcept>
+
+
+// Returns the first character in range that can not be part of a number.
+const char* FindNumberEnd(const char* Begin, const char* End);
+
+// Parse the number that spans the whole range. False if it is not a number.
+bool ParseNumber(const char* Begin, const char* End, float& Out);
+bool ParseNumber(const char* Begin, const char* End, double& Out);
+
+// Parses one "[n, ...]" that starts at or after Begin, after whitespace.
+// Returns pointer past the closing bracket.
+const char* ParseNumberRow(
+    const char* Begin, const char* End, std::vector<float>& Row);
+const char* ParseNumberRow(
+    const char* Begin, const char* End, std::vector<double>& Row);
+
+// Appends to Starts the offset from Base of each '[' in range, and returns
+// the closing bracket of the outer array, or End if not in range. Depth is
+// the number of open arrays at Begin, and is updated. Valid only for arrays
+// of arrays of numbers, as strings are not recognized.
+const char* IndexRows(const char* Base, const char* Begin, const char* End,
+    int& Depth, std::vector<std::size_t>& Starts);
+
+// Copies the parsed row to the row Y of the container.
+template<typename Value>
+void StoreRow(std::vector<std::vector<Value>>& Out, std::size_t Y,
+    std::vector<Value>& Row)
+{
+    Out[Y].swap(Row);
+}
+
+// Parses rows whose '[' are at Text + Starts[k] into rows First + k of Out,
+// which must already have room for them. Only whitespace and the commas
+// between rows may follow each row, up to the next start or Text + Length.
+template<typename Value, typename Container>
+void ParseRows(const char* Text, std::size_t Length,
+    const std::vector<std::size_t>& Starts, Container& Out, std::size_t First,
+    ThreadPool& Pool)
+{
+    Pool.ParallelFor(Starts.size(),
+        [&](std::size_t Begin, std::size_t End) {
+            std::vector<Value> row;
+            for (std::size_t k = Begin; k < End; ++k) {
+                const char* stop = (k + 1 < Starts.size()) ?
+                    Text + Starts[k + 1] : Text + Length;
+                const char* pos = ParseNumberRow(Text + Starts[k], stop, row);
+                bool comma = (k + 1 == Starts.size());
+                for (; pos != stop; ++pos) {
+                    if (*pos == ',' && !comma)
+                        comma = true;
+                    else if (*pos != ' ' && *pos != '\n' && *pos != '\r' &&
+                        *pos != '\t')
+                        throw std::runtime_error(
+                            "Unexpected character in number array.");
+                }
+                if (!comma)
+                    throw std::runtime_error("Expected comma between arrays.");
+                StoreRow(Out, First + k, row);
+            }
+        });
+}
+
+// Parses [[n, ...], ...] in pieces, passing each inner array to
+// Container::push_back once complete.
+template<typename Value>
+class NumberArrayParser {
+private:
+    enum Expect { ItemOrEnd, Item, CommaOrEnd };
+    int depth;
+    Expect expect;
+    bool finished;
+    bool pause, pause_requested;
+    std::vector<Value> row;
+    std::string carry; // Number split between two pieces of input.
+
+    static bool whitespace(char C) {
+        return C == ' ' || C == '\n' || C == '\r' || C == '\t';
+    }
+
+    template<typename Container>
+    void structural(char C, Container& Out) {
+        if (C == '[') {
+            if (depth == 2 || (depth == 1 && expect == CommaOrEnd))
+                throw std::runtime_error("Unexpected array in number array.");
+            ++depth;
+            expect = ItemOrEnd;
+            row.resize(0);
+        } else if (C == ']') {
+            if (depth == 0 || expect == Item)
+                throw std::runtime_error("Unexpected end of number array.");
+            if (--depth == 1) {
+                Out.push_back(row);
+                pause = pause_requested;
+            } else
+                finished = true;
+            expect = CommaOrEnd;
+        } else if (C == ',') {
+            if (depth == 0 || expect != CommaOrEnd)
+                throw std::runtime_error("Unexpected comma in number array.");
+            expect = Item;
+        } else
+            throw std::runtime_error("Unexpected character in number array.");
+    }
+
+    void value(const char* Begin, const char* End) {
+        if (depth != 2 || expect == CommaOrEnd)
+            throw std::runtime_error("Unexpected number in number array.");
+        row.push_back(Value());
+        if (!ParseNumber(Begin, End, row.back()))
+            throw std::runtime_error("Invalid number in number array.");
+        expect = CommaOrEnd;
+    }
+
+public:
+    NumberArrayParser() { Reset(); }
+
+    void Reset() {
+        depth = 0;
+        expect = Item;
+        finished = pause = pause_requested = false;
+        row.resize(0);
+        carry.resize(0);
+    }
+
+    bool Finished() const { return finished; }
+
+    // Makes Parse return after the next row. Afterwards the rest of the
+    // outer array can be handled elsewhere, starting with a comma.
+    void PauseAfterRow() { pause_requested = true; }
+    bool Paused() const { return pause; }
+
+    // Returns pointer past the closing bracket, or End if more is needed.
+    template<typename Container>
+    const char* Parse(const char* Begin, const char* End, Container& Out) {
+        if (!carry.empty()) {
+            const char* stop = FindNumberEnd(Begin, End);
+            carry.append(Begin, stop);
+            if (stop == End)
+                return End;
+            value(carry.data(), carry.data() + carry.size());
+            carry.resize(0);
+            Begin = stop;
+        }
+        while (Begin != End && !finished && !pause) {
+            if (whitespace(*Begin))
+                ++Begin;
+            else if (*Begin == '-' || ('0' <= *Begin && *Begin <= '9')) {
+                const char* stop = FindNumberEnd(Begin, End);
+                if (stop == End) {
+                    carry.assign(Begin, End);
+                    return End;
+                }
+                value(Begin, stop);
+                Begin = stop;
+            } else
+                structural(*Begin++, Out);
+        }
+        return Begin;
+    }
+};
+
+#endif
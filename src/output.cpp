@@ -0,0 +1,225 @@
+//
+//  output.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "output.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#include <sys/uio.h>
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <string>
+#endif
+
+
+static double milliseconds(std::chrono::steady_clock::duration D) {
+    return std::chrono::duration<double, std::milli>(D).count();
+}
+
+OutputBuffer::OutputBuffer(
+    int FileDescriptor, std::size_t BufferSize, std::size_t Buffers)
+    : fd(FileDescriptor),
+    ring(std::max<std::size_t>(2, Buffers),
+        std::vector<char>(std::max<std::size_t>(1, BufferSize))),
+    counts(ring.size(), 0), produced(0), consumed(0), sleeping(false),
+    waiting(false), stop(false), failed(false), start(Clock::now()),
+    stats { 0, 0, 0.0, 0.0, 0.0 }
+{
+    setp(ring[0].data(), ring[0].data() + ring[0].size());
+    writer = std::thread(&OutputBuffer::write_loop, this);
+}
+
+OutputBuffer::~OutputBuffer() {
+    submit();
+    stop = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        changed.notify_all();
+    }
+    writer.join();
+}
+
+void OutputBuffer::submit() {
+    const std::size_t count = pptr() - pbase();
+    if (count == 0)
+        return;
+    const std::size_t p = produced.load();
+    counts[p % ring.size()] = count;
+    produced = p + 1;
+    if (sleeping) {
+        std::lock_guard<std::mutex> lock(mutex);
+        changed.notify_all();
+    }
+    if (p + 1 - consumed.load() == ring.size()) {
+        Clock::time_point before = Clock::now();
+        std::unique_lock<std::mutex> lock(mutex);
+        waiting = true;
+        changed.wait(lock, [this, p]() {
+            return p + 1 - consumed.load() < ring.size();
+        });
+        waiting = false;
+        stats.waiting_ms += milliseconds(Clock::now() - before);
+    }
+    std::vector<char>& next(ring[(p + 1) % ring.size()]);
+    setp(next.data(), next.data() + next.size());
+}
+
+void OutputBuffer::write_ready() {
+    const std::size_t c = consumed.load();
+    const std::size_t p = std::min<std::size_t>(produced.load(), c + IOV_MAX);
+    std::vector<iovec> parts;
+    for (std::size_t k = c; k < p; ++k)
+        parts.push_back(iovec {
+            ring[k % ring.size()].data(), counts[k % ring.size()] });
+    std::size_t bytes = 0;
+    Clock::time_point before = Clock::now();
+    iovec* first = parts.data();
+    int left = static_cast<int>(parts.size());
+    while (0 < left && !failed) {
+        ssize_t n = writev(fd, first, left);
+        if (n < 0) {
+            if (errno != EINTR && errno != EAGAIN)
+                failed = true;
+            continue;
+        }
+        bytes += n;
+        while (0 < left && first->iov_len <= static_cast<std::size_t>(n)) {
+            n -= first->iov_len;
+            ++first;
+            --left;
+        }
+        if (0 < left) {
+            first->iov_base = static_cast<char*>(first->iov_base) + n;
+            first->iov_len -= n;
+        }
+    }
+    Clock::time_point after = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stats.writes == 0)
+            stats.first_byte_ms = milliseconds(after - start);
+        stats.bytes += bytes;
+        ++stats.writes;
+        stats.writing_ms += milliseconds(after - before);
+    }
+    consumed = p;
+    if (waiting) {
+        std::lock_guard<std::mutex> lock(mutex);
+        changed.notify_all();
+    }
+}
+
+void OutputBuffer::write_loop() {
+    while (true) {
+        if (consumed.load() != produced.load()) {
+            write_ready();
+            continue;
+        }
+        if (stop)
+            return;
+        std::unique_lock<std::mutex> lock(mutex);
+        sleeping = true;
+        changed.wait(lock, [this]() {
+            return stop || consumed.load() != produced.load();
+        });
+        sleeping = false;
+    }
+}
+
+OutputBuffer::int_type OutputBuffer::overflow(int_type C) {
+    submit();
+    if (traits_type::eq_int_type(C, traits_type::eof()))
+        return traits_type::not_eof(C);
+    *pptr() = traits_type::to_char_type(C);
+    pbump(1);
+    return C;
+}
+
+int OutputBuffer::sync() {
+    submit();
+    return 0;
+}
+
+void OutputBuffer::Drain() {
+    submit();
+    std::unique_lock<std::mutex> lock(mutex);
+    waiting = true;
+    changed.wait(lock, [this]() {
+        return consumed.load() == produced.load();
+    });
+    waiting = false;
+}
+
+OutputBuffer::Stats OutputBuffer::Statistics() {
+    Drain();
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void ReportStats(const OutputBuffer::Stats& S) {
+    if (std::getenv("TERRAIN_STATS") == nullptr)
+        return;
+    std::cerr << "output: bytes " << S.bytes << ", writes " << S.writes
+        << ", first byte " << S.first_byte_ms << " ms, writing "
+        << S.writing_ms << " ms, overlapped with computing "
+        << std::max(0.0, S.writing_ms - S.waiting_ms) << " ms" << std::endl;
+}
+
+class StandardOutput {
+public:
+    OutputBuffer buffer;
+    std::ostream stream;
+
+    StandardOutput() : buffer(1), stream(&buffer) { }
+    ~StandardOutput() { ReportStats(buffer.Statistics()); }
+};
+
+std::ostream& Output() {
+    static StandardOutput out;
+    return out.stream;
+}
+
+#if defined(UNITTEST)
+
+TEST_CASE("OutputBuffer") {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    std::string expected;
+    std::string received;
+    std::thread reader([&fds, &received]() {
+        char block[4096];
+        ssize_t n;
+        while (0 < (n = read(fds[0], block, sizeof(block))))
+            received.append(block, n);
+    });
+    {
+        OutputBuffer buffer(fds[1], 100, 3);
+        std::ostream out(&buffer);
+        for (int k = 0; k < 5000; ++k) {
+            std::string s = std::to_string(k) + ',';
+            out << s;
+            expected += s;
+            if (k % 1000 == 0)
+                out.flush();
+        }
+        out << std::endl;
+        expected += '\n';
+        OutputBuffer::Stats s = buffer.Statistics();
+        REQUIRE(s.bytes == expected.size());
+        REQUIRE(0 < s.writes);
+    }
+    close(fds[1]);
+    reader.join();
+    close(fds[0]);
+    REQUIRE(received == expected);
+}
+
+#endif
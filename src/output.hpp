@@ -0,0 +1,84 @@
+//
+//  output.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(OUTPUT_HPP)
+#define OUTPUT_HPP
+
+// Output is formatted into large buffers that a writer thread writes to the
+// file descriptor, so computing continues while earlier output drains.
+// Flushing hands the buffer to the writer and does not wait for the write.
+
+#include <streambuf>
+#include <ostream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+
+
+class OutputBuffer : public std::streambuf {
+public:
+    struct Stats {
+        std::size_t bytes;
+        std::size_t writes;
+        // From construction to the first completed write.
+        double first_byte_ms;
+        // Time the writer thread spent writing.
+        double writing_ms;
+        // Time spent waiting for the writer to free a buffer. The rest of
+        // the writing time overlapped with computing.
+        double waiting_ms;
+    };
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    int fd;
+    std::vector<std::vector<char>> ring;
+    std::vector<std::size_t> counts;
+    // Buffers [consumed, produced) modulo ring size are waiting to be written.
+    // Only the producer changes produced and only the writer consumed.
+    std::atomic<std::size_t> produced, consumed;
+    std::atomic<bool> sleeping, waiting, stop;
+    bool failed;
+    std::mutex mutex;
+    std::condition_variable changed;
+    Clock::time_point start;
+    Stats stats;
+    std::thread writer;
+
+    void submit();
+    void write_ready();
+    void write_loop();
+
+protected:
+    int_type overflow(int_type C);
+    int sync();
+
+public:
+    OutputBuffer(int FileDescriptor, std::size_t BufferSize = 1 << 20,
+        std::size_t Buffers = 8);
+    ~OutputBuffer();
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    // Waits until everything handed to the writer has been written.
+    void Drain();
+    Stats Statistics();
+};
+
+// Writes the statistics to std::cerr if TERRAIN_STATS is set.
+void ReportStats(const OutputBuffer::Stats& S);
+
+// Stream to standard output shared by all programs. Statistics are reported
+// at exit.
+std::ostream& Output();
+
+#endif
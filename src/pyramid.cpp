@@ -0,0 +1,213 @@
+//
+//  pyramid.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "pyramid.hpp"
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#endif
+
+
+PyramidReduction PyramidReductionFromName(const std::string& Name) {
+    if (Name == "mean")
+        return PyramidMean;
+    if (Name == "min")
+        return PyramidMin;
+    if (Name == "max")
+        return PyramidMax;
+    throw std::runtime_error("Unknown pyramid reduction: " + Name);
+}
+
+static float reduce(float A0, float A1, float B0, float B1,
+    PyramidReduction Kind)
+{
+    switch (Kind) {
+    case PyramidMin: {
+        const float a = (A1 < A0) ? A1 : A0;
+        const float b = (B1 < B0) ? B1 : B0;
+        return (b < a) ? b : a;
+    }
+    case PyramidMax: {
+        const float a = (A0 < A1) ? A1 : A0;
+        const float b = (B0 < B1) ? B1 : B0;
+        return (a < b) ? b : a;
+    }
+    default:
+        return ((A0 + B0) + (A1 + B1)) * 0.25f;
+    }
+}
+
+void Reduce2x2(const float* A, const float* B, std::size_t Width,
+    PyramidReduction Kind, float* Out)
+{
+    std::size_t k = 0;
+#if defined(__SSE2__)
+    // Combine rows first, then even and odd columns of the combined row.
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    for (; k + 8 <= Width; k += 8, Out += 4) {
+        const __m128 a0 = _mm_loadu_ps(A + k);
+        const __m128 a1 = _mm_loadu_ps(A + k + 4);
+        const __m128 b0 = _mm_loadu_ps(B + k);
+        const __m128 b1 = _mm_loadu_ps(B + k + 4);
+        __m128 lo, hi, even, odd;
+        switch (Kind) {
+        case PyramidMin:
+            lo = _mm_min_ps(a0, b0);
+            hi = _mm_min_ps(a1, b1);
+            break;
+        case PyramidMax:
+            lo = _mm_max_ps(a0, b0);
+            hi = _mm_max_ps(a1, b1);
+            break;
+        default:
+            lo = _mm_add_ps(a0, b0);
+            hi = _mm_add_ps(a1, b1);
+            break;
+        }
+        even = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+        odd = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+        switch (Kind) {
+        case PyramidMin:
+            _mm_storeu_ps(Out, _mm_min_ps(even, odd));
+            break;
+        case PyramidMax:
+            _mm_storeu_ps(Out, _mm_max_ps(even, odd));
+            break;
+        default:
+            _mm_storeu_ps(Out, _mm_mul_ps(_mm_add_ps(even, odd), quarter));
+            break;
+        }
+    }
+#endif
+    for (; k + 2 <= Width; k += 2, ++Out)
+        *Out = reduce(A[k], A[k + 1], B[k], B[k + 1], Kind);
+    if (k < Width)
+        *Out = (Kind == PyramidMean) ? (A[k] + B[k]) * 0.5f :
+            reduce(A[k], A[k], B[k], B[k], Kind);
+}
+
+Pyramid::Pyramid(std::uint32_t Width, std::uint32_t Height,
+    PyramidReduction Kind, Output Out)
+    : kind(Kind), output(Out)
+{
+    if (Width == 0 || Height == 0)
+        throw std::runtime_error("Pyramid of empty height field.");
+    while (true) {
+        levels.push_back(Level());
+        Level& level(levels.back());
+        level.width = Width;
+        level.height = Height;
+        level.has_pending = false;
+        if (Width == 1 && Height == 1)
+            break;
+        Width = (Width + 1) / 2;
+        Height = (Height + 1) / 2;
+    }
+    // Each level holds at most one row waiting for its pair.
+    for (std::size_t k = 0; k + 1 < levels.size(); ++k) {
+        levels[k].pending.reserve(levels[k].width);
+        levels[k].reduced.resize(levels[k + 1].width);
+    }
+}
+
+void Pyramid::row(std::size_t Index, const std::vector<float>& Values) {
+    Level& level(levels[Index]);
+    if (Values.size() != level.width)
+        throw std::runtime_error("Pyramid row length differs from width.");
+    output(Index, Values);
+    if (Index + 1 == levels.size())
+        return;
+    if (!level.has_pending) {
+        level.pending.assign(Values.begin(), Values.end());
+        level.has_pending = true;
+        return;
+    }
+    Reduce2x2(level.pending.data(), Values.data(), level.width, kind,
+        level.reduced.data());
+    level.has_pending = false;
+    row(Index + 1, level.reduced);
+}
+
+void Pyramid::Finish() {
+    for (std::size_t k = 0; k + 1 < levels.size(); ++k) {
+        Level& level(levels[k]);
+        if (!level.has_pending)
+            continue;
+        Reduce2x2(level.pending.data(), level.pending.data(), level.width,
+            kind, level.reduced.data());
+        level.has_pending = false;
+        row(k + 1, level.reduced);
+    }
+}
+
+#if defined(UNITTEST)
+
+TEST_CASE("Reduce2x2") {
+    std::vector<float> a, b;
+    for (int k = 0; k < 11; ++k) {
+        a.push_back(float(k));
+        b.push_back(float(k % 3) - float(k));
+    }
+    std::vector<float> out(6);
+    SUBCASE("Mean") {
+        Reduce2x2(a.data(), b.data(), a.size(), PyramidMean, out.data());
+        for (std::size_t k = 0; k < 5; ++k)
+            REQUIRE(out[k] == (a[2 * k] + b[2 * k] + a[2 * k + 1]
+                + b[2 * k + 1]) / 4.0f);
+        REQUIRE(out[5] == (a[10] + b[10]) / 2.0f);
+    }
+    SUBCASE("Min") {
+        Reduce2x2(a.data(), b.data(), a.size(), PyramidMin, out.data());
+        for (std::size_t k = 0; k < 5; ++k)
+            REQUIRE(out[k] == b[2 * k + 1]);
+        REQUIRE(out[5] == b[10]);
+    }
+    SUBCASE("Max") {
+        Reduce2x2(a.data(), b.data(), a.size(), PyramidMax, out.data());
+        for (std::size_t k = 0; k < 5; ++k)
+            REQUIRE(out[k] == a[2 * k + 1]);
+        REQUIRE(out[5] == a[10]);
+    }
+    SUBCASE("Names") {
+        REQUIRE(PyramidReductionFromName("max") == PyramidMax);
+        REQUIRE_THROWS(PyramidReductionFromName("median"));
+    }
+}
+
+TEST_CASE("Pyramid") {
+    std::vector<std::vector<std::vector<float>>> got;
+    Pyramid pyramid(5, 3, PyramidMean,
+        [&got](std::size_t Level, const std::vector<float>& Row) {
+            if (got.size() <= Level)
+                got.resize(Level + 1);
+            got[Level].push_back(Row);
+        });
+    REQUIRE(pyramid.Levels() == 4);
+    REQUIRE(pyramid.Width(1) == 3);
+    REQUIRE(pyramid.Height(1) == 2);
+    REQUIRE(pyramid.Width(2) == 2);
+    REQUIRE(pyramid.Height(2) == 1);
+    REQUIRE(pyramid.Width(3) == 1);
+    for (int y = 0; y < 3; ++y)
+        pyramid.Row(std::vector<float>(5, float(4 * y)));
+    REQUIRE(got.size() == 2);
+    pyramid.Finish();
+    REQUIRE(got.size() == 4);
+    for (std::size_t k = 0; k < got.size(); ++k)
+        REQUIRE(got[k].size() == pyramid.Height(k));
+    REQUIRE(got[1][0] == std::vector<float>(3, 2.0f));
+    REQUIRE(got[1][1] == std::vector<float>(3, 8.0f));
+    REQUIRE(got[2][0] == std::vector<float>(2, 5.0f));
+    REQUIRE(got[3][0] == std::vector<float>(1, 5.0f));
+    REQUIRE_THROWS(pyramid.Row(std::vector<float>(4, 0.0f)));
+}
+
+#endif
@@ -0,0 +1,70 @@
+//
+//  pyramid.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(PYRAMID_HPP)
+#define PYRAMID_HPP
+
+// Coarser levels of detail built from rows as they come. Each level halves
+// the size of the level below it, rounding up, until the level is 1 by 1.
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+
+enum PyramidReduction {
+    PyramidMean,
+    PyramidMin,
+    PyramidMax
+};
+
+// Reduction for name mean, min, or max. Throws if unknown.
+PyramidReduction PyramidReductionFromName(const std::string& Name);
+
+// Reduces 2 by 2 blocks of rows A and B to (Width + 1) / 2 values in Out.
+// With odd Width, the last value comes from the last column only.
+void Reduce2x2(const float* A, const float* B, std::size_t Width,
+    PyramidReduction Kind, float* Out);
+
+class Pyramid {
+public:
+    // Receives level and a row of it, rows of each level in order.
+    typedef std::function<void(std::size_t, const std::vector<float>&)>
+        Output;
+
+private:
+    struct Level {
+        std::uint32_t width, height;
+        std::vector<float> pending, reduced;
+        bool has_pending;
+    };
+    std::vector<Level> levels;
+    PyramidReduction kind;
+    Output output;
+
+    void row(std::size_t Level, const std::vector<float>& Values);
+
+public:
+    Pyramid(std::uint32_t Width, std::uint32_t Height, PyramidReduction Kind,
+        Output Out);
+
+    std::size_t Levels() const { return levels.size(); }
+    std::uint32_t Width(std::size_t Level) const { return levels[Level].width; }
+    std::uint32_t Height(std::size_t Level) const {
+        return levels[Level].height;
+    }
+
+    // Passes a row of the finest level on and adds it to the coarser ones.
+    void Row(const std::vector<float>& Values) { row(0, Values); }
+    // Reduces the last row of levels with odd height on its own.
+    void Finish();
+};
+
+#endif
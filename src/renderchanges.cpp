@@ -13,6 +13,7 @@
 #include "convenience.hpp"
 #endif
 #include "render_io.hpp"
+#include "rowwriter.hpp"
 #include <vector>
 #include <iostream>
 #include <cmath>
@@ -149,14 +150,39 @@ static void row_deltas(std::vector<std::int64_t>& Deltas,
 }
 
 #if !defined(UNITTEST)
-static void render_changes(io::RenderChangesIn& Val) {
+// Fixed-point heights of row Y in [Left, Right) to Heights. Clears Deltas.
+static void row_heights(std::vector<std::int64_t>& Heights,
+    std::vector<std::int64_t>& Deltas, const std::vector<ScaledChange>& Scaled,
+    const std::uint32_t Y, const std::uint32_t Size,
+    const std::uint32_t Left, const std::uint32_t Right)
+{
+    row_deltas(Deltas, Scaled, Y, Size, Left, Right);
+    std::int64_t height = 0;
+    for (std::uint32_t n = 0; n < Left; ++n) {
+        height += Deltas[n];
+        Deltas[n] = 0;
+    }
+    for (std::uint32_t n = Left; n < Right; ++n) {
+        height += Deltas[n];
+        Deltas[n] = 0;
+        Heights[n - Left] = height;
+    }
+    for (std::uint32_t n = Right; n < Deltas.size(); ++n)
+        Deltas[n] = 0;
+}
+
+static void render_changes(io::RenderChangesIn& Val, RowWriter& Out) {
     const std::uint32_t size = Val.size();
     const std::uint32_t low = Val.lowGiven() ? std::min(Val.low(), size) : 0;
     const std::uint32_t high = Val.highGiven() ? std::min(Val.high(), size) : size;
     const std::uint32_t left = Val.leftGiven() ? std::min(Val.left(), size) : 0;
     const std::uint32_t right = Val.rightGiven() ? std::min(Val.right(), size) : size;
-    if (high <= low)
+    Out.Begin((left < right) ? right - left : 0, (low < high) ? high - low : 0,
+        left, low);
+    if (high <= low) {
+        Out.End();
         return;
+    }
     const double max = max_abs_change(Val.changes());
 
     std::int64_t change_room;
@@ -168,37 +194,39 @@ static void render_changes(io::RenderChangesIn& Val) {
     std::vector<ScaledChange> scaled;
     scale_changes(scaled, Val.changes(), size, 0.5 * Val.size(), change_scale,
         left, right, low, high);
-    std::vector<char> buffer;
     std::vector<std::int64_t> deltas(size + 1, 0);
+    std::vector<std::int64_t> heights;
     std::vector<float> row;
-    if (left < right)
+    if (left < right) {
         row.resize(right - left);
+        heights.resize(right - left);
+    }
+    const bool fixed = Out.FixedPoint() && left < right;
+    if (fixed)
+        Out.FixedScale(change_scale);
     for (std::uint32_t y = low; y < high; ++y) {
         if (left < right) {
-            row_deltas(deltas, scaled, y, size, left, right);
-            std::int64_t height = 0;
-            for (std::uint32_t n = 0; n < left; ++n) {
-                height += deltas[n];
-                deltas[n] = 0;
-            }
-            for (std::uint32_t n = left; n < right; ++n) {
-                height += deltas[n];
-                deltas[n] = 0;
-                row[n - left] = height / change_scale;
+            row_heights(heights, deltas, scaled, y, size, left, right);
+            if (fixed) {
+                Out.FixedRow(heights);
+                continue;
             }
-            for (std::uint32_t n = right; n < deltas.size(); ++n)
-                deltas[n] = 0;
+            for (std::uint32_t n = 0; n < heights.size(); ++n)
+                row[n] = heights[n] / change_scale;
         }
-        io::Write(std::cout, row, buffer);
-        if (y + 1 != high)
-            std::cout << ',';
+        Out.Row(row);
     }
+    Out.End();
 }
 
 static int render(io::RenderChangesIn& Val) {
-    std::cout << "{\"heightfield\":[";
-    render_changes(Val);
-    std::cout << "]}" << std::endl;
+    try {
+        render_changes(Val, *NewRowWriter(Val));
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
     return 0;
 }
 
@@ -208,6 +236,8 @@ int main(int argc, char** argv) {
         f = open(argv[1], O_RDONLY);
     InputParser<io::ParserPool, io::RenderChangesIn_Parser,
         io::RenderChangesIn> ip(f);
+    ip.AddNumberArray<double>("changes", [](io::RenderChangesIn& Val)
+        -> io::RenderChangesIn::changesType& { return Val.changes(); });
     int status = ip.ReadAndParse(render);
     if (f)
         close(f);
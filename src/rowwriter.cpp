@@ -0,0 +1,303 @@
+//
+//  rowwriter.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "rowwriter.hpp"
+#include "output.hpp"
+#include <ostream>
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <sstream>
+#include <cstdlib>
+#include <unistd.h>
+#endif
+
+
+RowWriter::~RowWriter() { }
+
+bool RowWriter::FixedPoint() const {
+    return false;
+}
+
+void RowWriter::FixedScale(double Scale) { }
+
+void RowWriter::FixedRow(const std::vector<std::int64_t>& Values) {
+    throw std::runtime_error("Writer does not take fixed-point rows.");
+}
+
+JSONRowWriter::JSONRowWriter(const NumberFormat& Format)
+    : format(Format), first(true)
+{ }
+
+void JSONRowWriter::Begin(std::uint32_t Width, std::uint32_t Height,
+    std::uint32_t Left, std::uint32_t Low)
+{
+    Output() << "{\"heightfield\":[";
+    first = true;
+}
+
+void JSONRowWriter::Row(const std::vector<float>& Values) {
+    if (!first)
+        Output() << ',';
+    first = false;
+    format.Write(Output(), Values, buffer);
+}
+
+void JSONRowWriter::End() {
+    Output() << "]}" << std::endl;
+}
+
+FileRowWriter::FileRowWriter(const std::string& Path, HeightFieldDataType Type,
+    std::uint32_t Readers)
+    : path(Readers ? SharedMemoryName(Path) : Path), type(Type),
+    readers(Readers), width(0), height(0), rows(0), fixed(false), scale(1.0),
+    fixed_min(0), fixed_max(0), min(0.0f), max(0.0f)
+{ }
+
+FileRowWriter::~FileRowWriter() {
+    // Unfinished shared memory would stay around with nobody to read it.
+    if (writer && readers)
+        RemoveSharedMemory(path);
+}
+
+void FileRowWriter::Begin(std::uint32_t Width, std::uint32_t Height,
+    std::uint32_t Left, std::uint32_t Low)
+{
+    width = Width;
+    height = Height;
+    rows = 0;
+    fixed = false;
+    if (readers) {
+        writer.reset(new HeightFieldFileWriter(
+            CreateSharedMemory(path), Width, Height, type));
+        writer->SetReaders(readers);
+    } else
+        writer.reset(new HeightFieldFileWriter(path, Width, Height, type));
+    writer->SetOrigin(Left, Low);
+    spilled.reset(type == HeightFieldUInt16 ? new TemporaryFile() : nullptr);
+}
+
+void FileRowWriter::Row(const std::vector<float>& Values) {
+    if (!spilled || Values.empty()) {
+        writer->WriteRow(Values.data());
+        return;
+    }
+    if (!rows)
+        min = max = Values[0];
+    MinMax(Values.data(), Values.size(), min, max);
+    spilled->Append(reinterpret_cast<const char*>(Values.data()),
+        sizeof(float) * Values.size());
+    ++rows;
+}
+
+bool FileRowWriter::FixedPoint() const {
+    return type == HeightFieldUInt16;
+}
+
+void FileRowWriter::FixedScale(double Scale) {
+    fixed = true;
+    scale = Scale;
+}
+
+void FileRowWriter::FixedRow(const std::vector<std::int64_t>& Values) {
+    if (Values.empty()) {
+        writer->WriteRow(static_cast<const float*>(nullptr));
+        return;
+    }
+    if (!rows)
+        fixed_min = fixed_max = Values[0];
+    for (std::int64_t v : Values) {
+        fixed_min = std::min(fixed_min, v);
+        fixed_max = std::max(fixed_max, v);
+    }
+    spilled->Append(reinterpret_cast<const char*>(Values.data()),
+        sizeof(std::int64_t) * Values.size());
+    ++rows;
+}
+
+// Encodes the rows in the temporary file now that the range is known.
+void FileRowWriter::write_spilled() {
+    std::vector<std::uint16_t> codes(width);
+    if (fixed) {
+        const Quantizer quantizer(fixed_min, fixed_max);
+        writer->SetQuantization(
+            double(fixed_min) / scale, quantizer.Step() / scale);
+        std::vector<std::int64_t> values(width);
+        for (std::uint32_t y = 0; y < rows; ++y) {
+            spilled->Read(reinterpret_cast<char*>(values.data()),
+                sizeof(std::int64_t) * width,
+                std::uint64_t(y) * sizeof(std::int64_t) * width);
+            for (std::uint32_t x = 0; x < width; ++x)
+                codes[x] = quantizer(values[x]);
+            writer->WriteRow(codes.data());
+        }
+        return;
+    }
+    writer->SetQuantization(min, (double(max) - double(min)) / 65535.0);
+    std::vector<float> values(width);
+    for (std::uint32_t y = 0; y < rows; ++y) {
+        spilled->Read(reinterpret_cast<char*>(values.data()),
+            sizeof(float) * width, std::uint64_t(y) * sizeof(float) * width);
+        writer->WriteRow(values.data());
+    }
+}
+
+void FileRowWriter::End() {
+    if (spilled && rows)
+        write_spilled();
+    spilled.reset();
+    writer->Finish();
+    if (readers) {
+        Output() << "{\"heightfield_shm\":";
+        WriteJSONString(Output(), path);
+        Output() << ",\"bytes\":" << writer->Size() << ",\"encoding\":\""
+            << HeightFieldEncodingName(type) << "\",\"width\":"
+            << width << ",\"height\":" << height << "}";
+    } else {
+        Output() << "{\"heightfield_file\":";
+        WriteJSONString(Output(), path);
+        Output() << "}";
+    }
+    Output() << std::endl;
+    writer.reset();
+}
+
+TiledRowWriter::TiledRowWriter(const std::string& Path, std::uint32_t TileSize,
+    HeightFieldDataType Type)
+    : path(Path), tile_size(TileSize), type(Type)
+{ }
+
+void TiledRowWriter::Begin(std::uint32_t Width, std::uint32_t Height,
+    std::uint32_t Left, std::uint32_t Low)
+{
+    writer.reset(
+        new TiledHeightFieldWriter(path, Width, Height, tile_size, type));
+    writer->SetOrigin(Left, Low);
+}
+
+void TiledRowWriter::Row(const std::vector<float>& Values) {
+    writer->WriteRow(Values.data());
+}
+
+void TiledRowWriter::End() {
+    writer->Finish();
+    writer.reset();
+    Output() << "{\"heightfield_file\":";
+    WriteJSONString(Output(), path);
+    Output() << "}" << std::endl;
+}
+
+PyramidRowWriter::PyramidRowWriter(const std::string& Path,
+    std::uint32_t TileSize, HeightFieldDataType Type,
+    PyramidReduction Reduction)
+    : path(Path), tile_size(TileSize), type(Type), reduction(Reduction)
+{ }
+
+std::string PyramidRowWriter::LevelPath(
+    const std::string& Path, std::size_t Level)
+{
+    return Path + "." + std::to_string(Level);
+}
+
+void PyramidRowWriter::Begin(std::uint32_t Width, std::uint32_t Height,
+    std::uint32_t Left, std::uint32_t Low)
+{
+    pyramid.reset(new Pyramid(Width, Height, reduction,
+        [this](std::size_t Level, const std::vector<float>& Values) {
+            writers[Level]->WriteRow(Values.data());
+        }));
+    writers.clear();
+    for (std::size_t k = 0; k < pyramid->Levels(); ++k) {
+        writers.push_back(std::unique_ptr<TiledHeightFieldWriter>(
+            new TiledHeightFieldWriter(LevelPath(path, k), pyramid->Width(k),
+                pyramid->Height(k), tile_size, type)));
+        writers.back()->SetOrigin(Left >> k, Low >> k);
+    }
+}
+
+void PyramidRowWriter::Row(const std::vector<float>& Values) {
+    pyramid->Row(Values);
+}
+
+void PyramidRowWriter::End() {
+    pyramid->Finish();
+    Output() << "{\"heightfield_pyramid\":[";
+    for (std::size_t k = 0; k < writers.size(); ++k) {
+        writers[k]->Finish();
+        if (k)
+            Output() << ',';
+        WriteJSONString(Output(), LevelPath(path, k));
+    }
+    Output() << "]}" << std::endl;
+    writers.clear();
+    pyramid.reset();
+}
+
+void WriteJSONString(std::ostream& Out, const std::string& S) {
+    Out << '"';
+    for (char c : S) {
+        if (c == '"' || c == '\\')
+            Out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char esc[8];
+            std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+            Out << esc;
+        } else
+            Out << c;
+    }
+    Out << '"';
+}
+
+#if defined(UNITTEST)
+
+TEST_CASE("WriteJSONString") {
+    std::ostringstream out;
+    WriteJSONString(out, "a\"b\\c\n");
+    REQUIRE(out.str() == "\"a\\\"b\\\\c\\u000a\"");
+}
+
+TEST_CASE("FileRowWriter uint16") {
+    char name[] = "/tmp/rowwriterXXXXXX";
+    int fd = mkstemp(name);
+    REQUIRE(fd != -1);
+    close(fd);
+    SUBCASE("Float rows") {
+        FileRowWriter out(name, HeightFieldUInt16);
+        out.Begin(3, 2, 0, 0);
+        out.Row(std::vector<float> { 1.0f, 2.0f, 3.0f });
+        out.Row(std::vector<float> { -1.0f, 0.0f, 5.0f });
+        out.End();
+        HeightFieldRowReader rows(name, {});
+        REQUIRE(rows.Header().type == HeightFieldUInt16);
+        REQUIRE(rows.Header().min == -1.0f);
+        REQUIRE(rows.Header().max == 5.0f);
+        REQUIRE(rows.Next()[2] == doctest::Approx(3.0f).epsilon(1e-4));
+        REQUIRE(rows.Next()[0] == -1.0f);
+    }
+    SUBCASE("Fixed-point rows") {
+        FileRowWriter out(name, HeightFieldUInt16);
+        REQUIRE(out.FixedPoint());
+        out.Begin(2, 2, 0, 0);
+        out.FixedScale(4.0);
+        out.FixedRow(std::vector<std::int64_t> { 4, -8 });
+        out.FixedRow(std::vector<std::int64_t> { 0, 12 });
+        out.End();
+        HeightFieldRowReader rows(name, {});
+        REQUIRE(rows.Header().min == -2.0f);
+        REQUIRE(rows.Header().max == doctest::Approx(3.0f));
+        const float* row = rows.Next();
+        REQUIRE(row[0] == doctest::Approx(1.0f).epsilon(1e-4));
+        REQUIRE(row[1] == -2.0f);
+    }
+    unlink(name);
+}
+
+#endif
@@ -0,0 +1,171 @@
+//
+//  rowwriter.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(ROWWRITER_HPP)
+#define ROWWRITER_HPP
+
+// Destinations for height field rows as they are rendered.
+
+#include "numberformat.hpp"
+#include "heightfieldfile.hpp"
+#include "pyramid.hpp"
+#include "spill.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+
+
+class RowWriter {
+public:
+    virtual ~RowWriter();
+    // Called once before the rows. Left and Low are the crop origin.
+    virtual void Begin(std::uint32_t Width, std::uint32_t Height,
+        std::uint32_t Left, std::uint32_t Low) = 0;
+    virtual void Row(const std::vector<float>& Values) = 0;
+    virtual void End() = 0;
+
+    // True when the writer wants fixed-point rows. FixedScale is then called
+    // after Begin, and the rows are passed to FixedRow instead of Row. Value
+    // of V is V / Scale.
+    virtual bool FixedPoint() const;
+    virtual void FixedScale(double Scale);
+    virtual void FixedRow(const std::vector<std::int64_t>& Values);
+};
+
+// Writes {"heightfield":[[...],...]} to Output().
+class JSONRowWriter : public RowWriter {
+private:
+    NumberFormat format;
+    std::vector<char> buffer;
+    bool first;
+
+public:
+    JSONRowWriter(const NumberFormat& Format);
+    void Begin(std::uint32_t Width, std::uint32_t Height,
+        std::uint32_t Left, std::uint32_t Low);
+    void Row(const std::vector<float>& Values);
+    void End();
+};
+
+// Writes the rows to a binary file and {"heightfield_file":"Path"} to
+// Output() once done. With uint16 encoding the codes need the range of all
+// values, so the rows go to a temporary file and are encoded from there at
+// the end. With Readers, writes to shared memory instead and outputs
+// heightfield_shm with the name, and size details.
+class FileRowWriter : public RowWriter {
+private:
+    std::string path;
+    HeightFieldDataType type;
+    std::uint32_t readers, width, height, rows;
+    std::unique_ptr<HeightFieldFileWriter> writer;
+    std::unique_ptr<TemporaryFile> spilled;
+    bool fixed;
+    double scale;
+    std::int64_t fixed_min, fixed_max;
+    float min, max;
+
+    void write_spilled();
+
+public:
+    FileRowWriter(const std::string& Path,
+        HeightFieldDataType Type = HeightFieldFloat32,
+        std::uint32_t Readers = 0);
+    ~FileRowWriter();
+    void Begin(std::uint32_t Width, std::uint32_t Height,
+        std::uint32_t Left, std::uint32_t Low);
+    void Row(const std::vector<float>& Values);
+    void End();
+    bool FixedPoint() const;
+    void FixedScale(double Scale);
+    void FixedRow(const std::vector<std::int64_t>& Values);
+};
+
+// Writes the rows to a tiled binary file and {"heightfield_file":"Path"} to
+// Output() once done.
+class TiledRowWriter : public RowWriter {
+private:
+    std::string path;
+    std::uint32_t tile_size;
+    HeightFieldDataType type;
+    std::unique_ptr<TiledHeightFieldWriter> writer;
+
+public:
+    TiledRowWriter(const std::string& Path, std::uint32_t TileSize,
+        HeightFieldDataType Type = HeightFieldFloat32);
+    void Begin(std::uint32_t Width, std::uint32_t Height,
+        std::uint32_t Left, std::uint32_t Low);
+    void Row(const std::vector<float>& Values);
+    void End();
+};
+
+// Writes the rows and each coarser level to tiled binary files named Path
+// followed by a dot and the level number, 0 being the rows as given. Outputs
+// {"heightfield_pyramid":[names]} once done. Holds a row of tiles and at most
+// one row per level.
+class PyramidRowWriter : public RowWriter {
+private:
+    std::string path;
+    std::uint32_t tile_size;
+    HeightFieldDataType type;
+    PyramidReduction reduction;
+    std::vector<std::unique_ptr<TiledHeightFieldWriter>> writers;
+    std::unique_ptr<Pyramid> pyramid;
+
+public:
+    PyramidRowWriter(const std::string& Path, std::uint32_t TileSize,
+        HeightFieldDataType Type = HeightFieldFloat32,
+        PyramidReduction Reduction = PyramidMean);
+    static std::string LevelPath(const std::string& Path, std::size_t Level);
+    void Begin(std::uint32_t Width, std::uint32_t Height,
+        std::uint32_t Left, std::uint32_t Low);
+    void Row(const std::vector<float>& Values);
+    void End();
+};
+
+// Writer for the output the render request asks for.
+template<typename Request>
+std::unique_ptr<RowWriter> NewRowWriter(Request& Val) {
+    const HeightFieldDataType type = Val.heightfield_encodingGiven() ?
+        HeightFieldEncoding(Val.heightfield_encoding()) : HeightFieldFloat32;
+    if (Val.heightfield_pyramidGiven())
+        return std::unique_ptr<RowWriter>(new PyramidRowWriter(
+            Val.heightfield_pyramid(), Val.heightfield_tile_sizeGiven() ?
+                Val.heightfield_tile_size() : 256, type,
+            Val.heightfield_pyramid_reductionGiven() ?
+                PyramidReductionFromName(Val.heightfield_pyramid_reduction()) :
+                PyramidMean));
+    if (Val.heightfield_pyramid_reductionGiven())
+        throw std::runtime_error(
+            "heightfield_pyramid_reduction needs heightfield_pyramid.");
+    if (Val.heightfield_tile_sizeGiven()) {
+        if (!Val.heightfield_fileGiven())
+            throw std::runtime_error(
+                "heightfield_tile_size needs heightfield_file.");
+        return std::unique_ptr<RowWriter>(new TiledRowWriter(
+            Val.heightfield_file(), Val.heightfield_tile_size(), type));
+    }
+    if (Val.heightfield_shmGiven())
+        return std::unique_ptr<RowWriter>(new FileRowWriter(
+            Val.heightfield_shm(), type, Val.heightfield_shm_readersGiven() ?
+                Val.heightfield_shm_readers() : 1));
+    if (Val.heightfield_fileGiven())
+        return std::unique_ptr<RowWriter>(
+            new FileRowWriter(Val.heightfield_file(), type));
+    if (Val.heightfield_encodingGiven())
+        throw std::runtime_error(
+            "heightfield_encoding needs heightfield_file or heightfield_shm.");
+    return std::unique_ptr<RowWriter>(new JSONRowWriter(NumberFormat(
+        Val.output_precisionGiven() ? Val.output_precision() : 0)));
+}
+
+// Writes S as JSON string to Out.
+void WriteJSONString(std::ostream& Out, const std::string& S);
+
+#endif
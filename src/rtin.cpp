@@ -0,0 +1,211 @@
+//
+//  rtin.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "rtin.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+
+// Triangle Id > 1 is a path from one of the two largest triangles: the lowest
+// bit picks the first, the bits below the leading one pick a child on each
+// level. Corners a and b end the hypotenuse, c is at the right angle.
+static void corners(std::uint32_t Id, std::uint32_t Last,
+    std::uint32_t& Ax, std::uint32_t& Ay, std::uint32_t& Bx, std::uint32_t& By)
+{
+    std::uint32_t ax = 0, ay = 0, bx = 0, by = 0, cx = 0, cy = 0;
+    if (Id & 1)
+        bx = by = cx = Last;
+    else
+        ax = ay = cy = Last;
+    while ((Id >>= 1) > 1) {
+        const std::uint32_t mx = (ax + bx) >> 1;
+        const std::uint32_t my = (ay + by) >> 1;
+        if (Id & 1) {
+            bx = ax;
+            by = ay;
+            ax = cx;
+            ay = cy;
+        } else {
+            ax = bx;
+            ay = by;
+            bx = cx;
+            by = cy;
+        }
+        cx = mx;
+        cy = my;
+    }
+    Ax = ax;
+    Ay = ay;
+    Bx = bx;
+    By = by;
+}
+
+RTIN::RTIN(const HeightField& Field)
+    : size(static_cast<std::uint32_t>(Field.Width()))
+{
+    if (Field.Height() != size || size < 3 || ((size - 1) & (size - 2)))
+        throw std::runtime_error(
+            "Adaptive mesh needs a square height field with side 2^k + 1.");
+    errors.assign(std::size_t(size) * size, 0.0f);
+    const std::uint32_t last = size - 1;
+    // Triangles that have a grid point in the middle of the hypotenuse. The
+    // smallest ones come last and have no such children.
+    const std::uint64_t count = 2 * std::uint64_t(last) * last - 2;
+    const std::uint64_t parents = count - std::uint64_t(last) * last;
+    for (std::uint64_t k = count; k-- > 0; ) {
+        std::uint32_t ax, ay, bx, by;
+        corners(static_cast<std::uint32_t>(k + 2), last, ax, ay, bx, by);
+        const std::uint32_t mx = (ax + bx) >> 1;
+        const std::uint32_t my = (ay + by) >> 1;
+        const float middle = 0.5f * (Field.Row(ay)[ax] + Field.Row(by)[bx]);
+        float& e = errors[std::size_t(my) * size + mx];
+        e = std::max(e, std::fabs(middle - Field.Row(my)[mx]));
+        if (k < parents) {
+            const std::uint32_t cx = mx + my - ay;
+            const std::uint32_t cy = my + ax - mx;
+            e = std::max(e, std::max(
+                errors[std::size_t((ay + cy) >> 1) * size + ((ax + cx) >> 1)],
+                errors[std::size_t((by + cy) >> 1) * size + ((bx + cx) >> 1)]));
+        }
+    }
+}
+
+namespace {
+
+struct MeshBuilder {
+    const std::vector<float>& errors;
+    std::uint32_t size;
+    float limit;
+    std::vector<std::uint32_t> index;
+    std::vector<std::uint32_t>& vertices;
+    std::vector<std::uint32_t>& triangles;
+
+    std::uint32_t vertex(std::uint32_t X, std::uint32_t Y) {
+        std::uint32_t& idx = index[std::size_t(Y) * size + X];
+        if (!idx) {
+            vertices.push_back(Y * size + X);
+            idx = static_cast<std::uint32_t>(vertices.size());
+        }
+        return idx - 1;
+    }
+
+    void add(std::uint32_t Ax, std::uint32_t Ay, std::uint32_t Bx,
+        std::uint32_t By, std::uint32_t Cx, std::uint32_t Cy)
+    {
+        const std::uint32_t mx = (Ax + Bx) >> 1;
+        const std::uint32_t my = (Ay + By) >> 1;
+        const std::uint32_t leg = (Ax > Cx ? Ax - Cx : Cx - Ax)
+            + (Ay > Cy ? Ay - Cy : Cy - Ay);
+        if (leg > 1 && errors[std::size_t(my) * size + mx] > limit) {
+            add(Cx, Cy, Ax, Ay, mx, my);
+            add(Bx, By, Cx, Cy, mx, my);
+            return;
+        }
+        // Grid strip triangles turn clockwise with y growing upwards.
+        const std::int64_t turn =
+            (std::int64_t(Bx) - Ax) * (std::int64_t(Cy) - Ay)
+            - (std::int64_t(By) - Ay) * (std::int64_t(Cx) - Ax);
+        triangles.push_back(vertex(Ax, Ay));
+        if (turn < 0) {
+            triangles.push_back(vertex(Bx, By));
+            triangles.push_back(vertex(Cx, Cy));
+        } else {
+            triangles.push_back(vertex(Cx, Cy));
+            triangles.push_back(vertex(Bx, By));
+        }
+    }
+};
+
+}
+
+void RTIN::Mesh(float MaxError, std::vector<std::uint32_t>& Vertices,
+    std::vector<std::uint32_t>& Triangles) const
+{
+    Vertices.resize(0);
+    Triangles.resize(0);
+    MeshBuilder mb { errors, size, MaxError,
+        std::vector<std::uint32_t>(std::size_t(size) * size, 0),
+        Vertices, Triangles };
+    const std::uint32_t last = size - 1;
+    mb.add(0, 0, last, last, last, 0);
+    mb.add(last, last, 0, 0, 0, last);
+}
+
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+
+static void check_winding(const RTIN& R,
+    const std::vector<std::uint32_t>& Vertices,
+    const std::vector<std::uint32_t>& Triangles)
+{
+    for (std::size_t k = 0; k < Triangles.size(); k += 3) {
+        std::int64_t x[3], y[3];
+        for (int n = 0; n < 3; ++n) {
+            x[n] = Vertices[Triangles[k + n]] % R.Size();
+            y[n] = Vertices[Triangles[k + n]] / R.Size();
+        }
+        REQUIRE((x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0])
+            < 0);
+    }
+}
+
+TEST_CASE("RTIN") {
+    HeightField hf(5, 5);
+    for (std::size_t y = 0; y < 5; ++y)
+        for (std::size_t x = 0; x < 5; ++x)
+            hf[y][x] = 0.0f;
+    std::vector<std::uint32_t> vertices, triangles;
+    SUBCASE("Flat") {
+        RTIN r(hf);
+        REQUIRE(r.Size() == 5);
+        r.Mesh(0.0f, vertices, triangles);
+        REQUIRE(vertices.size() == 4);
+        REQUIRE(triangles.size() == 6);
+        check_winding(r, vertices, triangles);
+    }
+    SUBCASE("Peak") {
+        hf[1][1] = 1.0f;
+        RTIN r(hf);
+        REQUIRE(r.Error(1 * 5 + 1) == 1.0f);
+        // Center is the split point of the two largest triangles and gets the
+        // error below it.
+        REQUIRE(r.Error(2 * 5 + 2) == 1.0f);
+        REQUIRE(r.Error(2 * 5 + 4) == 0.0f);
+        r.Mesh(0.5f, vertices, triangles);
+        REQUIRE(std::find(vertices.begin(), vertices.end(), 1 * 5 + 1)
+            != vertices.end());
+        REQUIRE(std::find(vertices.begin(), vertices.end(), 3 * 5 + 3)
+            == vertices.end());
+        check_winding(r, vertices, triangles);
+        r.Mesh(1.0f, vertices, triangles);
+        REQUIRE(vertices.size() == 4);
+    }
+    SUBCASE("Full") {
+        for (std::size_t y = 0; y < 5; ++y)
+            for (std::size_t x = 0; x < 5; ++x)
+                hf[y][x] = float((x * 7 + y * 3) % 5) * float(x + y);
+        RTIN r(hf);
+        r.Mesh(0.0f, vertices, triangles);
+        REQUIRE(triangles.size() == 3 * 4 * 4 * 2);
+        std::vector<std::uint32_t> sorted(vertices);
+        std::sort(sorted.begin(), sorted.end());
+        REQUIRE(sorted.size() == 25);
+        for (std::uint32_t k = 0; k < 25; ++k)
+            REQUIRE(sorted[k] == k);
+        check_winding(r, vertices, triangles);
+    }
+    SUBCASE("Bad size") {
+        HeightField wide(9, 5);
+        REQUIRE_THROWS_AS(RTIN r(wide), std::runtime_error);
+        HeightField six(6, 6);
+        REQUIRE_THROWS_AS(RTIN r(six), std::runtime_error);
+    }
+}
+
+#endif
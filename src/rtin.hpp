@@ -0,0 +1,42 @@
+//
+//  rtin.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(RTIN_HPP)
+#define RTIN_HPP
+
+// Right-triangulated irregular network over a square height field with side
+// 2^k + 1. The two triangles that cover the field are split recursively at
+// the middle of the hypotenuse. Each split point gets the largest error that
+// leaving it out causes, including the errors of the smaller triangles below
+// it, so a mesh for an error bound is the triangles that need no split.
+
+#include "heightfield.hpp"
+#include <vector>
+#include <cstdint>
+
+
+class RTIN {
+private:
+    std::uint32_t size;
+    std::vector<float> errors;
+
+public:
+    // Throws if Field is not square with side 2^k + 1 for k > 0.
+    RTIN(const HeightField& Field);
+
+    std::uint32_t Size() const { return size; }
+    // Error at grid point y * Size() + x.
+    float Error(std::uint32_t Index) const { return errors[Index]; }
+
+    // Vertices as grid indexes y * Size() + x and triangles as indexes to
+    // Vertices. Triangles wind the same way as the grid triangle strips.
+    void Mesh(float MaxError, std::vector<std::uint32_t>& Vertices,
+        std::vector<std::uint32_t>& Triangles) const;
+};
+
+#endif
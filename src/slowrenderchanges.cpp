@@ -13,6 +13,7 @@
 #include "convenience.hpp"
 #endif
 #include "render_io.hpp"
+#include "rowwriter.hpp"
 #include <vector>
 #include <iostream>
 #include <cmath>
@@ -113,17 +114,20 @@ static void compute_heights(std::vector<float>& Row,
 }
 
 #if !defined(UNITTEST)
-static void render_changes(io::RenderChangesIn& Val) {
+static void render_changes(io::RenderChangesIn& Val, RowWriter& Out) {
     const std::uint32_t size = Val.size();
     const std::uint32_t low = Val.lowGiven() ? std::min(Val.low(), size) : 0;
     const std::uint32_t high = Val.highGiven() ? std::min(Val.high(), size) : size;
     const std::uint32_t left = Val.leftGiven() ? std::min(Val.left(), size) : 0;
     const std::uint32_t right = Val.rightGiven() ? std::min(Val.right(), size) : size;
-    if (high <= low)
+    Out.Begin((left < right) ? right - left : 0, (low < high) ? high - low : 0,
+        left, low);
+    if (high <= low) {
+        Out.End();
         return;
+    }
     io::RenderChangesIn::changesType scaled;
     scale_changes(scaled, Val.changes(), size, 0.5 * Val.size(), left, right, low, high);
-    std::vector<char> buffer;
     std::vector<float> row;
     if (left < right)
         row.resize(right - left);
@@ -131,16 +135,19 @@ static void render_changes(io::RenderChangesIn& Val) {
     for (std::uint32_t y = low; y < high; ++y) {
         pick_changes(spans, scaled, y, size);
         compute_heights(row, left, right, spans, size);
-        io::Write(std::cout, row, buffer);
-        if (y + 1 != high)
-            std::cout << ',';
+        Out.Row(row);
     }
+    Out.End();
 }
 
 static int render(io::RenderChangesIn& Val) {
-    std::cout << "{\"heightfield\":[";
-    render_changes(Val);
-    std::cout << "]}" << std::endl;
+    try {
+        render_changes(Val, *NewRowWriter(Val));
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
     return 0;
 }
 
@@ -151,6 +158,8 @@ int main(int argc, char** argv) {
         f = open(argv[1], O_RDONLY);
     InputParser<io::ParserPool, io::RenderChangesIn_Parser,
         io::RenderChangesIn> ip(f);
+    ip.AddNumberArray<double>("changes", [](io::RenderChangesIn& Val)
+        -> io::RenderChangesIn::changesType& { return Val.changes(); });
     int status = ip.ReadAndParse(render);
     if (f)
         close(f);
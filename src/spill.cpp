@@ -0,0 +1,172 @@
+//
+//  spill.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "spill.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <sstream>
+#endif
+
+
+TemporaryFile::TemporaryFile() : fd(-1), size(0) { }
+
+TemporaryFile::~TemporaryFile() {
+    if (fd != -1)
+        close(fd);
+}
+
+void TemporaryFile::Append(const char* Data, std::size_t Length) {
+    if (fd == -1) {
+        const char* dir = std::getenv("TMPDIR");
+        std::string name((dir && *dir) ? dir : "/tmp");
+        name += "/terrainXXXXXX";
+        fd = mkstemp(&name[0]);
+        if (fd == -1)
+            throw std::runtime_error("Failed to create temporary file.");
+        unlink(name.c_str());
+    }
+    while (Length) {
+        ssize_t n = pwrite(fd, Data, Length, off_t(size));
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            throw std::runtime_error("Failed to write temporary file.");
+        }
+        Data += n;
+        size += n;
+        Length -= n;
+    }
+}
+
+void TemporaryFile::Read(
+    char* Data, std::size_t Length, std::uint64_t Offset) const
+{
+    while (Length) {
+        ssize_t n = pread(fd, Data, Length, off_t(Offset));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            throw std::runtime_error("Failed to read temporary file.");
+        Data += n;
+        Offset += n;
+        Length -= n;
+    }
+}
+
+void TemporaryFile::Clear() {
+    if (fd != -1 && ftruncate(fd, 0) == 0)
+        size = 0;
+}
+
+SpilledSections::SpilledSections(std::size_t Count, std::size_t Budget)
+    : limit(0), pending(Count), segments(Count)
+{
+    // Writing tiny pieces to the file would cost more than the memory.
+    limit = std::max<std::size_t>(Count ? Budget / Count : Budget, 4096);
+}
+
+void SpilledSections::spill(std::size_t Section) {
+    std::string& data(pending[Section]);
+    const std::uint64_t offset = file.Size();
+    file.Append(data.data(), data.size());
+    std::vector<Segment>& list(segments[Section]);
+    if (!list.empty() && list.back().offset + list.back().length == offset)
+        list.back().length += data.size();
+    else
+        list.push_back(Segment { offset, data.size() });
+    data.resize(0);
+}
+
+void SpilledSections::Append(
+    std::size_t Section, const char* Data, std::size_t Length)
+{
+    pending[Section].append(Data, Length);
+    if (limit <= pending[Section].size())
+        spill(Section);
+}
+
+void SpilledSections::Write(std::ostream& Out) {
+    std::vector<char> buffer;
+    for (std::size_t k = 0; k < pending.size(); ++k) {
+        for (const Segment& s : segments[k]) {
+            buffer.resize(std::min<std::uint64_t>(s.length, 1 << 20));
+            for (std::uint64_t done = 0; done < s.length;) {
+                const std::size_t length = static_cast<std::size_t>(
+                    std::min<std::uint64_t>(buffer.size(), s.length - done));
+                file.Read(buffer.data(), length, s.offset + done);
+                Out.write(buffer.data(), length);
+                done += length;
+            }
+        }
+        segments[k].resize(0);
+        Out << pending[k];
+        pending[k].resize(0);
+    }
+    file.Clear();
+}
+
+#if defined(UNITTEST)
+
+TEST_CASE("TemporaryFile") {
+    TemporaryFile file;
+    REQUIRE(file.Size() == 0);
+    file.Append("abc", 3);
+    file.Append("de", 2);
+    REQUIRE(file.Size() == 5);
+    char got[3];
+    file.Read(got, 3, 2);
+    REQUIRE(std::string(got, 3) == "cde");
+    REQUIRE_THROWS_AS(file.Read(got, 3, 4), std::runtime_error);
+    file.Clear();
+    REQUIRE(file.Size() == 0);
+    file.Append("f", 1);
+    file.Read(got, 1, 0);
+    REQUIRE(got[0] == 'f');
+}
+
+TEST_CASE("SpilledSections") {
+    std::ostringstream out;
+    SUBCASE("In memory") {
+        SpilledSections sections(3, 1 << 20);
+        sections.Append(2, "c");
+        sections.Append(0, "a");
+        sections.Append(1, std::string());
+        sections.Append(0, "b");
+        sections.Write(out);
+        REQUIRE(sections.Spilled() == 0);
+        REQUIRE(out.str() == "abc");
+    }
+    SUBCASE("Spilled") {
+        SpilledSections sections(2, 0);
+        std::string first, second;
+        for (int k = 0; k < 3000; ++k) {
+            const std::string a = std::to_string(k) + ",";
+            const std::string b = std::to_string(-k) + ";";
+            first += a;
+            second += b;
+            sections.Append(1, b);
+            sections.Append(0, a);
+        }
+        REQUIRE(0 < sections.Spilled());
+        sections.Write(out);
+        REQUIRE(out.str() == first + second);
+        out.str("");
+        sections.Append(1, "y");
+        sections.Append(0, "x");
+        sections.Write(out);
+        REQUIRE(out.str() == "xy");
+    }
+}
+
+#endif
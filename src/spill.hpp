@@ -0,0 +1,79 @@
+//
+//  spill.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(SPILL_HPP)
+#define SPILL_HPP
+
+// Output that is produced in a different order than it is written. Data is
+// appended to numbered sections in any order and the sections are written
+// out one after another at the end. Each section keeps its share of a memory
+// budget and moves the rest to a temporary file, so memory use does not
+// depend on the output size.
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+
+// File in TMPDIR, or in /tmp, created on the first Append and removed right
+// away so that it goes away with the object.
+class TemporaryFile {
+private:
+    int fd;
+    std::uint64_t size;
+
+public:
+    TemporaryFile();
+    ~TemporaryFile();
+    TemporaryFile(const TemporaryFile&) = delete;
+    TemporaryFile& operator=(const TemporaryFile&) = delete;
+
+    std::uint64_t Size() const { return size; }
+    // Throws if the file can not be created or written.
+    void Append(const char* Data, std::size_t Length);
+    // Reads Length bytes from Offset. Throws if they can not be read.
+    void Read(char* Data, std::size_t Length, std::uint64_t Offset) const;
+    // Drops the contents.
+    void Clear();
+};
+
+class SpilledSections {
+private:
+    struct Segment {
+        std::uint64_t offset, length;
+    };
+    TemporaryFile file;
+    std::size_t limit;
+    std::vector<std::string> pending;
+    std::vector<std::vector<Segment>> segments;
+
+    void spill(std::size_t Section);
+
+public:
+    // Count sections sharing Budget bytes. The file is created in TMPDIR, or
+    // in /tmp, when a section first exceeds its share, and removed right away
+    // so that it goes away with the object. Throws if it can not be created.
+    SpilledSections(std::size_t Count, std::size_t Budget);
+    SpilledSections(const SpilledSections&) = delete;
+    SpilledSections& operator=(const SpilledSections&) = delete;
+
+    std::size_t Count() const { return pending.size(); }
+    void Append(std::size_t Section, const char* Data, std::size_t Length);
+    void Append(std::size_t Section, const std::string& Data) {
+        Append(Section, Data.data(), Data.size());
+    }
+    // Bytes moved to the file so far.
+    std::uint64_t Spilled() const { return file.Size(); }
+    // Writes the sections in order and empties them. Throws if the file can
+    // not be read.
+    void Write(std::ostream& Out);
+};
+
+#endif
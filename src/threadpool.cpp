@@ -0,0 +1,148 @@
+//
+//  threadpool.cpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#include "threadpool.hpp"
+#include <algorithm>
+#if defined(UNITTEST)
+#include <doctest/doctest.h>
+#include <atomic>
+#include <stdexcept>
+#endif
+
+
+ThreadPool::ThreadPool(std::size_t Threads)
+    : job(nullptr), job_count(0), job_parts(0), next_part(0), done_parts(0),
+    generation(0), stop(false)
+{
+    if (Threads == 0)
+        Threads = std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t k = 1; k < Threads; ++k)
+        workers.push_back(std::thread(&ThreadPool::worker, this));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers)
+        w.join();
+}
+
+void ThreadPool::run_parts() {
+    while (true) {
+        std::size_t part;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (job == nullptr || next_part == job_parts)
+                return;
+            part = next_part++;
+        }
+        try {
+            (*job)(part * job_count / job_parts,
+                (part + 1) * job_count / job_parts);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++done_parts == job_parts)
+            done.notify_all();
+    }
+}
+
+void ThreadPool::worker() {
+    unsigned long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this, seen]() {
+                return stop || (job != nullptr && generation != seen);
+            });
+            if (stop)
+                return;
+            seen = generation;
+        }
+        run_parts();
+    }
+}
+
+void ThreadPool::ParallelFor(std::size_t Count, const Range& Work) {
+    if (Count == 0)
+        return;
+    // Several parts per thread even out rows that differ in cost.
+    const std::size_t parts = std::min(Count, 4 * Size());
+    if (workers.empty() || parts == 1) {
+        Work(0, Count);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &Work;
+        job_count = Count;
+        job_parts = parts;
+        next_part = done_parts = 0;
+        error = nullptr;
+        ++generation;
+    }
+    wake.notify_all();
+    run_parts();
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]() { return done_parts == job_parts; });
+    job = nullptr;
+    if (error) {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+#if defined(UNITTEST)
+
+TEST_CASE("ThreadPool") {
+    SUBCASE("Covers range once") {
+        ThreadPool pool(4);
+        REQUIRE(pool.Size() == 4);
+        std::vector<std::atomic<int>> hits(1000);
+        for (auto& h : hits)
+            h = 0;
+        for (int round = 0; round < 3; ++round)
+            pool.ParallelFor(hits.size(), [&hits](std::size_t B, std::size_t E) {
+                for (std::size_t k = B; k < E; ++k)
+                    ++hits[k];
+            });
+        for (auto& h : hits)
+            REQUIRE(h == 3);
+    }
+    SUBCASE("Single thread") {
+        ThreadPool pool(1);
+        std::size_t sum = 0;
+        pool.ParallelFor(10, [&sum](std::size_t B, std::size_t E) {
+            for (std::size_t k = B; k < E; ++k)
+                sum += k;
+        });
+        REQUIRE(sum == 45);
+    }
+    SUBCASE("Exception") {
+        ThreadPool pool(3);
+        REQUIRE_THROWS_AS(pool.ParallelFor(100, [](std::size_t B, std::size_t E) {
+            if (B <= 50 && 50 < E)
+                throw std::runtime_error("fail");
+        }), std::runtime_error);
+        std::atomic<std::size_t> count(0);
+        pool.ParallelFor(100, [&count](std::size_t B, std::size_t E) {
+            count += E - B;
+        });
+        REQUIRE(count == 100);
+    }
+}
+
+#endif
@@ -0,0 +1,56 @@
+//
+//  threadpool.hpp
+//
+//  Created by Ismo Kärkkäinen on 19.10.2026.
+//  Copyright © 2026 Ismo Kärkkäinen. All rights reserved.
+//
+// Licensed under Universal Permissive License. See License.txt.
+
+#if !defined(THREADPOOL_HPP)
+#define THREADPOOL_HPP
+
+// Fixed set of worker threads that split index ranges between them.
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <cstddef>
+
+
+class ThreadPool {
+public:
+    typedef std::function<void(std::size_t Begin, std::size_t End)> Range;
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const Range* job;
+    std::size_t job_count, job_parts, next_part, done_parts;
+    unsigned long generation;
+    bool stop;
+    std::exception_ptr error;
+
+    void run_parts();
+    void worker();
+
+public:
+    // Zero threads means one per hardware thread. The caller of ParallelFor
+    // works too, so one less worker thread is started.
+    ThreadPool(std::size_t Threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t Size() const { return workers.size() + 1; }
+
+    // Calls Work with consecutive sub-ranges of [0, Count) until all are
+    // done. Rethrows the first exception thrown by Work.
+    void ParallelFor(std::size_t Count, const Range& Work);
+};
+
+#endif